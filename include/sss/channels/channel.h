@@ -8,11 +8,18 @@
 //
 #pragma once
 
+#include <deque>
+#include <functional>
 #include <boost/asio.hpp>
 #include "sodiumpp/sodiumpp.h"
 #include "arsenal/byte_array.h"
 #include "uia/comm/socket.h"
 #include "sss/framing/stream_protocol.h"
+#include "sss/framing/frame_parser.h"
+#include "sss/channels/message_header.h"
+#include "sss/channels/priority_tree.h"
+#include "sss/channels/deadline_queue.h"
+#include "sss/channels/path_scheduler.h"
 #include "sss/streams/base_stream.h"
 #include "sss/internal/usid.h"
 #include "sss/internal/timer.h"
@@ -24,13 +31,20 @@ class stream_rx_attachment;
 namespace internal {
 class stream_peer;
 } // internal namespace
+namespace framing {
+class framing_t;
+class frame_writer;
+class padding_policy;
+} // framing namespace
 
 /**
  * Abstract base class representing a channel between a local link and a remote endpoint.
  */
 class channel : public socket_channel
 {
-    friend class base_stream; // @fixme *sigh*
+    friend class base_stream;        // @fixme *sigh*
+    friend class framing::framing_t; // Delivers received frames.
+    friend class channel_host_state; // Dispatches compact MESSAGE packets.
 
     using super = socket_channel;
 
@@ -42,6 +56,10 @@ class channel : public socket_channel
     byte_array tx_channel_id_; ///< Transmit ID of the channel.
     byte_array rx_channel_id_; ///< Receive ID of the channel.
 
+    /// Connection IDs exchanged in INITIATE for compact MESSAGE headers, 0 if not negotiated.
+    channels::connection_id_t tx_connection_id_{0}; ///< Issued by peer, sent in our packets.
+    channels::connection_id_t rx_connection_id_{0}; ///< Issued by us, registered with host.
+
     uia::comm::socket::status link_status_{
         uia::comm::socket::status::down}; ///< Link online status.
 
@@ -79,6 +97,57 @@ public:
         rx_channel_id_ = rx_id;
     }
 
+    /**
+     * Set connection IDs negotiated during INITIATE.
+     * rx_cid must come from host's allocate_connection_id(), the channel registers it
+     * with the host for compact MESSAGE lookup while active.
+     * Once tx_cid is set, packets are sent with the compact header.
+     */
+    void set_connection_ids(channels::connection_id_t tx_cid, channels::connection_id_t rx_cid);
+
+    inline channels::connection_id_t tx_connection_id() const { return tx_connection_id_; }
+    inline channels::connection_id_t rx_connection_id() const { return rx_connection_id_; }
+
+    /**
+     * Validated path MTU: datagram size including IP and UDP headers.
+     * Starts at stream_protocol::mtu and grows as path MTU probes get acknowledged.
+     */
+    size_t path_mtu() const;
+
+    /// Largest packet payload (frames) fitting into the validated path MTU.
+    inline size_t max_payload_size() const
+    {
+        return path_mtu() - stream_protocol::datagram_overhead;
+    }
+
+    /**
+     * Set upper limit for path MTU discovery. Default is stream_protocol::ethernet_mtu,
+     * use stream_protocol::jumbo_mtu on datacenter LANs with jumbo frames or on loopback.
+     */
+    void set_max_path_mtu(size_t max_mtu);
+
+    /**
+     * Network address the peer is currently reached at. Set from the key exchange,
+     * changes when the peer moves to an address that passes path validation.
+     */
+    uia::comm::socket_endpoint const& peer_endpoint() const;
+    void set_peer_endpoint(uia::comm::socket_endpoint const& ep);
+
+    /// Smoothed round-trip time estimate, initial guess until measured.
+    async::timer::duration_type smoothed_rtt() const;
+
+    /**
+     * Congestion control state of this channel's network path, in bytes,
+     * for spreading streams over several channels to the same peer.
+     */
+    path_estimate tx_path_estimate() const;
+
+    /**
+     * Padding policy applied to assembled packets, with counters of padding bytes sent.
+     * Default is padding to a multiple of 16 bytes as required by spec.
+     */
+    framing::padding_policy& tx_padding();
+
     /**
      * May be called by upper-level protocols during receive
      * to indicate that the packet has been received and processed,
@@ -119,6 +188,32 @@ protected:
      */
     bool channel_transmit(boost::asio::const_buffer packet, packet_seq_t& packet_seq);
 
+    /**
+     * Fill in packet header for the packet with given sequence number.
+     * Packet sequence gets the shortest encoding the peer can unambiguously expand,
+     * given the largest sequence it has acknowledged; version is included until
+     * the peer acknowledges one of our packets.
+     */
+    framing::packet_header_view tx_packet_header(packet_seq_t packet_seq) const;
+
+    /// Sequence number the next transmitted packet will get.
+    packet_seq_t tx_next_sequence() const;
+
+    /**
+     * Fill in compact MESSAGE header for the packet with given sequence number,
+     * which also serves as the packet's nonce. Valid only once tx_connection_id() is set.
+     */
+    channels::compact_message_header tx_message_header(packet_seq_t packet_seq) const;
+
+    /**
+     * Transmit a packet carrying only channel control frames, such as credit updates.
+     * write_frames fills the packet after its header and returns false if there's nothing
+     * to send. Control packets aren't retransmitted, their senders must recover from loss.
+     * Packet goes to the peer endpoint unless another destination is given.
+     */
+    bool tx_control_packet(std::function<bool(framing::frame_writer&)> const& write_frames,
+                           uia::comm::socket_endpoint const* to = nullptr);
+
     /**
      * Main method for upper-layer subclass to receive a packet on a channel.
      * Should return true if the packet was processed and should be acked,
@@ -126,6 +221,15 @@ protected:
      */
     virtual bool channel_receive(boost::asio::mutable_buffer pkt, packet_seq_t packet_seq) = 0;
 
+    /**
+     * Process a single frame received in the packet with given sequence number.
+     * Frame view points into the decrypted packet and is valid only for the duration of this call.
+     * Channel handles channel-level frames (ACK, DECONGESTION, CLOSE, SETTINGS),
+     * subclasses override this to handle stream-level frames.
+     * Should return true if the frame requires the packet to be acknowledged.
+     */
+    virtual bool channel_receive_frame(framing::frame_view const& frame, packet_seq_t packet_seq);
+
     /**
      * Create and transmit a packet for acknowledgment purposes only.
      * Upper layer may override this if ack packets should contain
@@ -140,7 +244,39 @@ protected:
 private:
     void start_retransmit_timer();
 
-    packet_seq_t derive_packet_seq(packet_seq_t partial_seq);
+    /// Send a PADDING-filled path MTU probe if discovery needs one.
+    void tx_pmtu_probe();
+
+    /** @name Connection migration. */
+    /**@{*/
+    /**
+     * Authenticated packet arrived from an address other than the peer endpoint,
+     * start validating it if newest is set (packet is the highest sequence seen so far).
+     */
+    void rx_new_source(uia::comm::socket_endpoint const& src, bool newest);
+    /// Send PATH_CHALLENGE for the address being validated.
+    void tx_path_challenge();
+    /**
+     * Move the channel to a validated peer address. Streams stay attached, congestion
+     * control and path MTU start over since nothing is known about the new path.
+     */
+    void migrate_to(uia::comm::socket_endpoint const& ep);
+    /**@}*/
+
+    /**
+     * Reconstruct full packet sequence number from the truncated one found in packet header.
+     * Returns 0 if the sequence is not valid, the packet was already received or is too old
+     * to tell, i.e. below the receive mask window.
+     */
+    packet_seq_t derive_packet_seq(uint64_t truncated_seq, uint8_t sequence_size);
+
+    /**
+     * Handle ACK frame received in packet rxackseq: report newly acknowledged packets through
+     * acknowledged() and those still missing past miss_threshold through missed(), update
+     * congestion control and stop sending protocol version once the peer has acknowledged
+     * a versioned packet.
+     */
+    void rx_ack_frame(framing::ack_frame_view const& ack, packet_seq_t rxackseq);
 
     /** @name Internal transmit methods. */
     /**@{*/
@@ -150,11 +286,13 @@ private:
      * encrypt, authenticate, and transmit a packet whose cleartext header and data are
      * already fully set up, with a specified ACK sequence/count word.
      * Returns true on success, false on error (e.g., no output buffer space for packet)
+     * Packet goes to the peer endpoint unless another destination is given.
      */
     bool transmit(boost::asio::const_buffer packet,
                   uint32_t ack_seq,
                   packet_seq_t& packet_seq,
-                  bool is_data);
+                  bool is_data,
+                  uia::comm::socket_endpoint const* to = nullptr);
 
     /**
      * Transmit ack packet with no extra payload.
@@ -202,6 +340,8 @@ private:
     void retransmit_timeout(bool failed); ///< Retransmission timeout
     void ack_timeout();                   ///< Delayed ACK timeout
     void stats_timeout();                 ///< Stats gathering
+    void pmtu_timeout();                  ///< Path MTU search restart
+    void path_challenge_timeout();        ///< PATH_RESPONSE didn't arrive
 };
 
 /**
@@ -256,19 +396,35 @@ class stream_channel : public channel, public stream_protocol
     std::unordered_set<local_stream_id_t> closed_streams_;
 
     /**
-     * Streams queued for transmission on this channel.
-     * This should be a priority queue for simplicity of enqueueing.
-     * We use deque with the limitation that only push_back() and pop_front() are used.
-     * Of course insertion into a deque is a bit more involved.
-     * @fixme would prefer a smarter scheduling algorithm, e.g., stride.
+     * Streams queued for transmission on this channel, scheduled by priority and then
+     * by bytes sent relative to their weights, each level of the stream tree sharing
+     * its parent's bandwidth.
+     */
+    priority_tree<base_stream> sending_streams_;
+
+    /**
+     * Streams whose next frame has a deadline, served earliest deadline first
+     * ahead of all sending_streams_.
      */
-    std::deque<base_stream*> sending_streams_;
+    deadline_queue<base_stream> deadline_streams_;
 
     /**
-     * Packets transmitted and waiting for acknowledgment,
-     * indexed by assigned transmit sequence number.
+     * Frames transmitted and waiting for acknowledgment,
+     * indexed by transmit sequence number of the packet carrying them.
+     */
+    std::unordered_multimap<packet_seq_t, base_stream::tx_frame_t> waiting_ack_;
+
+    /** @name Packet assembly
+     * Frames from several streams are packed into one packet in scheduling order. The packet
+     * goes out when the next frame doesn't fit or the channel has served all ready streams,
+     * so no packet stays open between got_ready_transmit() calls. Frames are written after
+     * room for the largest packet header, the header itself is filled in when sending.
      */
-    std::unordered_map<packet_seq_t, base_stream::tx_frame_t> waiting_ack_;
+    /**@{*/
+    byte_array tx_packet_;                             ///< Packet being assembled.
+    std::unique_ptr<framing::frame_writer> tx_writer_; ///< Frames writer, null if none open.
+    std::vector<base_stream::tx_frame_t> tx_packed_;   ///< Frames in the packet, to wait ACK.
+    /**@}*/
 
     /**
      * Packets already presumed lost ("missed")
@@ -276,6 +432,46 @@ class stream_channel : public channel, public stream_protocol
      */
     std::unordered_map<packet_seq_t, base_stream::tx_frame_t> waiting_expiry_;
 
+    /** @name Channel-level flow control
+     * Credit shared by all streams on the channel, bounding stream data the peer may have
+     * in our receive buffers (spec 4.2.12). Stream windows still apply within it.
+     * Both directions count new stream bytes, by highest offset, from the channel start.
+     */
+    /**@{*/
+    uint64_t tx_credit_limit_{initial_channel_credit}; ///< Credit granted by peer.
+    uint64_t tx_credit_used_{0};                       ///< New stream bytes sent.
+    std::vector<base_stream*> tx_credit_blocked_;      ///< Streams waiting for more credit.
+
+    uint64_t rx_credit_limit_{initial_channel_credit}; ///< Credit granted to peer.
+    uint64_t rx_credit_used_{0};                       ///< New stream bytes received.
+    uint64_t rx_credit_consumed_{0};                   ///< Received bytes read by application.
+    uint64_t rx_credit_window_{default_credit_window}; ///< Credit kept ahead of reads.
+    /**@}*/
+
+    /** @name Orphan INIT frames
+     * INIT frames whose parent LSID we don't know yet, the parent's own INIT being lost
+     * or reordered. Their packets are acknowledged like any other, so they are kept here
+     * and replayed once the parent attaches. Oldest are reset when the limits are hit.
+     */
+    /**@{*/
+    struct orphan_frame
+    {
+        packet_seq_t pktseq;
+        framing::stream_frame_view frame; ///< usid and data point into bytes.
+        std::vector<uint8_t> bytes;       ///< Stream USID if present, then the data.
+    };
+    static constexpr size_t max_orphan_frames = 32;
+    static constexpr size_t max_orphan_bytes  = 4 * initial_substream_window;
+
+    std::deque<orphan_frame> rx_orphans_;
+    size_t rx_orphan_bytes_{0};
+
+    /// Keep an INIT frame for an unknown parent until the parent attaches.
+    void rx_hold_orphan(packet_seq_t pktseq, framing::stream_frame_view const& frame);
+    /// Process frames held for parent_sid, now attached at parent_seq.
+    void rx_replay_orphans(local_stream_id_t parent_sid, packet_seq_t parent_seq);
+    /**@}*/
+
     /**
      * RxSID of stream on which we last received a packet -
      * this determines for which stream we send receive window info
@@ -288,6 +484,9 @@ class stream_channel : public channel, public stream_protocol
     void got_ready_transmit();
 
 public:
+    /// Default channel credit window, enough for one stream at its largest auto-tuned window.
+    static constexpr uint64_t default_credit_window = 16 << 20;
+
     stream_channel(std::shared_ptr<host> host,
                    sss::internal::stream_peer* peer,
                    uia::peer_identity const& id);
@@ -303,6 +502,30 @@ public:
 
     void enqueue_stream(base_stream* stream);
     void dequeue_stream(base_stream* stream);
+    /// Pick up changed stream priority or weight, moving its whole subtree along.
+    void reprioritize_stream(base_stream* stream);
+    /// Move stream with its substreams under a different parent in the transmit schedule.
+    void reparent_stream(base_stream* stream, base_stream* parent);
+
+    /**
+     * Set how much stream data the peer may send ahead of application reads,
+     * across all streams on this channel. Takes effect with the next credit update.
+     */
+    inline void set_receive_credit_window(uint64_t window) { rx_credit_window_ = window; }
+    inline uint64_t receive_credit_window() const { return rx_credit_window_; }
+    /// Stream bytes we may still send on this channel before running out of credit.
+    inline uint64_t transmit_credit() const { return tx_credit_limit_ - tx_credit_used_; }
+
+    /// Outcome of frames written with a deadline, for sizing capacity of latency-critical streams.
+    struct deadline_counters
+    {
+        uint64_t sent_frames{0};    ///< Frames with a deadline transmitted.
+        uint64_t late_frames{0};    ///< Reliable frames first sent after their deadline.
+        uint64_t dropped_frames{0}; ///< Unreliable frames dropped unsent after their deadline.
+    };
+
+    inline deadline_counters const& deadline_stats() const { return deadline_counters_; }
+    inline void reset_deadline_stats() { deadline_counters_ = deadline_counters{}; }
 
     /**
      * Detach all streams currently transmit-attached to this channel,
@@ -321,6 +544,58 @@ public:
     void expire(packet_seq_t txseq, int npackets) override;
 
     bool channel_receive(boost::asio::mutable_buffer pkt, packet_seq_t packet_seq) override;
+
+protected:
+    /**
+     * Dispatch stream-level frames (STREAM, DETACH, RESET, PRIORITY, MAX_STREAM_DATA,
+     * STREAM_DATA_BLOCKED) to their streams, handle channel credit frames (MAX_DATA,
+     * DATA_BLOCKED).
+     */
+    bool channel_receive_frame(framing::frame_view const& frame, packet_seq_t packet_seq) override;
+
+private:
+    deadline_counters deadline_counters_;
+
+    /**
+     * Find receive attachment for the peer's stream ID, nullptr if there's none.
+     */
+    stream_rx_attachment* rx_attachment(local_stream_id_t sid) const;
+
+    /// Stream's parent in the transmit schedule, nullptr for the top of the tree.
+    base_stream* schedule_parent(base_stream* stream);
+
+    inline bool has_sending_streams() const
+    {
+        return not deadline_streams_.empty() or not sending_streams_.empty();
+    }
+
+    /**
+     * Make room for a frame of frame_size bytes in the packet being assembled,
+     * sending the packet off first if the frame doesn't fit.
+     * @return false if the channel may not transmit another packet right now.
+     */
+    bool tx_make_room(size_t frame_size);
+    /// Add frame to the packet being assembled, opening a new one if needed.
+    void tx_pack_frame(base_stream::tx_frame_t const& p, framing::stream_frame_view const& frame);
+    /// Send the packet being assembled, if any, and register its frames as waiting for ACK.
+    void tx_flush();
+    /// Forget frame p of the given packet, leaving other streams' frames waiting.
+    void erase_waiting_ack(packet_seq_t packet_seq, base_stream::tx_frame_t const& p);
+
+    /**
+     * Charge bytes of new stream data about to be sent to the credit granted by peer.
+     * If there isn't enough, returns false and requeues the stream once peer extends it.
+     */
+    bool tx_consume_credit(size_t bytes, base_stream* stream);
+    /// Charge bytes of new stream data received, false if peer exceeded its credit.
+    bool rx_charge_credit(size_t bytes);
+    /// Account for received bytes read by application, extending peer's credit when due.
+    void rx_release_credit(size_t bytes);
+
+    void tx_max_data();
+    void tx_data_blocked();
+    void rx_max_data_frame(framing::max_data_frame_view const& frame);
+    void rx_data_blocked_frame(framing::data_blocked_frame_view const& frame);
 };
 
 } // sss namespace
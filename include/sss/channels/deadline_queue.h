@@ -0,0 +1,92 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <cassert>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace sss {
+
+/**
+ * Earliest-deadline-first queue for streams with latency-critical data waiting to transmit.
+ *
+ * Each ready item is keyed by the deadline of the data it will send next, pop() returns
+ * the item whose deadline comes first. Items with equal deadlines are served in the order
+ * they became ready. push(), pop() and remove() are O(log n).
+ */
+template <typename T>
+class deadline_queue
+{
+public:
+    using ptime = boost::posix_time::ptime;
+
+private:
+    using queue_t = std::multimap<ptime, T*>;
+
+    queue_t queue_;
+    std::unordered_map<T*, typename queue_t::iterator> index_;
+
+public:
+    inline size_t size() const { return queue_.size(); }
+    inline bool empty() const { return queue_.empty(); }
+    inline bool is_ready(T* item) const { return index_.find(item) != index_.end(); }
+
+    /// Deadline of the item pop() would return. Queue must not be empty.
+    inline ptime earliest() const
+    {
+        assert(not empty());
+        return queue_.begin()->first;
+    }
+
+    /// Make item ready with given deadline, moving it if it's already queued.
+    void push(T* item, ptime deadline)
+    {
+        assert(not deadline.is_special());
+        auto it = index_.find(item);
+        if (it != index_.end()) {
+            if (it->second->first == deadline) {
+                return;
+            }
+            queue_.erase(it->second);
+            it->second = queue_.insert({deadline, item});
+            return;
+        }
+        index_.insert({item, queue_.insert({deadline, item})});
+    }
+
+    /// Take the item with the earliest deadline out of the queue. Queue must not be empty.
+    T* pop()
+    {
+        assert(not empty());
+        T* item = queue_.begin()->second;
+        queue_.erase(queue_.begin());
+        index_.erase(item);
+        return item;
+    }
+
+    void remove(T* item)
+    {
+        auto it = index_.find(item);
+        if (it == index_.end()) {
+            return;
+        }
+        queue_.erase(it->second);
+        index_.erase(it);
+    }
+
+    void clear()
+    {
+        queue_.clear();
+        index_.clear();
+    }
+};
+
+} // sss namespace
@@ -0,0 +1,126 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include "sss/framing/packet_sequence.h"
+
+namespace sss {
+namespace channels {
+
+/**
+ * Connection identifier issued by the receiving side during INITIATE.
+ * Peer puts it into compact MESSAGE headers so that the receiver finds the channel
+ * with a single hash lookup instead of matching 32-byte short-term keys.
+ * Zero is never issued.
+ */
+using connection_id_t = uint64_t;
+
+/**
+ * Compact MESSAGE packet header, used after the handshake instead of
+ * 8-byte magic, 32-byte short-term public key and 8-byte nonce (48 bytes).
+ *
+ * @verbatim
+ * +----------+-------------------+-------------+--------
+ * | 100000ss | connection id (8) | nonce (2-8) | box...
+ * +----------+-------------------+-------------+--------
+ * @endverbatim
+ * Marker bit 0x80 never appears in the first byte of full packets, whose magic is ASCII.
+ * ss bits encode the truncated nonce size exactly as in the packet header (2, 4, 6 or 8 bytes),
+ * receiver expands it around the largest nonce received so far.
+ */
+struct compact_message_header
+{
+    static constexpr uint8_t marker          = 0x80;
+    static constexpr uint8_t reserved_mask   = 0x7c;
+    static constexpr uint8_t nonce_size_mask = 0x03;
+    static constexpr size_t min_size         = 1 + 8 + 2;
+    static constexpr size_t max_size         = 1 + 8 + 8;
+
+    connection_id_t connection_id;
+    uint64_t nonce;     ///< Truncated on the wire, full after read().
+    uint8_t nonce_size; ///< 2, 4, 6 or 8.
+
+    inline size_t size() const { return 1 + 8 + nonce_size; }
+
+    /// Check if packet starts with compact header rather than with a magic.
+    static inline bool is_compact(boost::asio::const_buffer packet)
+    {
+        return boost::asio::buffer_size(packet) > 0
+               and (*boost::asio::buffer_cast<uint8_t const*>(packet) & marker);
+    }
+
+    /**
+     * Write header to the beginning of buf.
+     * @return Number of bytes written, 0 if it doesn't fit or nonce_size is invalid.
+     */
+    inline size_t write(boost::asio::mutable_buffer buf) const
+    {
+        if ((nonce_size & 1) or nonce_size < 2 or nonce_size > 8
+            or boost::asio::buffer_size(buf) < size()) {
+            return 0;
+        }
+        uint8_t* p = boost::asio::buffer_cast<uint8_t*>(buf);
+        *p++       = marker | ((nonce_size / 2) - 1);
+        p          = put(p, connection_id, 8);
+        put(p, nonce, nonce_size);
+        return size();
+    }
+
+    /**
+     * Read header from the beginning of buf, expanding the nonce around
+     * largest_nonce, the largest nonce received on the channel so far.
+     * @return Number of bytes consumed, 0 if the header is malformed.
+     */
+    inline size_t read(boost::asio::const_buffer buf, uint64_t largest_nonce)
+    {
+        size_t avail     = boost::asio::buffer_size(buf);
+        uint8_t const* p = boost::asio::buffer_cast<uint8_t const*>(buf);
+        if (avail < min_size or not(p[0] & marker) or (p[0] & reserved_mask)) {
+            return 0;
+        }
+        nonce_size = ((p[0] & nonce_size_mask) + 1) * 2;
+        if (avail < size()) {
+            return 0;
+        }
+        connection_id = get(p + 1, 8);
+        nonce = framing::expand_packet_sequence(get(p + 9, nonce_size), nonce_size, largest_nonce);
+        return size();
+    }
+
+    /// Extract connection id for channel lookup, 0 if packet is not a compact message.
+    static inline connection_id_t peek_connection_id(boost::asio::const_buffer packet)
+    {
+        if (boost::asio::buffer_size(packet) < min_size or not is_compact(packet)) {
+            return 0;
+        }
+        return get(boost::asio::buffer_cast<uint8_t const*>(packet) + 1, 8);
+    }
+
+private:
+    static inline uint8_t* put(uint8_t* p, uint64_t value, size_t size)
+    {
+        for (size_t i = size; i > 0; --i) {
+            *p++ = uint8_t(value >> ((i - 1) * 8));
+        }
+        return p;
+    }
+
+    static inline uint64_t get(uint8_t const* p, size_t size)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+};
+
+} // channels namespace
+} // sss namespace
@@ -0,0 +1,104 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "sss/framing/stream_protocol.h"
+
+namespace sss {
+namespace channels {
+
+/**
+ * Packetization layer path MTU discovery (DPLPMTUD, RFC 8899) for a channel.
+ *
+ * Every path is assumed to carry stream_protocol::mtu (1280) byte datagrams. Larger sizes
+ * are validated with probe packets of a PING frame and PADDING: the first probe tries
+ * the configured maximum right away, so LAN and loopback paths validate in one round trip,
+ * after that the search bisects between the largest acknowledged and smallest failed size.
+ * A size is considered failed after max_probes lost probes.
+ *
+ * Black hole detection: if black_hole_threshold consecutive packets larger than base mtu
+ * are lost while smaller ones get through, the path MTU falls back to the base mtu
+ * until the search is restarted.
+ *
+ * This class only keeps the state, channel sends probes and feeds back acks and losses.
+ * All sizes are datagram sizes, including IP and UDP headers.
+ */
+class path_mtu_discovery
+{
+public:
+    enum class state
+    {
+        searching,       ///< Probing for larger sizes.
+        search_complete, ///< Largest size found, waiting for restart() to probe again.
+        black_hole,      ///< Large packets are being lost, using base mtu.
+    };
+
+    static constexpr size_t base_mtu          = stream_protocol::mtu;
+    static constexpr int max_probes           = 3;
+    static constexpr int black_hole_threshold = 3;
+    /// Probe sizes are multiples of this, as required for message padding.
+    static constexpr size_t search_granularity = 16;
+
+private:
+    state state_{state::searching};
+    size_t mtu_{base_mtu};      ///< Validated path MTU.
+    size_t max_mtu_;            ///< Upper limit of the search.
+    size_t search_high_;        ///< Largest size not yet known to fail.
+    size_t probe_size_{0};      ///< Size of probe in flight, 0 if none.
+    packet_seq_t probe_seq_{0}; ///< Sequence number of probe in flight.
+    int probe_count_{0};        ///< Lost probes of the current probe size.
+    int large_losses_{0};       ///< Consecutive lost packets larger than base mtu.
+
+public:
+    explicit path_mtu_discovery(size_t max_mtu = stream_protocol::ethernet_mtu);
+
+    /// Validated path MTU, safe to use for every packet.
+    inline size_t mtu() const { return mtu_; }
+    inline size_t max_mtu() const { return max_mtu_; }
+    inline state current_state() const { return state_; }
+
+    inline bool probe_in_flight() const { return probe_size_ != 0; }
+    inline packet_seq_t probe_sequence() const { return probe_seq_; }
+
+    /**
+     * Change the upper limit of the search, e.g. to stream_protocol::jumbo_mtu on
+     * datacenter LANs and loopback. Restarts the search.
+     */
+    void set_max_mtu(size_t max_mtu);
+
+    /// Size of the next probe to send, 0 if there's nothing to probe right now.
+    size_t next_probe_size() const;
+
+    void probe_sent(packet_seq_t packet_seq, size_t size);
+
+    /**
+     * Probe acknowledged, its size becomes the validated path MTU.
+     * @return true if validated path MTU has changed.
+     */
+    bool probe_acked();
+    /// Probe lost, the size is given up on after max_probes losses.
+    void probe_lost();
+
+    /// Regular packet acknowledged, for black hole detection.
+    void packet_acked(size_t size);
+    /**
+     * Regular packet lost, for black hole detection.
+     * @return true if validated path MTU has fallen back to base mtu.
+     */
+    bool packet_lost(size_t size);
+
+    /// Start a new search from the current path MTU, called periodically by the channel.
+    void restart();
+
+private:
+    void check_complete();
+};
+
+} // channels namespace
+} // sss namespace
@@ -0,0 +1,98 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace sss {
+
+/**
+ * Congestion control state of one network path, as seen by the sender.
+ */
+struct path_estimate
+{
+    using time_duration = boost::posix_time::time_duration;
+
+    time_duration srtt;  ///< Smoothed round-trip time.
+    size_t window{0};    ///< Congestion window in bytes.
+    size_t in_flight{0}; ///< Bytes sent and not yet acknowledged or lost.
+
+    /**
+     * Estimated time for bytes sent now to reach the peer: the path delivers a window per
+     * round trip, so data queued behind what's in flight waits its turn, plus one-way delay.
+     */
+    time_duration delivery_time(size_t bytes) const
+    {
+        if (window == 0) {
+            return boost::posix_time::pos_infin;
+        }
+        auto queued = srtt.total_microseconds() * double(in_flight + bytes) / window;
+        return srtt / 2 + boost::posix_time::microseconds(int64_t(queued));
+    }
+};
+
+/**
+ * Set of network paths to one peer, picking the path that delivers the next frame first.
+ *
+ * Each path runs its own congestion control, so a fast path with room in its window gets
+ * most frames while a slow or congested one still takes what it can deliver in time.
+ * T must provide is_active() and tx_path_estimate() returning a path_estimate.
+ */
+template <typename T>
+class path_scheduler
+{
+    std::vector<T*> paths_;
+
+public:
+    inline size_t size() const { return paths_.size(); }
+    inline bool empty() const { return paths_.empty(); }
+    inline std::vector<T*> const& paths() const { return paths_; }
+
+    inline bool contains(T* path) const
+    {
+        return std::find(paths_.begin(), paths_.end(), path) != paths_.end();
+    }
+
+    void add(T* path)
+    {
+        if (not contains(path)) {
+            paths_.push_back(path);
+        }
+    }
+
+    void remove(T* path)
+    {
+        paths_.erase(std::remove(paths_.begin(), paths_.end(), path), paths_.end());
+    }
+
+    /**
+     * Active path with the earliest estimated delivery time for a frame of given size,
+     * nullptr if no path is active. Ties go to the path added first.
+     */
+    T* select(size_t bytes) const
+    {
+        T* best = nullptr;
+        boost::posix_time::time_duration best_time;
+        for (auto path : paths_) {
+            if (not path->is_active()) {
+                continue;
+            }
+            auto time = path->tx_path_estimate().delivery_time(bytes);
+            if (not best or time < best_time) {
+                best      = path;
+                best_time = time;
+            }
+        }
+        return best;
+    }
+};
+
+} // sss namespace
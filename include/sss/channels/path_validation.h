@@ -0,0 +1,103 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace sss {
+
+/**
+ * Validation of a new peer address before a channel migrates to it.
+ *
+ * An authenticated packet arriving from an address other than the current one means the
+ * peer moved or a NAT rebound its mapping. Authentication alone proves the packet came from
+ * the peer, not that the peer is reachable at that address: an attacker could replay it
+ * from elsewhere. So the channel sends a PATH_CHALLENGE with an unpredictable value to the
+ * candidate address and migrates only once a PATH_RESPONSE echoes that value back.
+ *
+ * Only packets newer than anything received so far start a validation, so reordered or
+ * replayed old packets can't redirect the channel. Endpoint must be equality comparable.
+ */
+template <typename Endpoint>
+class path_validation
+{
+    Endpoint candidate_;
+    uint64_t challenge_{0};
+    unsigned attempts_{0};
+    bool in_progress_{false};
+
+public:
+    /// Challenges sent to a candidate address before giving up on it.
+    static constexpr unsigned max_challenges = 3;
+
+    inline bool in_progress() const { return in_progress_; }
+    inline Endpoint const& candidate() const { return candidate_; }
+    inline uint64_t challenge() const { return challenge_; }
+    inline unsigned attempts() const { return attempts_; }
+
+    /**
+     * Authenticated packet arrived from address src other than the current peer address.
+     * @param newest Packet has the highest sequence number received so far.
+     * @param challenge Fresh random value to use if a new validation starts.
+     * @return true if a PATH_CHALLENGE should be sent to src.
+     */
+    bool packet_from(Endpoint const& src, bool newest, uint64_t challenge)
+    {
+        if (not newest or (in_progress_ and src == candidate_)) {
+            return false;
+        }
+        // The peer moved again while validating, or this is the first move: (re)start.
+        candidate_   = src;
+        challenge_   = challenge;
+        attempts_    = 0;
+        in_progress_ = true;
+        return true;
+    }
+
+    /// PATH_CHALLENGE went out to the candidate address.
+    inline void challenge_sent() { ++attempts_; }
+
+    /**
+     * No PATH_RESPONSE arrived in time.
+     * @return true if the challenge should be sent again, false if the candidate is dropped.
+     */
+    bool challenge_lost()
+    {
+        if (not in_progress_) {
+            return false;
+        }
+        if (attempts_ >= max_challenges) {
+            cancel();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * PATH_RESPONSE arrived carrying given data.
+     * @return true if it answers the outstanding challenge and the candidate is now valid.
+     */
+    bool response(uint64_t data)
+    {
+        if (not in_progress_ or data != challenge_) {
+            return false;
+        }
+        in_progress_ = false;
+        return true;
+    }
+
+    void cancel()
+    {
+        in_progress_ = false;
+        attempts_    = 0;
+    }
+};
+
+} // sss namespace
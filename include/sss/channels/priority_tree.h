@@ -0,0 +1,252 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "sss/channels/stride_scheduler.h"
+#include <memory>
+#include <unordered_set>
+
+namespace sss {
+
+/**
+ * Hierarchical scheduler for streams waiting to transmit on a channel.
+ *
+ * Items form a tree following the stream hierarchy, and each node schedules its children
+ * with a stride_scheduler by their priority and weight. Bandwidth is thus split among siblings
+ * relative to their parent's share: a substream with weight 2 gets twice its sibling's bytes,
+ * but only out of what its parent was given against the parent's own siblings.
+ *
+ * A node with data of its own is served before any of its children. Nodes only take part
+ * in their parent's scheduling while something in their subtree is ready, so idle subtrees
+ * cost nothing.
+ *
+ * Moving or re-weighting a node carries its whole subtree along and touches only the nodes
+ * on its path to the root, so reprioritizing is O(depth) scheduler operations regardless
+ * of subtree size.
+ */
+template <typename T>
+class priority_tree
+{
+public:
+    using priority_t = typename stride_scheduler<T>::priority_t;
+    using weight_t   = typename stride_scheduler<T>::weight_t;
+
+private:
+    struct node
+    {
+        T* item;
+        node* parent;
+        priority_t priority;
+        weight_t weight;
+        bool ready{false};                  ///< Item itself has data to send.
+        std::unordered_set<node*> children; ///< All child nodes, active or not.
+        stride_scheduler<node> active;      ///< Children with something ready in their subtree.
+
+        node(T* i, node* p, priority_t pri = 0, weight_t w = 1)
+            : item(i)
+            , parent(p)
+            , priority(pri)
+            , weight(w)
+        {
+        }
+    };
+
+    node root_{nullptr, nullptr};
+    std::unordered_map<T*, std::unique_ptr<node>> nodes_;
+    size_t size_{0};
+
+public:
+    /// Number of ready items.
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+
+    inline bool contains(T* item) const { return nodes_.find(item) != nodes_.end(); }
+
+    inline bool is_ready(T* item) const
+    {
+        auto it = nodes_.find(item);
+        return it != nodes_.end() and it->second->ready;
+    }
+
+    /**
+     * Add item to the tree under parent, or under the root if parent is nullptr.
+     * Unknown parent is added under the root first. Item must not be in the tree yet.
+     */
+    void insert(T* item, T* parent, priority_t priority = 0, weight_t weight = 1)
+    {
+        assert(not contains(item));
+        assert(weight > 0);
+        node* p = find_or_insert(parent);
+        node* n = new node(item, p, priority, weight);
+        nodes_[item].reset(n);
+        p->children.insert(n);
+    }
+
+    /// Make item ready to be scheduled, adding it under the root if unknown.
+    void push(T* item)
+    {
+        node* n = find_or_insert(item);
+        if (n->ready) {
+            return;
+        }
+        n->ready = true;
+        ++size_;
+        activate(n);
+    }
+
+    /**
+     * Take the next item to transmit out of the ready set, descending from the root
+     * through the scheduled children. Tree must not be empty.
+     */
+    T* pop()
+    {
+        assert(not empty());
+        node* n = root_.active.pop();
+        while (not n->ready) {
+            n = n->active.pop();
+        }
+        n->ready = false;
+        --size_;
+
+        // Put the nodes taken along the way back where something is still ready below them.
+        for (node* p = n; p != &root_; p = p->parent) {
+            if (is_active(p)) {
+                p->parent->active.push(p, p->priority, p->weight);
+            }
+        }
+        return n->item;
+    }
+
+    /// Account for bytes sent by item against it and all its ancestors. Unknown items are ignored.
+    void charge(T* item, size_t bytes)
+    {
+        auto it = nodes_.find(item);
+        if (it == nodes_.end()) {
+            return;
+        }
+        for (node* n = it->second.get(); n != &root_; n = n->parent) {
+            n->parent->active.charge(n, bytes);
+        }
+    }
+
+    /// Change item priority and weight relative to its siblings, adding it if unknown.
+    void set_weight(T* item, priority_t priority, weight_t weight)
+    {
+        assert(weight > 0);
+        node* n     = find_or_insert(item);
+        n->priority = priority;
+        n->weight   = weight;
+        if (n->parent->active.is_ready(n)) {
+            n->parent->active.push(n, priority, weight);
+        }
+    }
+
+    /**
+     * Move item with its subtree under a new parent, nullptr meaning the root.
+     * If the new parent is inside item's subtree, it is first moved up to item's old parent,
+     * so the tree never gets a cycle.
+     */
+    void set_parent(T* item, T* parent)
+    {
+        node* n = find_or_insert(item);
+        node* p = find_or_insert(parent);
+        if (p == n or p == n->parent) {
+            return;
+        }
+        for (node* a = p->parent; a != &root_; a = a->parent) {
+            if (a == n) {
+                detach(p);
+                attach(p, n->parent);
+                break;
+            }
+        }
+        detach(n);
+        attach(n, p);
+    }
+
+    /// Forget item completely, moving its children under its parent.
+    void remove(T* item)
+    {
+        auto it = nodes_.find(item);
+        if (it == nodes_.end()) {
+            return;
+        }
+        node* n = it->second.get();
+        if (n->ready) {
+            n->ready = false;
+            --size_;
+        }
+        while (not n->children.empty()) {
+            node* c = *n->children.begin();
+            detach(c);
+            attach(c, n->parent);
+        }
+        detach(n);
+        nodes_.erase(it);
+    }
+
+    void clear()
+    {
+        nodes_.clear();
+        root_.children.clear();
+        root_.active.clear();
+        size_ = 0;
+    }
+
+private:
+    inline bool is_active(node* n) const { return n->ready or not n->active.empty(); }
+
+    node* find_or_insert(T* item)
+    {
+        if (item == nullptr) {
+            return &root_;
+        }
+        auto it = nodes_.find(item);
+        if (it != nodes_.end()) {
+            return it->second.get();
+        }
+        insert(item, nullptr);
+        return nodes_[item].get();
+    }
+
+    /// Schedule active node n in its parent and further up until an already scheduled ancestor.
+    void activate(node* n)
+    {
+        for (; n != &root_ and not n->parent->active.is_ready(n); n = n->parent) {
+            n->parent->active.push(n, n->priority, n->weight);
+        }
+    }
+
+    /// Unschedule ancestors starting from n that have nothing ready left.
+    void deactivate(node* n)
+    {
+        for (; n != &root_ and not is_active(n); n = n->parent) {
+            n->parent->active.cancel(n);
+        }
+    }
+
+    void detach(node* n)
+    {
+        node* p = n->parent;
+        p->active.remove(n);
+        p->children.erase(n);
+        deactivate(p);
+    }
+
+    void attach(node* n, node* p)
+    {
+        n->parent = p;
+        p->children.insert(n);
+        if (is_active(n)) {
+            activate(n);
+        }
+    }
+};
+
+} // sss namespace
@@ -0,0 +1,235 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+namespace sss {
+
+/**
+ * Stride scheduler for streams waiting to transmit on a channel.
+ *
+ * Items with higher priority are strictly preferred. Within a priority level bandwidth is shared
+ * in proportion to item weights, accounted in bytes: each item has a pass value advanced by
+ * charge() with bytes sent divided by its weight, and the ready item with the lowest pass goes
+ * next. Equal passes are served in the order items became ready, so items charging nothing
+ * simply take turns.
+ *
+ * Pass is kept while an item is not ready, so a stream re-enqueued after each packet keeps its
+ * place. An item returning after being idle starts no earlier than the level's current pass
+ * and can't burst on credit saved up while idle.
+ *
+ * Ready items of each level are kept in an indexed binary heap, so push(), pop(), charge(),
+ * cancel() and remove() are O(log n) in the number of ready items without any allocations
+ * once warmed up, plus the number of priority levels for pop().
+ */
+template <typename T>
+class stride_scheduler
+{
+public:
+    using priority_t = uint32_t;
+    using weight_t   = uint32_t;
+
+    /// Pass advance for a byte sent at weight 1.
+    static constexpr uint64_t stride_unit = 1 << 16;
+
+private:
+    static constexpr size_t not_ready = ~size_t(0);
+
+    struct record
+    {
+        T* item;
+        priority_t priority;
+        weight_t weight;
+        uint64_t pass;
+        uint64_t order; ///< Tie breaker, FIFO among equal passes.
+        size_t index;   ///< Position in level heap, not_ready if not in it.
+
+        inline bool operator<(record const& other) const
+        {
+            return pass < other.pass or (pass == other.pass and order < other.order);
+        }
+    };
+
+    /// Ready items of one priority level in a binary min-heap by pass.
+    struct level
+    {
+        std::vector<record*> heap;
+        uint64_t pass{0}; ///< Pass of the item scheduled last.
+    };
+
+    std::unordered_map<T*, record> records_; ///< Node-based, so record pointers stay valid.
+    std::map<priority_t, level, std::greater<priority_t>> levels_; ///< Highest priority first.
+    uint64_t order_{0};
+    size_t size_{0};
+
+public:
+    /// Number of ready items.
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+
+    inline bool is_ready(T* item) const
+    {
+        auto it = records_.find(item);
+        return it != records_.end() and it->second.index != not_ready;
+    }
+
+    /**
+     * Make item ready to be scheduled. Changing priority restarts its pass in the new level,
+     * pushing an item that's already ready with the same priority only updates its weight.
+     */
+    void push(T* item, priority_t priority, weight_t weight = 1)
+    {
+        assert(weight > 0);
+        auto ins    = records_.insert({item, record{item, priority, weight, 0, 0, not_ready}});
+        record& rec = ins.first->second;
+
+        if (not ins.second and rec.priority != priority) {
+            unlink(rec);
+            rec.priority = priority;
+            rec.pass     = 0;
+        }
+        rec.weight = weight;
+        if (rec.index != not_ready) {
+            return;
+        }
+
+        level& lvl = levels_[priority];
+        rec.pass   = std::max(rec.pass, lvl.pass);
+        rec.order  = order_++;
+        rec.index  = lvl.heap.size();
+        lvl.heap.push_back(&rec);
+        sift_up(lvl.heap, rec.index);
+        ++size_;
+    }
+
+    /**
+     * Take the next item to transmit out of the ready set: the one with lowest pass
+     * in the highest priority level. Scheduler must not be empty.
+     */
+    T* pop()
+    {
+        assert(not empty());
+        auto it = levels_.begin();
+        while (it->second.heap.empty()) {
+            ++it;
+        }
+        level& lvl  = it->second;
+        record& rec = *lvl.heap.front();
+        lvl.pass    = rec.pass;
+        erase(lvl.heap, 0);
+        --size_;
+        return rec.item;
+    }
+
+    /// Account for bytes sent by item, ready or not. Unknown items are ignored.
+    void charge(T* item, size_t bytes)
+    {
+        auto it = records_.find(item);
+        if (it == records_.end()) {
+            return;
+        }
+        record& rec = it->second;
+        rec.pass += bytes * stride_unit / rec.weight;
+        if (rec.index != not_ready) {
+            sift_down(levels_[rec.priority].heap, rec.index);
+        }
+    }
+
+    /// Take item out of the ready set, keeping its pass.
+    void cancel(T* item)
+    {
+        auto it = records_.find(item);
+        if (it != records_.end()) {
+            unlink(it->second);
+        }
+    }
+
+    /// Forget item completely, whether ready or not.
+    void remove(T* item)
+    {
+        auto it = records_.find(item);
+        if (it == records_.end()) {
+            return;
+        }
+        unlink(it->second);
+        records_.erase(it);
+    }
+
+    void clear()
+    {
+        records_.clear();
+        levels_.clear();
+        size_ = 0;
+    }
+
+private:
+    void unlink(record& rec)
+    {
+        if (rec.index != not_ready) {
+            erase(levels_[rec.priority].heap, rec.index);
+            --size_;
+        }
+    }
+
+    static void place(std::vector<record*>& heap, size_t i, record* rec)
+    {
+        heap[i]    = rec;
+        rec->index = i;
+    }
+
+    static void sift_up(std::vector<record*>& heap, size_t i)
+    {
+        record* rec = heap[i];
+        while (i > 0 and *rec < *heap[(i - 1) / 2]) {
+            place(heap, i, heap[(i - 1) / 2]);
+            i = (i - 1) / 2;
+        }
+        place(heap, i, rec);
+    }
+
+    static void sift_down(std::vector<record*>& heap, size_t i)
+    {
+        record* rec = heap[i];
+        size_t size = heap.size();
+        while (2 * i + 1 < size) {
+            size_t child = 2 * i + 1;
+            if (child + 1 < size and *heap[child + 1] < *heap[child]) {
+                ++child;
+            }
+            if (not(*heap[child] < *rec)) {
+                break;
+            }
+            place(heap, i, heap[child]);
+            i = child;
+        }
+        place(heap, i, rec);
+    }
+
+    static void erase(std::vector<record*>& heap, size_t i)
+    {
+        heap[i]->index = not_ready;
+        record* last   = heap.back();
+        heap.pop_back();
+        if (i == heap.size()) {
+            return;
+        }
+        place(heap, i, last);
+        sift_up(heap, i);
+        sift_down(heap, last->index);
+    }
+};
+
+} // sss namespace
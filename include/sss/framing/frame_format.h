@@ -82,7 +82,21 @@ using settings_frame_type_t =
     std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::SETTINGS)>;
 using priority_frame_type_t =
     std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::PRIORITY)>;
-using max_frame_count_t = std::integral_constant<uint8_t, 10>;
+using max_data_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::MAX_DATA)>;
+using data_blocked_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::DATA_BLOCKED)>;
+using path_challenge_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::PATH_CHALLENGE)>;
+using path_response_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::PATH_RESPONSE)>;
+using ping_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::PING)>;
+using max_stream_data_frame_type_t =
+    std::integral_constant<uint8_t, to_underlying(stream_protocol::frame_type::MAX_STREAM_DATA)>;
+using stream_data_blocked_frame_type_t = std::integral_constant<uint8_t,
+    to_underlying(stream_protocol::frame_type::STREAM_DATA_BLOCKED)>;
+using max_frame_count_t = std::integral_constant<uint8_t, 17>;
 
 using stream_flags_field_t  = field_flag<uint8_t>;
 using optional_parent_sid_t = optional_field_specification<uint32_t, field_index<1>, 6_bits_shift>;
@@ -174,6 +188,51 @@ BOOST_FUSION_DEFINE_STRUCT(
     (sss::framing::priority_frame_type_t, type)
     (uint32_t, lsid)
     (uint32_t, priority_value)
+    (uint32_t, parent_lsid)
+    (big_uint16_t, weight)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), max_data_frame_header,
+    (sss::framing::max_data_frame_type_t, type)
+    (big_uint64_t, maximum_data)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), data_blocked_frame_header,
+    (sss::framing::data_blocked_frame_type_t, type)
+    (big_uint64_t, data_limit)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), path_challenge_frame_header,
+    (sss::framing::path_challenge_frame_type_t, type)
+    (big_uint64_t, data)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), path_response_frame_header,
+    (sss::framing::path_response_frame_type_t, type)
+    (big_uint64_t, data)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), ping_frame_header,
+    (sss::framing::ping_frame_type_t, type)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), max_stream_data_frame_header,
+    (sss::framing::max_stream_data_frame_type_t, type)
+    (uint32_t, lsid)
+    (big_uint64_t, maximum_stream_data)
+);
+
+BOOST_FUSION_DEFINE_STRUCT(
+    (sss)(framing), stream_data_blocked_frame_header,
+    (sss::framing::stream_data_blocked_frame_type_t, type)
+    (uint32_t, lsid)
+    (big_uint64_t, data_limit)
 );
 // clang-format on
 
@@ -240,5 +299,47 @@ operator==(priority_frame_header const& f, priority_frame_header const& s)
     return boost::fusion::equal_to(f, s);
 }
 
+inline bool
+operator==(max_data_frame_header const& f, max_data_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(data_blocked_frame_header const& f, data_blocked_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(path_challenge_frame_header const& f, path_challenge_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(path_response_frame_header const& f, path_response_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(ping_frame_header const& f, ping_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(max_stream_data_frame_header const& f, max_stream_data_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
+inline bool
+operator==(stream_data_blocked_frame_header const& f, stream_data_blocked_frame_header const& s)
+{
+    return boost::fusion::equal_to(f, s);
+}
+
 } // framing namespace
 } // sss namespace
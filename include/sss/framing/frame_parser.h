@@ -0,0 +1,292 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <boost/asio/buffer.hpp>
+#include "sss/framing/stream_protocol.h"
+
+namespace sss {
+namespace framing {
+
+/**
+ * Result of parsing a packet header or a single frame.
+ * Malformed input is reported through these codes, parser never throws.
+ */
+enum class parse_status
+{
+    ok,                 ///< Frame parsed successfully.
+    end_of_packet,      ///< No more frames in the packet.
+    truncated,          ///< Frame extends past the end of the packet.
+    unknown_frame_type, ///< Frame type byte is not in the known range.
+    invalid             ///< Frame fields are inconsistent (bad flags, unknown settings tag...)
+};
+
+char const* to_string(parse_status status);
+
+/**
+ * Non-owning range of bytes inside the decrypted packet buffer.
+ * Kept trivial so it can live inside frame_view's union.
+ */
+struct byte_range
+{
+    uint8_t const* data;
+    size_t size;
+
+    inline boost::asio::const_buffer buffer() const { return {data, size}; }
+    inline bool empty() const { return size == 0; }
+};
+
+//=================================================================================================
+// Frame views.
+// All views point into the packet buffer given to frame_parser and are valid only as long as
+// that buffer is. Multi-byte fields are decoded from network byte order.
+//=================================================================================================
+
+struct packet_header_view
+{
+    static constexpr uint8_t version_flag   = 0x01; ///< v bit
+    static constexpr uint8_t fec_flag       = 0x02; ///< g bit
+    static constexpr uint8_t seq_size_mask  = 0x0c; ///< ss bits
+    static constexpr uint8_t seq_size_shift = 2;
+    static constexpr uint8_t fec_last_flag  = 0x10; ///< f bit
+
+    uint8_t flags;
+    uint16_t version;
+    uint8_t fec_group;
+    uint64_t packet_sequence; ///< Truncated packet sequence, as found on the wire.
+    uint8_t sequence_size;    ///< Size in bytes of packet sequence on the wire: 2, 4, 6 or 8.
+
+    inline bool has_version() const { return flags & version_flag; }
+    inline bool has_fec_group() const { return flags & fec_flag; }
+};
+
+struct stream_frame_view
+{
+    static constexpr uint8_t fin_flag           = 0x01; ///< f bit
+    static constexpr uint8_t data_length_flag   = 0x02; ///< d bit
+    static constexpr uint8_t offset_size_mask   = 0x1c; ///< ooo bits
+    static constexpr uint8_t offset_size_shift  = 2;
+    static constexpr uint8_t usid_flag          = 0x20; ///< u bit
+    static constexpr uint8_t init_flag          = 0x40; ///< i bit
+    static constexpr uint8_t no_retransmit_flag = 0x80; ///< n bit
+
+    static constexpr size_t usid_size = 24;
+    /// Parent Stream ID of an INIT frame whose parent isn't attached on this channel,
+    /// the parent's USID follows the stream USID instead.
+    static constexpr uint32_t parent_by_usid = 0xffffffff;
+    /// Parent Stream ID of an INIT frame attaching an existing stream, found by its USID,
+    /// to one more channel. Such a frame never creates a stream.
+    static constexpr uint32_t join_path = 0xfffffffe;
+
+    uint8_t flags;
+    uint32_t stream_id;         ///< Datagram number if is_datagram().
+    uint32_t parent_stream_id;  ///< Valid only if is_init(), sending stream for datagrams.
+    uint8_t const* usid;        ///< usid_size bytes, nullptr if not present.
+    uint8_t const* parent_usid; ///< usid_size bytes if has_parent_usid(), nullptr otherwise.
+    uint64_t stream_offset;
+    byte_range data;
+
+    inline bool is_init() const { return flags & init_flag; }
+    inline bool has_usid() const { return flags & usid_flag; }
+    inline bool has_parent_usid() const
+    {
+        return is_init() and not is_no_retransmit() and parent_stream_id == parent_by_usid;
+    }
+    inline bool is_join() const
+    {
+        return is_init() and not is_no_retransmit() and parent_stream_id == join_path;
+    }
+    inline bool is_fin() const { return flags & fin_flag; }
+    inline bool is_no_retransmit() const { return flags & no_retransmit_flag; }
+    /// Empty NORETRANSMIT frame: sender gave up on any data before stream_offset still missing.
+    inline bool is_skip() const
+    {
+        return is_no_retransmit() and not is_init() and data.empty() and not is_fin();
+    }
+    /**
+     * INIT with NORETRANSMIT: stateless datagram fragment at stream_offset within the datagram,
+     * FIN marks the last fragment. No stream is created for it.
+     */
+    inline bool is_datagram() const { return is_init() and is_no_retransmit(); }
+};
+
+struct ack_frame_view
+{
+    static constexpr size_t nack_size = 8; ///< 48 bits of sequence + 16 bits of run length.
+
+    uint8_t sent_entropy;
+    uint8_t received_entropy;
+    uint8_t missing_packets; ///< Number of NACK entries.
+    uint64_t least_unacked_packet;
+    uint64_t largest_observed_packet;
+    uint32_t largest_observed_delta_time;
+    byte_range nacks; ///< missing_packets entries of nack_size bytes.
+
+    /// Lower 48 bits of the first missing packet sequence in NACK run i.
+    uint64_t nack_sequence(size_t i) const;
+    /// Length of NACK run i.
+    uint16_t nack_run_length(size_t i) const;
+    /// Check if packet_seq is acknowledged: not above largest observed and not in any NACK run.
+    bool is_acked(uint64_t packet_seq) const;
+};
+
+struct padding_frame_view
+{
+    byte_range padding;
+};
+
+struct decongestion_frame_view
+{
+    uint8_t subtype;
+    byte_range data; ///< Method specific contents.
+};
+
+struct detach_frame_view
+{
+    uint32_t lsid;
+};
+
+struct reset_frame_view
+{
+    uint32_t lsid;
+    uint32_t error_code;
+    byte_range reason_phrase;
+};
+
+struct close_frame_view
+{
+    uint32_t error_code;
+    byte_range reason_phrase;
+    ack_frame_view final_ack;
+};
+
+struct settings_frame_view
+{
+    uint16_t number_of_settings;
+    byte_range settings; ///< Raw tag-value pairs, validated by the parser.
+};
+
+struct priority_frame_view
+{
+    uint32_t lsid;
+    uint32_t priority_value;
+    uint32_t parent_lsid; ///< Parent stream, 0 for the channel root stream.
+    uint16_t weight;      ///< Share among siblings, never 0.
+};
+
+struct max_data_frame_view
+{
+    uint64_t maximum_data; ///< Channel credit, total stream bytes the peer may send.
+};
+
+struct data_blocked_frame_view
+{
+    uint64_t data_limit; ///< Channel credit the sender is blocked at.
+};
+
+struct max_stream_data_frame_view
+{
+    uint32_t lsid;                ///< Stream as known to the receiver of this frame.
+    uint64_t maximum_stream_data; ///< Stream offset the peer may send up to.
+};
+
+struct stream_data_blocked_frame_view
+{
+    uint32_t lsid;       ///< Stream as known to the sender of this frame.
+    uint64_t data_limit; ///< Stream offset the sender is blocked at.
+};
+
+struct path_challenge_frame_view
+{
+    uint64_t data; ///< Random value the peer must echo back.
+};
+
+struct path_response_frame_view
+{
+    uint64_t data; ///< Value from the PATH_CHALLENGE being answered.
+};
+
+/**
+ * Tagged view of a single frame. Only the member matching type is valid.
+ */
+struct frame_view
+{
+    stream_protocol::frame_type type;
+    byte_range raw; ///< Whole frame including the type byte.
+
+    union
+    {
+        stream_frame_view stream;
+        ack_frame_view ack;
+        padding_frame_view padding;
+        decongestion_frame_view decongestion;
+        detach_frame_view detach;
+        reset_frame_view reset;
+        close_frame_view close;
+        settings_frame_view settings;
+        priority_frame_view priority;
+        max_data_frame_view max_data;
+        data_blocked_frame_view data_blocked;
+        path_challenge_frame_view path_challenge;
+        path_response_frame_view path_response;
+        max_stream_data_frame_view max_stream_data;
+        stream_data_blocked_frame_view stream_data_blocked;
+    };
+};
+
+/**
+ * Parse packet header and frames in place.
+ * Parser does no allocations and never copies frame contents, it only produces views
+ * (offsets and lengths) into the decrypted packet.
+ */
+class frame_parser
+{
+    uint8_t const* begin_;
+    uint8_t const* pos_;
+    uint8_t const* end_;
+
+public:
+    explicit frame_parser(boost::asio::const_buffer packet);
+
+    /**
+     * Parse packet header, must be called once before the first call to next().
+     */
+    parse_status read_packet_header(packet_header_view& header);
+
+    /**
+     * Parse next frame in the packet.
+     * Returns parse_status::end_of_packet when there are no more frames.
+     * After an error the parser position is not advanced, so the rest of the packet
+     * should be discarded.
+     */
+    parse_status next(frame_view& frame);
+
+    inline size_t offset() const { return pos_ - begin_; }
+    inline size_t remaining() const { return end_ - pos_; }
+
+private:
+    parse_status read_stream(stream_frame_view& frame);
+    parse_status read_ack(ack_frame_view& frame);
+    parse_status read_padding(padding_frame_view& frame);
+    parse_status read_decongestion(decongestion_frame_view& frame);
+    parse_status read_detach(detach_frame_view& frame);
+    parse_status read_reset(reset_frame_view& frame);
+    parse_status read_close(close_frame_view& frame);
+    parse_status read_settings(settings_frame_view& frame);
+    parse_status read_priority(priority_frame_view& frame);
+    parse_status read_max_data(max_data_frame_view& frame);
+    parse_status read_data_blocked(data_blocked_frame_view& frame);
+    parse_status read_path_data(uint64_t& data);
+    parse_status read_stream_limit(uint32_t& lsid, uint64_t& limit);
+};
+
+} // framing namespace
+} // sss namespace
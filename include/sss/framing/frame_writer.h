@@ -0,0 +1,97 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "sss/framing/frame_parser.h"
+
+namespace sss {
+namespace framing {
+
+/**
+ * Return ooo bits code of the shortest stream offset field able to hold offset.
+ */
+uint8_t stream_offset_size_code(uint64_t offset);
+
+/**
+ * Return size in bytes of the stream offset field for given ooo bits code.
+ */
+uint8_t stream_offset_size(uint8_t code);
+
+/**
+ * Counterpart of frame_parser: write packet header and frames directly into the packet buffer.
+ * Frames are described by the same views the parser produces, payload is copied from
+ * the view's byte_range exactly once, into the packet.
+ * All write functions return false without writing anything if the frame doesn't fit.
+ */
+class frame_writer
+{
+    uint8_t* begin_;
+    uint8_t* pos_;
+    uint8_t* end_;
+
+public:
+    explicit frame_writer(boost::asio::mutable_buffer packet);
+    /// Continue writing a packet whose first written bytes are already filled in.
+    frame_writer(boost::asio::mutable_buffer packet, size_t written);
+
+    /**
+     * Write packet header. Flags v, g and f are taken from header.flags,
+     * ss bits are computed from header.sequence_size (2, 4, 6 or 8).
+     */
+    bool write_packet_header(packet_header_view const& header);
+
+    /**
+     * Write STREAM frame. Offset field gets the shortest encoding for frame.stream_offset.
+     * If last is true, data length is omitted and data extends to the end of packet,
+     * otherwise the d bit is set and the length is written.
+     */
+    bool write_stream(stream_frame_view const& frame, bool last = false);
+    bool write_ack(ack_frame_view const& frame);
+    /// Write PADDING frame occupying exactly frame_size bytes (at least 3), zero-filled.
+    bool write_padding(size_t frame_size);
+    bool write_empty();
+    bool write_decongestion(decongestion_frame_view const& frame);
+    bool write_detach(detach_frame_view const& frame);
+    bool write_reset(reset_frame_view const& frame);
+    bool write_close(close_frame_view const& frame);
+    bool write_settings(settings_frame_view const& frame);
+    bool write_priority(priority_frame_view const& frame);
+    bool write_max_data(max_data_frame_view const& frame);
+    bool write_data_blocked(data_blocked_frame_view const& frame);
+    bool write_path_challenge(path_challenge_frame_view const& frame);
+    bool write_path_response(path_response_frame_view const& frame);
+    /// Write PING frame, which has no body but makes the packet ack-eliciting.
+    bool write_ping();
+    bool write_max_stream_data(max_stream_data_frame_view const& frame);
+    bool write_stream_data_blocked(stream_data_blocked_frame_view const& frame);
+
+    /// Size of STREAM frame header (everything except data) for given frame.
+    static size_t stream_header_size(stream_frame_view const& frame, bool last = false);
+    /// Size of encoded packet header.
+    static size_t packet_header_size(packet_header_view const& header);
+    static size_t ack_frame_size(ack_frame_view const& frame);
+
+    /// Minimum size of a PADDING frame: type and length.
+    static constexpr size_t min_padding_size = 3;
+    /// Largest packet header: flags, version, FEC group, 8-byte sequence.
+    static constexpr size_t max_packet_header_size = 1 + 2 + 1 + 8;
+
+    inline size_t size() const { return pos_ - begin_; }
+    inline size_t remaining() const { return end_ - pos_; }
+    /// Written part of the packet.
+    inline boost::asio::const_buffer written() const { return {begin_, size()}; }
+
+private:
+    void put(uint64_t value, size_t size);
+    void put(byte_range range);
+    void put_ack_body(ack_frame_view const& frame);
+};
+
+} // framing namespace
+} // sss namespace
@@ -10,6 +10,7 @@
 
 #include "packet_frame.h"
 #include "frame_format.h"
+#include "frame_parser.h"
 #include "sss/forward_ptrs.h"
 #include <memory>
 #include <boost/asio/buffer.hpp>
@@ -54,16 +55,18 @@ public:
     framing_t(channel_ptr c);
 
     void enframe(boost::asio::mutable_buffer output);
-    void deframe(boost::asio::const_buffer input);
 
-private:
-    template <typename T>
-    void read_handler(boost::asio::const_buffer input);
+    /**
+     * Read frames following the packet header and deliver them to the channel.
+     * Frames are handed out as views into the packet buffer, nothing is copied or allocated.
+     * @param parser     Parser positioned after the packet header.
+     * @param packet_seq Full sequence number of the packet being deframed.
+     * @param needs_ack  Set to true if any of the delivered frames requires an acknowledgement.
+     * @return parse_status::ok if the whole packet was consumed, error status otherwise.
+     */
+    parse_status deframe(frame_parser& parser, packet_seq_t packet_seq, bool& needs_ack);
 
 private:
-    using read_handler_type = void (framing_t::*)(boost::asio::const_buffer);
-    static std::array<read_handler_type, max_frame_count_t::value> handlers_;
-
     // Reference to channel associated with this framing instance.
     // When parsing received frames, obtain streams from channel by lsid/usid and call rx_*()
     // functions to process associated frames. Call channel's rx_*() functions to process
@@ -0,0 +1,67 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "sss/framing/stream_protocol.h"
+
+namespace sss {
+namespace framing {
+
+/**
+ * Choose the shortest packet sequence encoding (2, 4, 6 or 8 bytes, see ss bits in spec 4.1.1)
+ * the receiver can unambiguously expand.
+ * Truncated number must cover twice the span between the packet being sent and the largest
+ * packet acknowledged by the peer, so that it always falls into the half-window around
+ * the sequence the receiver expects next.
+ * @param packet_seq    Sequence number of the packet being sent.
+ * @param largest_acked Largest sequence number acknowledged by the peer, 0 if none.
+ */
+inline uint8_t
+packet_sequence_size(packet_seq_t packet_seq, packet_seq_t largest_acked)
+{
+    uint64_t span = packet_seq > largest_acked ? packet_seq - largest_acked : 1;
+    for (uint8_t size = 2; size < 8; size += 2) {
+        if (span < (1ULL << (size * 8 - 1))) {
+            return size;
+        }
+    }
+    return 8;
+}
+
+/**
+ * Reconstruct full packet sequence number from its truncated encoding.
+ * Picks the value closest to the next expected sequence number.
+ * @param truncated        Packet sequence as found in the packet header.
+ * @param size             Size of the encoding in bytes: 2, 4, 6 or 8.
+ * @param largest_received Largest sequence number received so far, 0 if none.
+ */
+inline packet_seq_t
+expand_packet_sequence(uint64_t truncated, uint8_t size, packet_seq_t largest_received)
+{
+    if (size >= 8) {
+        return truncated;
+    }
+
+    uint64_t const window      = 1ULL << (size * 8);
+    uint64_t const half_window = window / 2;
+    uint64_t const mask        = window - 1;
+    uint64_t const expected    = largest_received + 1;
+
+    uint64_t candidate = (expected & ~mask) | (truncated & mask);
+    if (candidate + half_window <= expected and candidate < ~0ULL - window) {
+        return candidate + window;
+    }
+    if (candidate > expected + half_window and candidate >= window) {
+        return candidate - window;
+    }
+    return candidate;
+}
+
+} // framing namespace
+} // sss namespace
@@ -0,0 +1,80 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <vector>
+#include "sss/framing/frame_writer.h"
+
+namespace sss {
+namespace framing {
+
+/**
+ * Per-channel padding policy, trading resistance to traffic analysis for bandwidth (spec 4.2.5).
+ * Applied by the packet assembler after all frames are written,
+ * fills the rest with PADDING frame, or EMPTY frames for 1- and 2-byte remainders.
+ */
+class padding_policy
+{
+public:
+    enum class mode
+    {
+        none,        ///< No padding, for metered links.
+        multiple_16, ///< Pad to a multiple of 16 bytes, the spec minimum.
+        buckets,     ///< Pad to the smallest of a few common sizes.
+        full,        ///< Pad every packet to the maximum size, as spec recommends.
+    };
+
+    static constexpr size_t granularity = 16;
+
+    /// Statistics counters.
+    struct counters
+    {
+        uint64_t packets{0};        ///< Packets passed through the policy.
+        uint64_t padded_packets{0}; ///< Packets which needed padding.
+        uint64_t payload_bytes{0};  ///< Bytes of header and frames before padding.
+        uint64_t padding_bytes{0};  ///< Bytes of PADDING and EMPTY frames added.
+    };
+
+private:
+    mode mode_{mode::multiple_16};
+    std::vector<size_t> buckets_{128, 256, 512, 1024};
+    counters counters_;
+
+public:
+    padding_policy() = default;
+    explicit padding_policy(mode m)
+        : mode_(m)
+    {
+    }
+
+    inline mode current_mode() const { return mode_; }
+    inline void set_mode(mode m) { mode_ = m; }
+
+    /// Set packet sizes used in buckets mode, must be sorted in ascending order.
+    inline void set_buckets(std::vector<size_t> buckets) { buckets_ = std::move(buckets); }
+
+    inline counters const& stats() const { return counters_; }
+    inline void reset_stats() { counters_ = counters{}; }
+
+    /**
+     * Compute size the packet should be padded to.
+     * @param size     Size of packet header and frames written so far.
+     * @param max_size Maximum packet size, padding never exceeds it.
+     */
+    size_t padded_size(size_t size, size_t max_size) const;
+
+    /**
+     * Pad the packet in writer according to the policy, never exceeding its buffer.
+     * @return Number of padding bytes added.
+     */
+    size_t pad(frame_writer& writer);
+};
+
+} // framing namespace
+} // sss namespace
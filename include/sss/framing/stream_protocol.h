@@ -26,20 +26,46 @@ using packet_seq_t = uint64_t; // @fixme goes to channel...
 class stream_protocol
 {
 public:
+    /// Minimum IPv6 MTU, every path is assumed to carry datagrams of this size (spec 4.1).
+    static constexpr size_t mtu = 1280;
+    /// Per-datagram overhead: IPv6 and UDP headers, MESSAGE header and cryptobox MAC.
+    static constexpr size_t datagram_overhead = 40 + 8 + 48 + 16;
+    /// Largest path MTU probed by default (Ethernet) and in datacenter jumbo mode.
+    static constexpr size_t ethernet_mtu = 1500;
+    static constexpr size_t jumbo_mtu    = 9000;
+
     static constexpr size_t min_receive_buffer_size = mtu * 2; // @todo Not needed?
 
+    /// Data a new substream may send before its attach is acknowledged, borrowed from
+    /// the parent's window. Receivers keep child receive buffers at least this large.
+    /// Also the stream flow control limit both sides assume before the first MAX_STREAM_DATA.
+    static constexpr size_t initial_substream_window = 16384;
+
+    /// Channel-level flow control credit both sides assume before the first MAX_DATA frame.
+    static constexpr uint64_t initial_channel_credit = 1 << 20;
+
+    /// Protocol version sent in packet headers until the peer acknowledges a versioned packet.
+    static constexpr uint16_t protocol_version = 1;
+
     enum class frame_type : uint8_t
     {
-        EMPTY        = 0,
-        STREAM       = 1,
-        ACK          = 2,
-        PADDING      = 3,
-        DECONGESTION = 4,
-        DETACH       = 5,
-        RESET        = 6,
-        CLOSE        = 7,
-        SETTINGS     = 8,
-        PRIORITY     = 9
+        EMPTY               = 0,
+        STREAM              = 1,
+        ACK                 = 2,
+        PADDING             = 3,
+        DECONGESTION        = 4,
+        DETACH              = 5,
+        RESET               = 6,
+        CLOSE               = 7,
+        SETTINGS            = 8,
+        PRIORITY            = 9,
+        MAX_DATA            = 10,
+        DATA_BLOCKED        = 11,
+        PATH_CHALLENGE      = 12,
+        PATH_RESPONSE       = 13,
+        PING                = 14,
+        MAX_STREAM_DATA     = 15,
+        STREAM_DATA_BLOCKED = 16
     };
 
     /// Service message codes
@@ -11,6 +11,7 @@
 #include "uia/host.h"
 #include "arsenal/logging.h"
 #include "sss/internal/stream_host_state.h"
+#include "sss/internal/channel_host_state.h"
 #include "sss/internal/routing_host_state.h"
 #include "sss/forward_ptrs.h"
 
@@ -32,6 +33,7 @@ namespace sss {
  */
 class host : public uia::host,
              public stream_host_state,
+             public channel_host_state,
              public routing_host_state
 {
 };
@@ -0,0 +1,69 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <random>
+#include <unordered_map>
+#include "arsenal/algorithm.h"
+#include "uia/comm/socket.h"
+#include "sss/channels/message_header.h"
+
+namespace sss {
+
+class channel;
+
+/**
+ * Host state for demultiplexing compact MESSAGE packets:
+ * channels indexed by the connection id we issued to the peer during INITIATE.
+ */
+class channel_host_state
+{
+    std::unordered_map<channels::connection_id_t, channel*> channels_;
+    std::mt19937_64 cid_generator_{std::random_device{}()};
+
+public:
+    /**
+     * Allocate a new connection id, unique among active channels on this host.
+     * Ids are random so that they don't reveal the number of channels;
+     * they are not secret, packets are authenticated by the channel.
+     */
+    inline channels::connection_id_t allocate_connection_id()
+    {
+        channels::connection_id_t cid;
+        do {
+            cid = cid_generator_();
+        } while (cid == 0 or contains(channels_, cid));
+        return cid;
+    }
+
+    inline void register_channel(channels::connection_id_t cid, channel* ch)
+    {
+        channels_[cid] = ch;
+    }
+
+    inline void unregister_channel(channels::connection_id_t cid) { channels_.erase(cid); }
+
+    /// Find channel for a compact MESSAGE packet, nullptr if there's none.
+    inline channel* channel_for(channels::connection_id_t cid) const
+    {
+        auto it = channels_.find(cid);
+        return it == channels_.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Dispatch a compact MESSAGE packet to the channel owning its connection id.
+     * Compact packets carry no magic, so the socket layer must hand every received packet
+     * with compact_message_header::is_compact() set here instead of to its magic receivers.
+     * @return false if no channel has this connection id, the packet is then dropped.
+     */
+    bool receive_compact_message(boost::asio::const_buffer pkt,
+                                 uia::comm::socket_endpoint const& src);
+};
+
+} // sss namespace
@@ -0,0 +1,119 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace sss {
+
+/**
+ * Pool of equally sized memory blocks, carved out of larger slabs and recycled via a free list.
+ *
+ * Objects created and destroyed at a high rate, like short-lived substreams, reuse the blocks
+ * of those destroyed before them instead of going to the general-purpose allocator each time.
+ * Block size is set by the first allocation, requests of any other size are passed on
+ * to operator new. Slabs are kept until the pool is destroyed, so pool memory stays at
+ * the peak number of live blocks.
+ *
+ * Not thread-safe, like the rest of the per-host state.
+ */
+class slab_pool
+{
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    size_t block_size_{0};
+    size_t blocks_per_slab_;
+    std::vector<std::unique_ptr<char[]>> slabs_;
+    free_block* free_{nullptr};
+    size_t in_use_{0};
+
+    static size_t round_size(size_t size);
+    void grow();
+
+public:
+    static constexpr size_t default_blocks_per_slab = 64;
+
+    explicit slab_pool(size_t blocks_per_slab = default_blocks_per_slab);
+    slab_pool(slab_pool const&) = delete;
+    slab_pool& operator=(slab_pool const&) = delete;
+
+    /// Size of pooled blocks, zero until the first allocation.
+    inline size_t block_size() const { return block_size_; }
+    /// Pooled blocks handed out and not yet returned.
+    inline size_t in_use() const { return in_use_; }
+    /// Pooled blocks in all slabs, used or free.
+    inline size_t capacity() const { return slabs_.size() * blocks_per_slab_; }
+
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+};
+
+/**
+ * Allocator drawing single objects from a shared slab_pool, meant for std::allocate_shared().
+ * Every copy of the allocator, including the one kept in the shared_ptr control block,
+ * holds a reference to the pool, so the pool outlives all objects allocated from it.
+ */
+template <typename T>
+class slab_allocator
+{
+    template <typename U>
+    friend class slab_allocator;
+
+    std::shared_ptr<slab_pool> pool_;
+
+public:
+    using value_type = T;
+
+    explicit slab_allocator(std::shared_ptr<slab_pool> pool)
+        : pool_(std::move(pool))
+    {
+    }
+
+    template <typename U>
+    slab_allocator(slab_allocator<U> const& other)
+        : pool_(other.pool_)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types not pooled");
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(pool_->allocate(sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n != 1) {
+            return ::operator delete(p);
+        }
+        pool_->deallocate(p, sizeof(T));
+    }
+
+    template <typename U>
+    inline bool operator==(slab_allocator<U> const& other) const
+    {
+        return pool_ == other.pool_;
+    }
+
+    template <typename U>
+    inline bool operator!=(slab_allocator<U> const& other) const
+    {
+        return pool_ != other.pool_;
+    }
+};
+
+} // sss namespace
@@ -12,7 +12,9 @@
 #include <boost/functional/hash.hpp>
 #include <utility>
 #include <string>
+#include <algorithm>
 #include "arsenal/algorithm.h"
+#include "sss/internal/slab_pool.h"
 
 // Hash specialization for pair<string,string>
 // Need to have it before declaration of listeners_ below.
@@ -49,8 +51,14 @@ class stream_host_state
     std::shared_ptr<stream_responder> responder_{nullptr};
     std::unordered_map<uia::peer_identity, std::shared_ptr<internal::stream_peer>> peers_;
     std::unordered_map<std::pair<std::string, std::string>, server*> listeners_;
+    size_t receive_memory_budget_{default_receive_memory_budget};
+    size_t receive_memory_used_{0};
+    std::shared_ptr<slab_pool> stream_pool_{std::make_shared<slab_pool>()};
 
 public:
+    /// Default memory budget for receive windows grown by auto-tuning, across all streams.
+    static constexpr size_t default_receive_memory_budget = 64 << 20;
+
     stream_host_state() = default;
     virtual ~stream_host_state() = default;
 
@@ -83,6 +91,43 @@ public:
     }
     // void unregister_listener()
 
+    /**
+     * Set memory budget for receive window auto-tuning. Lowering it below memory in use
+     * puts streams under memory pressure, making them shrink their windows as they drain.
+     */
+    inline void set_receive_memory_budget(size_t budget) { receive_memory_budget_ = budget; }
+    inline size_t receive_memory_budget() const { return receive_memory_budget_; }
+    inline size_t receive_memory_used() const { return receive_memory_used_; }
+    inline bool receive_memory_pressure() const
+    {
+        return receive_memory_used_ > receive_memory_budget_;
+    }
+
+    /**
+     * Reserve receive buffer memory from the budget.
+     * @return Number of bytes granted, may be less than wanted or zero.
+     */
+    inline size_t reserve_receive_memory(size_t wanted)
+    {
+        if (receive_memory_pressure()) {
+            return 0;
+        }
+        size_t granted = std::min(wanted, receive_memory_budget_ - receive_memory_used_);
+        receive_memory_used_ += granted;
+        return granted;
+    }
+
+    /// Return previously reserved receive buffer memory.
+    inline void release_receive_memory(size_t size)
+    {
+        receive_memory_used_ -= std::min(size, receive_memory_used_);
+    }
+
+    /// Memory pool for base_stream objects, shared by all streams of this host.
+    inline std::shared_ptr<slab_pool> stream_pool() const { return stream_pool_; }
+    /// Replace the stream memory pool, nullptr allocates streams from the heap.
+    inline void set_stream_pool(std::shared_ptr<slab_pool> pool) { stream_pool_ = pool; }
+
     inline server* listener_for(std::string service, std::string protocol) {
         if (!contains(listeners_, make_pair(service, protocol)))
             return nullptr;
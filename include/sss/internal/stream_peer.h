@@ -14,6 +14,7 @@
 #include <boost/signals2/connection.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include "sss/framing/stream_protocol.h"
+#include "sss/channels/path_scheduler.h"
 #include "sss/host.h"
 #include "sss/streams/base_stream.h"
 #include "sss/internal/stream_host_state.h"
@@ -79,6 +80,12 @@ class stream_peer : public uia::internal::peer, public stream_protocol
     // All streams that have USIDs, registered by their USIDs
     std::unordered_map<unique_stream_id_t, base_stream_wptr> usid_streams_;
 
+    /**
+     * Started channels to this peer, each over its own pair of local and remote endpoints
+     * with its own congestion control. Streams spread their frames across these paths.
+     */
+    path_scheduler<stream_channel> paths_;
+
     uia::routing::routing_coordination coord_;
 
     inline bool no_lookups_possible()
@@ -110,6 +117,26 @@ class stream_peer : public uia::internal::peer, public stream_protocol
 public:
     stream_peer(host_ptr const& host, uia::peer_identity const& remote_id, private_tag);
     ~stream_peer();
+
+    /** @name Multipath
+     * Channels add themselves as paths once started and leave when stopped.
+     * Streams outlive channel failures: once the last path is gone, the peer connects again
+     * and streams left without a path resume on the first new channel.
+     */
+    /**@{*/
+    void add_path(stream_channel* channel);
+    void remove_path(stream_channel* channel);
+    /// Some stream lost all its paths and waits for a new channel.
+    bool has_streams_to_resume() const;
+    inline size_t path_count() const { return paths_.size(); }
+    inline std::vector<stream_channel*> const& paths() const { return paths_.paths(); }
+
+    /// Path that would deliver a frame of given size first, nullptr if none is active.
+    stream_channel* select_path(size_t bytes) const;
+    /**@}*/
+
+    /// Stream with given USID, nullptr if there's none.
+    base_stream_ptr find_stream(unique_stream_id_t const& usid) const;
 };
 
 } // internal namespace
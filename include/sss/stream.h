@@ -8,7 +8,10 @@
 //
 #pragma once
 
+#include <vector>
+#include <boost/asio/buffer.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include "arsenal/byte_array.h"
 #include "uia/peer_identity.h"
 #include "uia/comm/socket.h"
@@ -106,6 +109,18 @@ public:
         reset = 4, ///< Forceful reset.
     };
 
+    /**
+     * How a stream recovers lost data, chosen when opening a substream.
+     * Partially reliable streams suit real-time data that is useless once late: the receiver
+     * skips data that is never going to arrive and reports the gaps via on_receive_gap().
+     */
+    enum class reliability
+    {
+        reliable,     ///< Lost data is retransmitted until acknowledged.
+        time_limited, ///< Lost data is retransmitted only within the stream's data lifetime.
+        unreliable,   ///< Lost data is never retransmitted.
+    };
+
     /**
      * Use this factory function to create new streams.
      */
@@ -241,6 +256,31 @@ public:
      */
     byte_array read_data(ssize_t max_size = 1 << 30);
 
+    /**
+     * Scatter read: fill a sequence of buffers in one call, each one before moving to the next.
+     * Lets the application read straight into its own structures, e.g. a fixed header
+     * and a payload area, without an intermediate copy. Stops at a record boundary
+     * just like the single buffer read_data().
+     * @return the total number of bytes read, or -1 if an error occurred.
+     */
+    ssize_t read_data(std::vector<boost::asio::mutable_buffer> const& buffers);
+
+    /**
+     * Zero-copy receive: borrow up to max_size bytes of received data as views
+     * into the stream's receive buffer, e.g. to writev() them straight to another socket.
+     * The views stay valid until released with consume_data(); receive window is not
+     * reopened for the borrowed bytes until then. Changing the receive buffer size
+     * while holding views invalidates them.
+     * @return the views in stream order, empty if no data is available.
+     */
+    std::vector<boost::asio::const_buffer> peek_data(ssize_t max_size = 1 << 30);
+
+    /**
+     * Release size bytes returned by peek_data(), updating the receive window.
+     * @return the number of bytes released, or -1 if an error occurred.
+     */
+    ssize_t consume_data(ssize_t size);
+
     /**
      * Return number of complete records currently available for reading.
      */
@@ -300,10 +340,36 @@ public:
      * ready to transmit.
      * @param data the buffer containing the bytes to write.
      * @param size the number of bytes to write.
-     * @return the number of bytes written (same as the size parameter), or -1 if an error occurred.
+     * @return the number of bytes written, or -1 if an error occurred. This may be less than
+     * the size parameter if the send buffer is full, on_ready_write is emitted once it drains.
      */
     ssize_t write_data(const char* data, ssize_t size);
 
+    /**
+     * Write data bytes to a stream without copying, the stream takes the buffer over.
+     * Data is sent, and resent if lost, straight from that buffer until acknowledged.
+     * @param data the bytes to write.
+     * @return the number of bytes written (all of them), or -1 if an error occurred.
+     * @overload
+     */
+    ssize_t write_data(byte_array&& data);
+
+    /**
+     * Write data bytes to a stream without copying, sharing an immutable buffer.
+     * The stream holds owner until all of data is acknowledged, so buffers shared with
+     * other users (logs, caches) or with a custom deleter can be sent as they are.
+     * @param data the bytes to write, must not change until released.
+     * @param owner reference keeping data alive.
+     * @param deadline time by which data should be sent, if any. Streams with deadline data
+     *        are transmitted ahead of all others, earliest deadline first. Data is still
+     *        delivered reliably after the deadline, it is only counted as a miss.
+     * @return the number of bytes written (all of them), or -1 if an error occurred.
+     * @overload
+     */
+    ssize_t write_data(boost::asio::const_buffer data,
+                       std::shared_ptr<void const> owner,
+                       boost::posix_time::ptime deadline = boost::posix_time::ptime());
+
     /**
      * Write a record to a stream.
      * Writes the data in the supplied buffer followed by a record/record marker. If some data has
@@ -340,14 +406,20 @@ public:
 
     /**
      * Send and receive unordered datagrams on this stream.
-     * Reliability is optional.
+     * Reliability is optional. Non-reliable datagrams may be given a deadline: they are sent
+     * ahead of other data, earliest deadline first, and dropped unsent once it passes.
      */
     ssize_t read_datagram(char* data, ssize_t max_size);
     byte_array read_datagram(ssize_t max_size = 1 << 30);
-    ssize_t write_datagram(const char* data, ssize_t size, datagram_type is_reliable);
-    inline ssize_t write_datagram(const byte_array& dgm, datagram_type is_reliable)
+    ssize_t write_datagram(const char* data,
+                           ssize_t size,
+                           datagram_type is_reliable,
+                           boost::posix_time::ptime deadline = boost::posix_time::ptime());
+    inline ssize_t write_datagram(const byte_array& dgm,
+                                  datagram_type is_reliable,
+                                  boost::posix_time::ptime deadline = boost::posix_time::ptime())
     {
-        return write_datagram(dgm.data(), dgm.size(), is_reliable);
+        return write_datagram(dgm.data(), dgm.size(), is_reliable, deadline);
     }
 
     /**
@@ -368,9 +440,15 @@ public:
      * substream and any data written to it locally until the remote host is ready to accept
      * the new substream.
      *
+     * @param mode     How the new substream recovers lost data. Substreams of any mode can share
+     *                 the channel with their reliable parent.
+     * @param lifetime For time_limited mode, how long after being written data is still worth
+     *                 retransmitting.
      * @return A stream object representing the new substream.
      */
-    stream_ptr open_substream();
+    stream_ptr open_substream(reliability mode = reliability::reliable,
+                              boost::posix_time::time_duration lifetime
+                              = boost::posix_time::time_duration());
 
     /**
      * Listen for incoming substreams on this stream.
@@ -427,6 +505,18 @@ public:
      */
     int current_priority() const;
 
+    /**
+     * Set the stream's transmit weight. Streams with the same priority level divide transmit
+     * bandwidth in proportion to their weights, so a stream with weight 3 gets three times
+     * the bytes of a stream with default weight 1.
+     */
+    void set_weight(int weight);
+
+    /**
+     * Returns the stream's current transmit weight.
+     */
+    int current_weight() const;
+
     /**
      * Control the receive buffer size for this stream.
      */
@@ -516,7 +606,8 @@ public:
     ready_signal on_ready_read_datagram;
     /**
      * Emitted when our transmit buffer contains only in-flight data
-     * and we could transmit more immediately if the app supplies more.
+     * and we could transmit more immediately if the app supplies more,
+     * or when a full send buffer drains down to its low watermark.
      */
     ready_signal on_ready_write;
     /**
@@ -529,6 +620,14 @@ public:
      */
     ready_signal on_receive_blocked;
 
+    using gap_signal = boost::signals2::signal<void(uint64_t, size_t)>;
+    /**
+     * Emitted when a partially reliable stream gives up on lost data: the peer did not
+     * retransmit size bytes at stream byte offset. The gap reads as zeros, so offsets of data
+     * after it don't change - byte offset 0 is the first byte ever read from the stream.
+     */
+    gap_signal on_receive_gap;
+
     using link_status_signal = boost::signals2::signal<void(void)>;
     /**
      * Emitted when the stream establishes live connectivity
@@ -8,6 +8,8 @@
 //
 #pragma once
 
+#include <vector>
+#include <boost/asio/buffer.hpp>
 #include "arsenal/byte_array.h"
 #include "arsenal/underlying.h"
 #include "uia/peer_identity.h"
@@ -58,9 +60,12 @@ public:
      * child streams. This allows parent stream to guarantee control over child streams.
      */
     using priority_t = uint32_t;
+    /// Share of bandwidth among streams with the same priority, relative to their weights.
+    using weight_t = uint32_t;
 
 private:
     priority_t priority_{0};                                       ///< Current priority level
+    weight_t weight_{1};                                           ///< Bandwidth share weight
     stream::listen_mode listen_mode_{stream::listen_mode::reject}; ///< Listen for substreams.
 
 public:
@@ -100,6 +105,14 @@ public:
      */
     inline priority_t current_priority() const { return priority_; }
 
+    /**
+     * Set the stream's transmit weight. Streams with the same priority share transmit bandwidth
+     * in proportion to their weights, counted in bytes. Default weight is 1, must not be 0.
+     */
+    virtual void set_weight(weight_t weight);
+
+    inline weight_t current_weight() const { return weight_; }
+
     //=============================================================================================
     // Byte-oriented data transfer.
     // Reading data.
@@ -122,6 +135,31 @@ public:
      */
     virtual ssize_t read_data(char* data, ssize_t max_size) = 0;
 
+    /**
+     * Read data into a sequence of buffers, filling each one before moving to the next.
+     * Same rules as for single buffer read_data() apply, in particular the read
+     * stops at a record boundary.
+     *
+     * @param buffers the buffers to read into.
+     * @return the total number of bytes read, or -1 if an error occurred.
+     */
+    virtual ssize_t read_data(std::vector<boost::asio::mutable_buffer> const& buffers) = 0;
+
+    /**
+     * Borrow up to max_size bytes of received data without copying it out.
+     * The views point into the stream's receive buffer and stay valid until consumed
+     * with consume_data(). Unlike read_data() this may span record boundaries.
+     * @return the views in stream order, empty if no data is available.
+     */
+    virtual std::vector<boost::asio::const_buffer> peek_data(ssize_t max_size) = 0;
+
+    /**
+     * Release size bytes of received data previously returned by peek_data(),
+     * freeing buffer space and updating the receive window.
+     * @return the number of bytes released, or -1 if an error occurred.
+     */
+    virtual ssize_t consume_data(ssize_t size) = 0;
+
     /**
      * Determine the number of bytes currently available to be read via read_data().
      * Note that calling read_data() with a buffer this large may not read all the available data
@@ -154,11 +192,29 @@ public:
      * @param data the buffer containing the bytes to write.
      * @param size the number of bytes to write.
      * @param endflags flags to finish transmission.
-     * @return the number of bytes written (should be the same as the size parameter),
-     *      or -1 if an error occurred.
+     * @return the number of bytes written, or -1 if an error occurred.
+     *      Fewer than size bytes are written when the send buffer is full,
+     *      wait for on_ready_write before writing the rest.
      */
     virtual ssize_t write_data(char const* data, ssize_t size, uint8_t endflags) = 0;
 
+    /**
+     * Write data bytes to a stream, taking ownership instead of copying them.
+     * The stream transmits and retransmits straight from data, keeping owner alive
+     * until all of it is acknowledged. The data must not change meanwhile.
+     * @param data the bytes to write.
+     * @param owner reference keeping data alive, e.g. a shared_ptr with custom deleter.
+     * @param endflags flags to finish transmission.
+     * @param deadline time by which data should be sent, not_a_date_time if none.
+     * @return the number of bytes written, which is always all of them,
+     *      or -1 if an error occurred. A full send buffer still blocks further writes
+     *      until on_ready_write.
+     */
+    virtual ssize_t write_data(boost::asio::const_buffer data,
+                               std::shared_ptr<void const> owner,
+                               uint8_t endflags,
+                               boost::posix_time::ptime deadline) = 0;
+
     //=============================================================================================
     // Record-oriented data transfer.
     // Reading data.
@@ -224,8 +280,10 @@ public:
     virtual ssize_t read_datagram(char* data, ssize_t max_size) = 0;
     virtual byte_array read_datagram(ssize_t max_size) = 0;
 
-    virtual ssize_t
-    write_datagram(char const* data, ssize_t size, stream::datagram_type is_reliable) = 0;
+    virtual ssize_t write_datagram(char const* data,
+                                   ssize_t size,
+                                   stream::datagram_type is_reliable,
+                                   boost::posix_time::ptime deadline) = 0;
 
     //=============================================================================================
     // Substreams management.
@@ -240,9 +298,12 @@ public:
      * SSS queues the new substream and any data written to it locally
      * until the remote host is ready to accept the new substream.
      *
+     * @param mode     How the new substream recovers lost data.
+     * @param lifetime How long data of a time_limited substream is worth retransmitting.
      * @return A stream object representing the new substream.
      */
-    virtual abstract_stream_ptr open_substream(/*priority_t prio = 1*/) = 0;
+    virtual abstract_stream_ptr open_substream(stream::reliability mode,
+                                               boost::posix_time::time_duration lifetime) = 0;
 
     /**
      * Listen for incoming substreams on this stream.
@@ -8,12 +8,18 @@
 //
 #pragma once
 
+#include <array>
 #include <deque>
-#include <unordered_set>
 #include <boost/signals2/signal.hpp>
-#include <boost/circular_buffer.hpp>
 #include "sss/streams/abstract_stream.h"
 #include "sss/internal/usid.h"
+#include "sss/framing/frame_parser.h"
+#include "sss/streams/send_buffer.h"
+#include "sss/streams/range_set.h"
+#include "sss/streams/receive_buffer.h"
+#include "sss/streams/receive_window_tuner.h"
+#include "sss/streams/datagram_reassembly.h"
+#include "sss/internal/timer.h"
 #include "arsenal/asio_buffer.hpp"
 
 namespace sss {
@@ -105,6 +111,8 @@ class base_stream : public abstract_stream, public std::enable_shared_from_this<
     friend class stream; // access to self_...
     friend class stream_channel;
     friend class stream_tx_attachment; // access to tx_current_attachment_
+    friend class stream_rx_attachment; // moves receive credit between channels
+    friend class internal::stream_peer; // resumes streams on new channels
 
     enum class state
     {
@@ -124,12 +132,13 @@ class base_stream : public abstract_stream, public std::enable_shared_from_this<
      * ACKed buffer segments are freed. When a contiguous chunk is ACKed, buffer is advanced to
      * allow writing more.
      */
-    boost::circular_buffer<uint8_t> buffer_; // bounded_buffer here instead
+    send_buffer buffer_;
 
     /**
      * @internal
      * Unit of data transmission on SSS stream.
-     * Frame represents a segment inside buffer that is being transmitted.
+     * Frame represents a segment inside buffer_ that is being transmitted,
+     * payload_ is a slice of the send buffer valid until the segment is acknowledged.
      * Frame's logical byte position refers to position within full stream,
      * they are used for ACKing.
      * Frame's range covers [tx_byte_seq_ .. tx_byte_seq_ + buffer_size(payload_)]
@@ -142,6 +151,16 @@ class base_stream : public abstract_stream, public std::enable_shared_from_this<
         boost::asio::const_buffer payload_; ///< Frame data.
         frame_type type_;
         bool late{false}; ///< Possibly lost frame.
+        /// Time by which the frame should be sent, not_a_date_time if it has no deadline.
+        boost::posix_time::ptime deadline_;
+        /// Time after which lost data is abandoned instead of retransmitted,
+        /// not_a_date_time for reliable data.
+        boost::posix_time::ptime give_up_;
+        /// Datagram this fragment belongs to, payload_ is a slice of it.
+        std::shared_ptr<byte_array const> datagram_;
+        uint32_t datagram_id_{0};     ///< Datagram number on the sending stream.
+        uint32_t datagram_offset_{0}; ///< Fragment offset within the datagram.
+        bool datagram_end_{false};    ///< Last fragment of the datagram.
 
         inline tx_frame_t() = default;
         inline tx_frame_t(base_stream* o, frame_type t)
@@ -152,6 +171,21 @@ class base_stream : public abstract_stream, public std::enable_shared_from_this<
         inline frame_type type() const { return type_; }
         inline bool is_null() const { return owner == nullptr; }
         inline int payload_size() const { return boost::asio::buffer_size(payload_); }
+        inline bool has_deadline() const { return not deadline_.is_special(); }
+        /// Unreliable frames are not worth sending after their deadline.
+        inline bool expired(boost::posix_time::ptime now) const
+        {
+            return type_ != frame_type::STREAM and has_deadline() and now > deadline_;
+        }
+        /// Data of this frame may be abandoned if lost, sent with the NORETRANSMIT flag.
+        inline bool is_partially_reliable() const { return not give_up_.is_not_a_date_time(); }
+        /// Datagram fragments are queued as EMPTY and sent as stateless datagram frames.
+        inline bool is_datagram() const { return type_ == frame_type::EMPTY; }
+        /// Lost partially reliable data is not worth retransmitting anymore.
+        inline bool abandoned(boost::posix_time::ptime now) const
+        {
+            return is_partially_reliable() and now > give_up_;
+        }
 
         template <typename T>
         inline T* header()
@@ -171,28 +205,6 @@ class base_stream : public abstract_stream, public std::enable_shared_from_this<
     };
     friend std::ostream& operator<<(std::ostream& os, tx_frame_t const& frame);
 
-    /**
-     * @internal
-     * Description of received data segment.
-     */
-    struct rx_segment_t
-    {
-        byte_seq_t rx_byte_seq_{0}; ///< Logical byte position.
-        byte_array buf;             ///< Packet buffer including headers. @todo asio::const_buf
-        bool end_marker_{false};    ///< This segment is end of record.
-
-        inline rx_segment_t(byte_array const& data, byte_seq_t rx_seq, bool end)
-            : rx_byte_seq_(rx_seq)
-            , buf(data)
-            , end_marker_(end)
-        {
-        }
-
-        inline int segment_size() const { return buf.size(); }
-
-        inline bool is_record_end() const { return end_marker_; }
-    };
-
     //=============================================================================================
     /** @name Connection state */
     //=============================================================================================
@@ -209,6 +221,7 @@ private:
     base_stream_ptr self_;
     state state_{state::created};
     bool init_{true};       ///< Starting a new stream and its attach hasn't been acknowledged yet.
+    bool tx_rejoin_{false}; ///< All paths were lost, next attachment rejoins by USID.
     bool top_level_{false}; ///< This is a top-level stream.
     bool end_read_{false};  ///< Seen or forced EOF for reading.
     bool end_write_{false}; ///< We've written EOF marker.
@@ -216,6 +229,8 @@ private:
     unique_stream_id_t usid_,     ///< Unique stream ID.
         parent_usid_;             ///< Unique ID of parent stream.
     internal::stream_peer* peer_; ///< Information about the other side of this connection.
+    /// usid_ in wire format, for INIT frames the peer can't derive our USID from.
+    std::array<uint8_t, framing::stream_frame_view::usid_size> usid_wire_{};
 
     /**@}*/
     //=============================================================================================
@@ -225,7 +240,8 @@ private:
 
     /// Stream is usually connected to a single channel via it's 0 index attachment point.
     /// When migrating from old to new channel, stream may be connected to two channels at once,
-    /// the new channel being connected via attachment index 1.
+    /// the new channel being connected via attachment index 1. With several paths to the peer
+    /// the stream stays attached to two of them, current attachment switching per frame.
 
     static constexpr int max_attachments = 2;
     stream_tx_attachment tx_attachments_[max_attachments]; // Our channel attachments
@@ -242,9 +258,20 @@ private:
     int32_t tx_window_{0};            ///< Current transmit window.
     int32_t tx_inflight_{0};          ///< Bytes currently in flight.
     bool tx_enqueued_channel_{false}; ///< We're enqueued for transmission on our channel.
-    std::unordered_set<byte_seq_t> tx_waiting_ack_; ///< Frames waiting to be ACKed.
-    std::deque<tx_frame_t> tx_queue_;               ///< Transmit frames queue.
-    size_t tx_waiting_size_{0}; ///< Cumulative size of all segments waiting to be ACKed.
+    bool tx_write_blocked_{false};    ///< Send buffer hit high watermark, writer must wait.
+    range_set tx_waiting_ack_;        ///< Byte ranges written but not yet ACKed.
+    /// How lost data is recovered, lifetime_ applies to time_limited mode.
+    stream::reliability reliability_{stream::reliability::reliable};
+    boost::posix_time::time_duration lifetime_;
+    /// Abandoned data the receiver hasn't been told to skip lies in [tx_skip_start_, tx_skip_end_).
+    byte_seq_t tx_skip_start_{0};
+    byte_seq_t tx_skip_end_{0};
+    /// Number of the next unreliable datagram sent on this stream.
+    uint32_t tx_datagram_id_{0};
+    byte_seq_t tx_credit_end_{0};     ///< End of data charged to channel credit.
+    std::deque<tx_frame_t> tx_queue_; ///< Transmit frames queue.
+    /// Stream offset the peer lets us send up to, raised by its MAX_STREAM_DATA frames.
+    byte_seq_t tx_stream_limit_{initial_substream_window};
 
     /**@}*/
     //=============================================================================================
@@ -255,37 +282,72 @@ private:
     /// Default receive buffer size for new top-level streams
     static constexpr int default_rx_buffer_size = 65536;
 
-    /// Next SSN expected to arrive.
-    byte_seq_t rx_byte_seq_{0};
-    /// Received bytes available.
-    int32_t rx_available_{0};
     /// Bytes avail in current message.
     int32_t rx_record_available_{0};
-    /// Total buffer space used.
-    int32_t rx_buffer_used_{0};
-    /// Receive window log2.
-    uint8_t receive_window_byte_{0};
-
-    /// Received out of order.
-    std::deque<rx_segment_t> readahead_;
-    /// Received, waiting to be read.
-    std::deque<rx_segment_t> rx_segments_;
+    /// Receive window advertised to the peer, in bytes.
+    uint32_t receive_window_{0};
+    /// Peer has sent end of stream, which is at rx_end_seq_.
+    bool rx_end_seen_{false};
+    /// Stream byte sequence of the end of stream.
+    byte_seq_t rx_end_seq_{0};
+    /// End of received data charged to channel credit.
+    byte_seq_t rx_credit_end_{0};
+    /// Start of received data charged to rx_credit_channel(), earlier bytes were charged
+    /// to a channel no longer carrying our credit.
+    byte_seq_t rx_credit_base_{0};
+    /// Stream offset the peer may send up to, as advertised in MAX_STREAM_DATA.
+    /// The ring never gets too small to hold everything up to it.
+    byte_seq_t rx_stream_limit_{initial_substream_window};
+
+    /// Reassembly ring, sized to the receive window.
+    /// Its ready_seq() is the next stream byte expected to arrive.
+    receive_buffer rx_buffer_{default_rx_buffer_size};
     /// Sizes of received messages.
     std::deque<ssize_t> rx_record_sizes_;
 
     int receive_buf_size_{default_rx_buffer_size};       // Recv buf size for channel control
     int child_receive_buf_size_{default_rx_buffer_size}; // Recv buf for child streams
 
+    /// Grows receive_buf_size_ from the configured size to cover the path bandwidth-delay product.
+    receive_window_tuner rx_tuner_{default_rx_buffer_size, default_rx_buffer_size};
+    /// Receive buffer memory above the configured size, reserved from the host budget.
+    size_t rx_reserved_{0};
+    /// Ring is larger than the window, rx_autotune() retries shrinking it as data drains.
+    bool rx_shrink_pending_{false};
+    /// Bytes handed out by peek_data() and not read yet, buffer isn't resized under them.
+    size_t rx_peeked_{0};
+
     /**@}*/
     //=============================================================================================
     /** @name Substream receive state */
     //=============================================================================================
     /**@{*/
 
-    /// Received, waiting substreams.
-    std::deque<abstract_stream_ptr> received_substreams_;
-    /// Received, waiting datagram streams.
-    std::deque<abstract_stream_ptr> received_datagrams_;
+    /**
+     * Most streams never receive substreams or datagrams, so this state is only created
+     * when the first one arrives, keeping the cost of opening a stream down.
+     */
+    struct substream_rx_state
+    {
+        /// Received, waiting substreams.
+        std::deque<abstract_stream_ptr> received_substreams_;
+        /// Received, waiting datagram streams.
+        std::deque<abstract_stream_ptr> received_datagrams_;
+        /// Fragmented datagrams being reassembled, bounded by the child receive buffer size.
+        datagram_reassembly datagrams_;
+        /// Drops partial datagrams that waited too long for their missing fragments.
+        async::timer datagram_timer_;
+
+        substream_rx_state(host* h, size_t datagram_memory_limit)
+            : datagrams_(datagram_memory_limit)
+            , datagram_timer_(h)
+        {
+        }
+    };
+    std::unique_ptr<substream_rx_state> rx_sub_;
+
+    /// Substream receive state, created if needed.
+    substream_rx_state& rx_sub();
 
     /**@}*/
 private:
@@ -307,13 +369,79 @@ private:
     void tx_enqueue_channel(bool tx_immediately = false);
 
     /**
-     * Send the stream attach packet to the peer.
+     * Largest data segment fitting into a single STREAM frame on any of our
+     * transmit channels, based on their validated path MTUs.
+     */
+    size_t tx_segment_size() const;
+
+    /**
+     * Release acknowledged prefix of the send buffer and signal on_ready_write
+     * if a blocked writer may continue.
+     */
+    void tx_release_acked();
+
+    /**
+     * Build a STREAM frame for the next payload slice of the send buffer,
+     * record it as waiting for ACK and queue it for transmission.
      */
-    void tx_attach();
+    void tx_enqueue_segment(boost::asio::const_buffer payload,
+                            boost::posix_time::ptime deadline = boost::posix_time::ptime());
 
-    void tx_attach_data(frame_type type, local_stream_id_t ref_sid);
+    /// Block the writer if the send buffer is above the high watermark.
+    void tx_check_write_blocked();
+
+    /// Emit on_ready_write, unless the writer is blocked on a full send buffer.
+    void tx_ready_write();
+
+    /// Send the head of transmit queue before our attach is acknowledged, as an INIT frame.
+    void tx_attach_data();
+    /// Peer acknowledged a frame sent on this attachment for the first time.
+    void tx_attach_acknowledged(stream_tx_attachment* attach, packet_seq_t rx_seq);
+
+    /** @name Multipath
+     * A stream the peer already knows may attach to more channels of the same peer. Each
+     * frame goes on the path expected to deliver it first, the peer's reassembly puts them
+     * back in order. Channel credit is charged on the first attachment only, on both sides.
+     */
+    /**@{*/
+    /// Our transmit attachment on channel, nullptr if there's none.
+    stream_tx_attachment* tx_attachment_on(stream_channel* channel);
+    /// Some attachment has been acknowledged, the peer knows this stream.
+    bool tx_established() const;
+    /// Current attachment is a path being added, its frames carry INIT and our USID.
+    bool tx_joining_path() const;
+    /// Attach to one more channel, nullptr if all attachment slots are taken.
+    stream_tx_attachment* tx_attach_path(stream_channel* channel);
+    /// Make current the attachment on the path delivering our next frame first.
+    void tx_select_path();
+    /// Channel whose credit our new stream data uses.
+    stream_channel* tx_credit_channel() const;
+    /// Channel whose credit the peer's new stream data uses.
+    stream_channel* rx_credit_channel() const;
+    /// Peer added channel as one more path of this stream, attach it as sid.
+    bool rx_join_path(packet_seq_t pktseq, stream_channel* channel, local_stream_id_t sid);
+    /// Lost all paths while connected, waiting for a new channel to carry on.
+    inline bool tx_needs_path() const { return tx_rejoin_ and not tx_current_attachment_; }
+    /**
+     * Carry on over channel after losing all paths. Unacknowledged frames went back into
+     * the transmit queue when the old channel went away, so sending resumes at the first
+     * byte the peer hasn't acknowledged, in INIT frames the peer matches by our USID.
+     */
+    void tx_resume(stream_channel* channel);
+    /**@}*/
     void tx_data(tx_frame_t& p);
-    void tx_datagram();
+    /// STREAM frame carrying p on the current attachment.
+    framing::stream_frame_view tx_frame_view(tx_frame_t const& p) const;
+    /// Bytes p takes up in a packet, frame header included.
+    size_t tx_frame_size(tx_frame_t const& p) const;
+    /// Deadline of the frame to be sent next, not_a_date_time if it has none.
+    boost::posix_time::ptime tx_next_deadline() const;
+    /// Drop expired unreliable frames at the head of transmit queue, counting them as misses.
+    void tx_drop_expired(stream_channel* channel);
+    /// Give up on lost bytes [start, end) of a partially reliable stream.
+    void tx_abandon(byte_seq_t start, byte_seq_t end);
+    /// Queue a skip marker telling the receiver not to wait for any data missing before byte_seq.
+    void tx_enqueue_skip(byte_seq_t byte_seq);
 
     /**
      * Send the stream reset packet to the peer.
@@ -338,10 +466,16 @@ private:
     // Returns true if received packet needs to be acked, false otherwise.
     static bool receive(packet_seq_t pktseq, byte_array const& pkt, stream_channel* channel);
 
-    bool rx_reset_frame(boost::asio::const_buffer pkt);
-    bool rx_priority_frame(boost::asio::const_buffer pkt);
-    bool rx_stream_frame(boost::asio::const_buffer pkt);
-    bool rx_detach_frame(boost::asio::const_buffer pkt);
+    // Frame handlers receive views into the decrypted packet, valid only during the call.
+    // Return true if the packet containing the frame needs to be acked.
+    static bool rx_stream_frame(packet_seq_t pktseq,
+                                framing::stream_frame_view const& frame,
+                                stream_channel* channel);
+    bool rx_reset_frame(framing::reset_frame_view const& frame);
+    bool rx_priority_frame(framing::priority_frame_view const& frame, stream_channel* channel);
+    bool rx_detach_frame(framing::detach_frame_view const& frame);
+    bool rx_max_stream_data_frame(framing::max_stream_data_frame_view const& frame);
+    bool rx_stream_data_blocked_frame(framing::stream_data_blocked_frame_view const& frame);
 
     // composite callback from channel
     bool rx_ack_frame(byte_seq_t byteseq, size_t size);
@@ -359,7 +493,59 @@ private:
     rx_attach_packet(packet_seq_t pktseq, byte_array const& pkt, stream_channel* channel);
     static bool
     rx_detach_packet(packet_seq_t pktseq, byte_array const& pkt, stream_channel* channel);
-    void rx_data(byte_array const& pkt, uint32_t byte_seq);
+    /**
+     * Deliver stream payload received at given byte offset to reassembly.
+     * @param data     View into the received packet, copied only if it has to be buffered.
+     * @param byte_seq Stream offset of the first byte of data.
+     * @param end      This is the last data on the stream (FIN).
+     */
+    void rx_data(boost::asio::const_buffer data, byte_seq_t byte_seq, bool end);
+
+    /**
+     * Peer gave up on data before byte_seq: skip the holes still missing there,
+     * reporting them to the application.
+     */
+    void rx_skip_to(byte_seq_t byte_seq);
+
+    /**
+     * Stateless datagram frame received on this stream: deliver it right away if it is
+     * whole, otherwise add it to reassembly of a larger datagram.
+     */
+    void rx_datagram_frame(framing::stream_frame_view const& frame);
+    void rx_expire_datagrams();
+
+    /**
+     * Account for act_size bytes that became available to read and notify the client,
+     * or enter the end-of-stream state if all data up to the end has arrived.
+     */
+    void rx_data_ready(size_t act_size, bool was_empty, bool was_no_recs);
+
+    /**
+     * Scatter available data into buffers, up to the next record boundary.
+     * Common implementation of all read_data() variants.
+     */
+    ssize_t rx_read(boost::asio::mutable_buffer const* buffers, size_t count);
+
+    /**
+     * Charge received segment to channel credit, counting only bytes beyond the highest offset
+     * seen so far. Returns false if the peer has exceeded the credit or the stream limit,
+     * and segment must be dropped.
+     * Segments arriving over any path are charged to rx_credit_channel().
+     */
+    bool rx_charge_credit(byte_seq_t byte_seq, size_t size);
+    /// Return credit for stream bytes begin..end read (or discarded) to the channel they were
+    /// charged to, if it's still rx_credit_channel().
+    void rx_release_credit(byte_seq_t begin, byte_seq_t end);
+    /// rx_credit_channel() is no longer old_channel: give old_channel back credit for unread
+    /// bytes and charge the new one from rx_credit_end_ on.
+    void rx_credit_moved(stream_channel* old_channel);
+    /// Raise the stream limit to cover the receive window once half of it has been read,
+    /// or the window has grown, and tell the peer.
+    void rx_extend_stream_limit();
+    /// Send our stream limit to the peer.
+    void tx_max_stream_data();
+    /// Tell the peer we have data to send beyond the stream limit it gave us.
+    void tx_stream_data_blocked();
 
     std::shared_ptr<base_stream> rx_substream(packet_seq_t pktseq,
                                               stream_channel* channel,
@@ -367,16 +553,28 @@ private:
                                               unsigned slot,
                                               unique_stream_id_t const& usid);
 
-    // Helper function to enqueue useful rx segment data.
-    void rx_enqueue_segment(rx_segment_t const& seg, size_t actual_size, bool& closed);
-
-    // Return the next receive window update byte
+    // Return the next receive window update
     // for some packet we are transmitting on this stream.
     // XX alternate between byte-window and substream-window updates.
-    inline uint8_t receive_window_byte() const { return receive_window_byte_; }
+    inline uint32_t receive_window() const { return receive_window_; }
 
     void recalculate_receive_window();
-    void recalculate_transmit_window(uint8_t window_byte);
+    void recalculate_transmit_window(uint32_t window);
+
+    /**
+     * Feed application drain rate to the window tuner and resize the receive buffer:
+     * grow it within the host memory budget, shrink it if the host is under memory pressure.
+     * Resizing waits until no peek_data() views are outstanding.
+     */
+    void rx_autotune(size_t drained);
+    /**
+     * Resize receive buffer to window bytes. Reserved memory above it returns to the host
+     * once the ring actually shrinks, which may wait for buffered data to be read.
+     */
+    void rx_resize_window(size_t window);
+
+    /// Tell the channel we transmit on about changed priority or weight.
+    void reprioritize();
 
     //=============================================================================================
     // Signal handlers.
@@ -484,26 +682,42 @@ public:
     byte_array read_record(ssize_t max_size) override;
 
     ssize_t read_data(char* data, ssize_t max_size) override;
+    ssize_t read_data(std::vector<boost::asio::mutable_buffer> const& buffers) override;
+    std::vector<boost::asio::const_buffer> peek_data(ssize_t max_size) override;
+    ssize_t consume_data(ssize_t size) override;
     ssize_t write_data(char const* data, ssize_t size, uint8_t endflags) override;
+    ssize_t write_data(boost::asio::const_buffer data,
+                       std::shared_ptr<void const> owner,
+                       uint8_t endflags,
+                       boost::posix_time::ptime deadline) override;
 
     //=============================================================================================
     // Substreams.
     //=============================================================================================
 
     // Initiate or accept substreams
-    abstract_stream_ptr open_substream() override;
+    abstract_stream_ptr open_substream(stream::reliability mode,
+                                       boost::posix_time::time_duration lifetime) override;
     abstract_stream_ptr accept_substream() override;
 
     // Send and receive unordered, unreliable datagrams on this stream.
     abstract_stream_ptr get_datagram();
     ssize_t read_datagram(char* data, ssize_t max_size) override;
     byte_array read_datagram(ssize_t max_size) override;
-    ssize_t
-    write_datagram(char const* data, ssize_t size, stream::datagram_type is_reliable) override;
+    ssize_t write_datagram(char const* data,
+                           ssize_t size,
+                           stream::datagram_type is_reliable,
+                           boost::posix_time::ptime deadline) override;
 
     void set_receive_buffer_size(size_t size) override;
     void set_child_receive_buffer_size(size_t size) override;
 
+    /**
+     * Set send buffer capacity, only possible while no written data is buffered.
+     * @return false if the send buffer is not empty.
+     */
+    bool set_send_buffer_size(size_t size);
+
     /**
      * Dump the state of this stream, for debugging purposes.
      */
@@ -515,6 +729,10 @@ public:
      * to move the stream to the correct transmit queue if necessary.
      */
     void set_priority(priority_t priority) override;
+    void set_weight(weight_t weight) override;
+
+    /// How this stream recovers lost data, chosen when it was opened.
+    inline stream::reliability reliability_mode() const { return reliability_; }
 
     // stream_channel calls these to return our transmitted packets to us
     // after being held in waiting_ack_.
@@ -563,6 +781,11 @@ operator<<(std::ostream& os, sss::base_stream::tx_frame_t const& pkt)
             case stream_protocol::frame_type::STREAM: return "stream";
             case stream_protocol::frame_type::PADDING: return "padding";
             case stream_protocol::frame_type::PRIORITY: return "priority";
+            case stream_protocol::frame_type::MAX_DATA: return "max_data";
+            case stream_protocol::frame_type::DATA_BLOCKED: return "data_blocked";
+            case stream_protocol::frame_type::PATH_CHALLENGE: return "path_challenge";
+            case stream_protocol::frame_type::PATH_RESPONSE: return "path_response";
+            case stream_protocol::frame_type::PING: return "ping";
             default: return "unknown";
         }
     }(pkt.type());
@@ -0,0 +1,98 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <map>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include "sss/streams/range_set.h"
+
+namespace sss {
+
+/**
+ * Receiver-side reassembly of unreliable datagrams too large for a single packet.
+ *
+ * Fragments are copied into place in a per-datagram buffer as they arrive, in any order.
+ * Fragments are never retransmitted, so a datagram missing one is not going to complete:
+ * partial datagrams are dropped once they are older than the expiry period, and the oldest
+ * ones are evicted to keep total buffered bytes within the memory limit. A datagram that
+ * can't fit into the limit at all is dropped right away.
+ *
+ * Datagrams fitting into a single packet never get here, see base_stream::rx_datagram_frame().
+ */
+class datagram_reassembly
+{
+public:
+    using ptime         = boost::posix_time::ptime;
+    using time_duration = boost::posix_time::time_duration;
+
+    /// How long a partial datagram may wait for its missing fragments.
+    static const time_duration default_expiry;
+
+private:
+    struct partial_datagram
+    {
+        std::vector<uint8_t> data;
+        range_set received;   ///< Fragment ranges received so far.
+        size_t end{0};        ///< Datagram size, valid once the last fragment arrived.
+        bool end_seen{false}; ///< Last fragment arrived.
+        ptime started;        ///< Arrival of the first fragment.
+    };
+
+    std::map<uint32_t, partial_datagram> partial_; ///< Keyed by datagram number.
+    size_t memory_limit_;
+    size_t used_{0}; ///< Bytes buffered in all partial datagrams.
+    time_duration expiry_;
+    size_t dropped_{0};
+
+    void drop(std::map<uint32_t, partial_datagram>::iterator it);
+    /// Evict partial datagrams other than keep, oldest first, until size more bytes fit.
+    bool make_room(size_t size, partial_datagram const* keep);
+
+public:
+    explicit datagram_reassembly(size_t memory_limit, time_duration expiry = default_expiry);
+
+    inline size_t memory_limit() const { return memory_limit_; }
+    /// Change memory limit, evicting partial datagrams if they no longer fit.
+    void set_memory_limit(size_t limit);
+
+    /// Bytes buffered in partial datagrams.
+    inline size_t memory_used() const { return used_; }
+    /// Number of datagrams waiting for more fragments.
+    inline size_t pending() const { return partial_.size(); }
+    inline bool empty() const { return partial_.empty(); }
+    /// Number of datagrams given up on so far, because they expired or didn't fit.
+    inline size_t dropped() const { return dropped_; }
+
+    /**
+     * Add a fragment of datagram number id at offset, end marks its last fragment.
+     * @param datagram Receives the whole datagram when this fragment completes it.
+     * @return true if the datagram is now complete.
+     */
+    bool add(uint32_t id,
+             size_t offset,
+             boost::asio::const_buffer fragment,
+             bool end,
+             ptime now,
+             std::vector<uint8_t>& datagram);
+
+    /**
+     * Drop partial datagrams older than the expiry period.
+     * @return Number of datagrams dropped.
+     */
+    size_t expire(ptime now);
+
+    /// Time the oldest partial datagram expires. Must not be empty.
+    ptime next_expiry() const;
+
+    void clear();
+};
+
+} // sss namespace
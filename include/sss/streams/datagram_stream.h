@@ -59,14 +59,26 @@ public:
     byte_array read_record(ssize_t max_size) override;
 
     ssize_t read_data(char* data, ssize_t max_size) override;
+    ssize_t read_data(std::vector<boost::asio::mutable_buffer> const& buffers) override;
+    std::vector<boost::asio::const_buffer> peek_data(ssize_t max_size) override;
+    ssize_t consume_data(ssize_t size) override;
     ssize_t write_data(const char* data, ssize_t size, uint8_t endflags) override;
-
-    std::shared_ptr<abstract_stream> open_substream() override;
+    ssize_t write_data(boost::asio::const_buffer data,
+                       std::shared_ptr<void const> owner,
+                       uint8_t endflags,
+                       boost::posix_time::ptime deadline) override;
+
+    std::shared_ptr<abstract_stream> open_substream(
+        stream::reliability mode,
+        boost::posix_time::time_duration lifetime) override;
     std::shared_ptr<abstract_stream> accept_substream() override;
 
     ssize_t read_datagram(char* data, ssize_t max_size) override;
     byte_array read_datagram(ssize_t max_size) override;
-    ssize_t write_datagram(const char* data, ssize_t size, stream::datagram_type is_reliable) override;
+    ssize_t write_datagram(const char* data,
+                           ssize_t size,
+                           stream::datagram_type is_reliable,
+                           boost::posix_time::ptime deadline) override;
 
     void set_receive_buffer_size(size_t size) override {
         // Do nothing.
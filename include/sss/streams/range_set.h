@@ -0,0 +1,83 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <map>
+#include <cstddef>
+#include <cstdint>
+
+namespace sss {
+
+using byte_seq_t = uint64_t;
+
+/**
+ * Set of stream byte ranges, kept as sorted disjoint half-open intervals [start, end).
+ *
+ * Adjacent and overlapping ranges are merged, so memory use is proportional to the number
+ * of holes rather than to the number of segments added. All operations are O(log n)
+ * in the number of intervals, plus the number of intervals merged or removed.
+ */
+class range_set
+{
+    std::map<byte_seq_t, byte_seq_t> ranges_; ///< Interval start -> interval end.
+    size_t total_{0};                         ///< Number of bytes covered.
+
+public:
+    inline bool empty() const { return ranges_.empty(); }
+    /// Number of disjoint intervals.
+    inline size_t intervals() const { return ranges_.size(); }
+    /// Number of bytes covered by all intervals.
+    inline size_t total_size() const { return total_; }
+
+    /// Start of the lowest interval, set must not be empty.
+    inline byte_seq_t lowest() const { return ranges_.begin()->first; }
+    /// End of the highest interval, set must not be empty.
+    inline byte_seq_t highest() const { return ranges_.rbegin()->second; }
+
+    inline void clear()
+    {
+        ranges_.clear();
+        total_ = 0;
+    }
+
+    /**
+     * Add range [start, end) to the set.
+     * @return Number of bytes which were not in the set before.
+     */
+    size_t add(byte_seq_t start, byte_seq_t end);
+
+    /**
+     * Remove range [start, end) from the set, splitting intervals as needed.
+     * @return Number of bytes which were actually removed.
+     */
+    size_t remove(byte_seq_t start, byte_seq_t end);
+
+    /// Check if any byte of [start, end) is in the set.
+    bool intersects(byte_seq_t start, byte_seq_t end) const;
+
+    /// Check if all bytes of [start, end) are in the set.
+    bool contains(byte_seq_t start, byte_seq_t end) const;
+
+    /**
+     * End of the interval containing seq, or seq itself if it is not in the set.
+     * Gives the end of contiguous data available from seq.
+     */
+    byte_seq_t contiguous_end(byte_seq_t seq) const;
+
+    /// Visit all intervals in ascending order, calling f(start, end).
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (auto const& r : ranges_) {
+            f(r.first, r.second);
+        }
+    }
+};
+
+} // sss namespace
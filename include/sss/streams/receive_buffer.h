@@ -0,0 +1,126 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include "sss/streams/range_set.h"
+
+namespace sss {
+
+/**
+ * Per-stream receive reassembly ring.
+ *
+ * Received segments are copied straight into their place in the ring, addressed by stream
+ * byte sequence, whether they arrive in order or not. Capacity is rounded up to a power of two,
+ * so ring offsets are a simple mask. Out-of-order data is tracked in
+ * a range_set, so reordering costs O(log holes) per segment, and in-order data only
+ * advances the contiguous end. Reading copies out of the ring and advances the read position.
+ * Streams that don't retransmit lost data skip_to() past holes, which then read as zeros.
+ * Ring storage is allocated when the first data arrives, so streams that never receive
+ * anything, and there are many short-lived ones, don't pay for it.
+ *
+ *   base_seq()           ready_seq()                     base_seq() + capacity()
+ *   |<--- available --->|<-- holes and out-of-order -->|
+ */
+class receive_buffer
+{
+    /// Ring storage, allocated when first needed.
+    std::unique_ptr<uint8_t[]> storage_;
+    size_t mask_;         ///< Capacity - 1, to get ring offset of a byte sequence.
+    byte_seq_t base_{0};  ///< Sequence of the next byte to read.
+    byte_seq_t ready_{0}; ///< End of contiguous received data, next expected byte sequence.
+    range_set ahead_;     ///< Ranges received beyond ready_.
+
+    /// Copy size bytes into the ring at seq, zero-filling if data is nullptr.
+    void copy_in(byte_seq_t seq, uint8_t const* data, size_t size);
+    static size_t round_capacity(size_t capacity);
+
+public:
+    /// Byte range [first, second) of the stream.
+    using byte_range_t = std::pair<byte_seq_t, byte_seq_t>;
+
+    explicit receive_buffer(size_t capacity, byte_seq_t start_seq = 0);
+
+    inline size_t capacity() const { return mask_ + 1; }
+    inline byte_seq_t base_seq() const { return base_; }
+    inline byte_seq_t ready_seq() const { return ready_; }
+    /// Contiguous bytes ready to be read.
+    inline size_t available() const { return ready_ - base_; }
+    /// Bytes received beyond a gap, waiting for retransmission to fill it.
+    inline size_t out_of_order() const { return ahead_.total_size(); }
+    /// Number of gaps, or rather out-of-order ranges, currently buffered.
+    inline size_t out_of_order_ranges() const { return ahead_.intervals(); }
+    /// Total buffer space holding data.
+    inline size_t used() const { return available() + out_of_order(); }
+
+    /// Check if segment [seq, seq + size) brings nothing new.
+    inline bool is_duplicate(byte_seq_t seq, size_t size) const
+    {
+        return seq + size <= ready_ or ahead_.contains(seq, seq + size);
+    }
+
+    /**
+     * Place received segment into the buffer.
+     * Parts already received or not fitting into capacity are dropped.
+     * @return Number of bytes which became available for reading.
+     */
+    size_t insert(byte_seq_t seq, boost::asio::const_buffer data);
+
+    /**
+     * Give up on data missing before seq, it is never going to arrive.
+     * Holes are zero-filled and become available together with the data received beyond them,
+     * so stream offsets of everything after a hole stay the same.
+     * @return Holes skipped, in ascending order.
+     */
+    std::vector<byte_range_t> skip_to(byte_seq_t seq);
+
+    /**
+     * Copy up to size available bytes out and release their space.
+     * If data is nullptr, the bytes are skipped.
+     * @return Number of bytes read.
+     */
+    size_t read(char* data, size_t size);
+
+    /**
+     * Scatter up to max_size available bytes into a sequence of buffers, filling each in turn.
+     * Buffers with nullptr data discard the bytes they would receive.
+     * @return Total number of bytes read.
+     */
+    size_t read(boost::asio::mutable_buffer const* buffers, size_t count, size_t max_size);
+
+    /**
+     * Borrow up to max_size available bytes without copying.
+     * Data may wrap around the end of the ring, so it comes in at most two pieces,
+     * second one is empty if there was no wrap. Views stay valid until the bytes are
+     * released with consume() or the capacity is changed.
+     */
+    std::array<boost::asio::const_buffer, 2> peek(size_t max_size) const;
+
+    /**
+     * Release up to size available bytes, same as reading them into nowhere.
+     * @return Number of bytes released.
+     */
+    inline size_t consume(size_t size) { return read(static_cast<char*>(nullptr), size); }
+
+    /**
+     * Change capacity, keeping buffered data.
+     * Storage is reallocated, invalidating peek() views, only if the rounded capacity changes.
+     * @return false if buffered data would not fit.
+     */
+    bool set_capacity(size_t capacity);
+
+    /// Drop all buffered data, next expected byte stays the same.
+    void clear();
+};
+
+} // sss namespace
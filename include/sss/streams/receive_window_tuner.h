@@ -0,0 +1,74 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <cstddef>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace sss {
+
+/**
+ * Receiver-side window auto-tuning.
+ *
+ * Measures how fast the application drains received data over each RTT and sizes the receive
+ * buffer to hold rtts_of_data round trips worth of it - the bandwidth-delay product with
+ * headroom. Since the sender can't deliver more than a window per RTT, a reader keeping up
+ * with the link lets the window double every RTT until it covers the path or hits max_window().
+ * A slow reader keeps the window small, there is no point buffering what it won't read.
+ *
+ * Growing is up to the caller, which may grant less memory than wanted; see base_stream.
+ */
+class receive_window_tuner
+{
+public:
+    using ptime         = boost::posix_time::ptime;
+    using time_duration = boost::posix_time::time_duration;
+
+    /// Window target in round trips of measured drain rate.
+    static constexpr size_t rtts_of_data = 2;
+    /// Default upper limit for a single stream window.
+    static constexpr size_t default_max_window = 16 << 20;
+
+private:
+    size_t window_;
+    size_t min_window_;
+    size_t max_window_;
+    ptime epoch_start_;      ///< Start of current measurement epoch.
+    size_t epoch_bytes_{0};  ///< Bytes drained since epoch_start_.
+
+public:
+    receive_window_tuner(size_t window,
+                         size_t min_window,
+                         size_t max_window = default_max_window);
+
+    inline size_t window() const { return window_; }
+    inline size_t min_window() const { return min_window_; }
+    inline size_t max_window() const { return max_window_; }
+
+    /// Set window limits, current window is clamped to them.
+    void set_limits(size_t min_window, size_t max_window);
+    /// Set current window, clamped to limits.
+    void set_window(size_t window);
+
+    /**
+     * Account for bytes read by the application.
+     * Once at least an RTT has passed since the last estimate, the drain rate over that
+     * period becomes the new window target.
+     * @return Window size wanted: larger than window() if it should grow, window() otherwise.
+     */
+    size_t drained(size_t bytes, ptime now, time_duration rtt);
+
+    /**
+     * Window to fall back to under memory pressure: half the current one,
+     * but never below min_window() or the bytes still buffered.
+     */
+    size_t shrink_target(size_t buffered) const;
+};
+
+} // sss namespace
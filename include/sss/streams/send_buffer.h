@@ -0,0 +1,113 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <boost/asio/buffer.hpp>
+
+namespace sss {
+
+using byte_seq_t = uint64_t;
+
+/**
+ * Per-stream send ring.
+ *
+ * Application data is copied in exactly once by append(); transmit frames then reference
+ * slices of the ring as const_buffers, retransmissions re-read the same bytes.
+ * Ring storage is allocated by the first append(), streams that never write don't need it.
+ * Bytes are addressed by stream byte sequence and released with release_to() as
+ * acknowledgements advance, freeing space for more writes.
+ *
+ * Slices never wrap around the end of storage, so append() may return a shorter slice
+ * at the wrap point - callers simply append the rest as the next segment.
+ *
+ * Watermarks provide backpressure: append() accepts data only up to the high watermark,
+ * a writer blocked there should wait until the buffered size drops to the low watermark.
+ *
+ * Bytes the application hands over with ownership are adopt()ed instead of copied:
+ * they take up stream sequence space like appended data, but stay in the caller's memory,
+ * which is kept alive until released. Ring storage for their sequence range is left unused,
+ * which is safe since copied data never gets more than capacity() ahead of base_seq().
+ */
+class send_buffer
+{
+    /// Ring storage, allocated by the first append().
+    std::unique_ptr<uint8_t[]> storage_;
+    size_t capacity_;
+    byte_seq_t base_{0}; ///< Sequence of the oldest unreleased byte.
+    byte_seq_t end_{0};  ///< Sequence of the next byte to append.
+    size_t high_watermark_;
+    size_t low_watermark_;
+
+    /// Adopted byte range, holding a reference to the memory owner until released.
+    struct adopted_range
+    {
+        byte_seq_t end_;
+        std::shared_ptr<void const> owner_;
+    };
+    std::deque<adopted_range> adopted_; ///< Adopted ranges in sequence order.
+
+public:
+    static constexpr size_t default_capacity = 65536;
+
+    explicit send_buffer(size_t capacity = default_capacity, byte_seq_t start_seq = 0);
+
+    inline size_t capacity() const { return capacity_; }
+    /// Bytes appended and not yet released.
+    inline size_t size() const { return end_ - base_; }
+    inline bool empty() const { return base_ == end_; }
+    inline byte_seq_t base_seq() const { return base_; }
+    inline byte_seq_t end_seq() const { return end_; }
+
+    /// Bytes append() would accept right now.
+    inline size_t free_space() const
+    {
+        return size() < high_watermark_ ? high_watermark_ - size() : 0;
+    }
+
+    inline size_t high_watermark() const { return high_watermark_; }
+    inline size_t low_watermark() const { return low_watermark_; }
+    /// Set watermarks, high is clamped to capacity and low to high.
+    void set_watermarks(size_t low, size_t high);
+
+    inline bool above_high_watermark() const { return size() >= high_watermark_; }
+    inline bool below_low_watermark() const { return size() <= low_watermark_; }
+
+    /**
+     * Copy up to size bytes at the end of the buffer.
+     * @return Slice holding the appended bytes, starting at end_seq() before the call.
+     * It may be shorter than size if the buffer hits the high watermark or wraps around.
+     */
+    boost::asio::const_buffer append(char const* data, size_t size);
+
+    /**
+     * Take over data at the end of the buffer without copying.
+     * Adopted data is always accepted whole and counts towards the watermarks.
+     * @param data  Bytes to send, must stay unchanged until released.
+     * @param owner Reference keeping data alive, dropped once all of it is released.
+     * @return Slice of the adopted bytes, starting at end_seq() before the call.
+     */
+    boost::asio::const_buffer adopt(boost::asio::const_buffer data,
+                                    std::shared_ptr<void const> owner);
+
+    /**
+     * Return a slice of previously appended (not adopted) bytes.
+     * Range must not be released yet and must not cross the wrap point.
+     */
+    boost::asio::const_buffer slice(byte_seq_t seq, size_t size) const;
+
+    /**
+     * Release bytes before seq, usually because all of them have been acknowledged.
+     * @return Number of bytes released.
+     */
+    size_t release_to(byte_seq_t seq);
+};
+
+} // sss namespace
@@ -0,0 +1,56 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "sss/framing/frame_parser.h"
+
+namespace sss {
+
+/**
+ * What to do with a STREAM frame whose Stream ID is not attached on the receiving channel.
+ */
+enum class unattached_frame_action
+{
+    join,   ///< Attach the stream found by the frame's USID to this channel.
+    create, ///< Create a new substream under the parent the frame names.
+    hold,   ///< Keep the frame until its parent LSID attaches, the parent's INIT may be late.
+    reset,  ///< Nothing to attach to, reset the sender's stream.
+};
+
+/**
+ * Decide on a STREAM frame for a Stream ID not attached on the channel it arrived on.
+ * Datagrams are not streams and never get here.
+ *
+ * @param frame Received frame.
+ * @param stream_known Peer has the stream named by the USID of a join frame.
+ * @param parent_known Parent named by Parent Stream ID or Parent USID is known.
+ *
+ * Joins never create streams: a join for a USID we don't know, e.g. a stream resuming on a new
+ * channel after we closed it, is reset. Only parents referred to by LSID may still arrive,
+ * the receiver knows every stream it could be referred to by USID.
+ */
+inline unattached_frame_action
+classify_unattached_frame(framing::stream_frame_view const& frame,
+                          bool stream_known,
+                          bool parent_known)
+{
+    if (not frame.is_init()) {
+        return unattached_frame_action::reset;
+    }
+    if (frame.is_join()) {
+        return stream_known ? unattached_frame_action::join : unattached_frame_action::reset;
+    }
+    if (parent_known) {
+        return unattached_frame_action::create;
+    }
+    return frame.has_parent_usid() ? unattached_frame_action::reset
+                                   : unattached_frame_action::hold;
+}
+
+} // sss namespace
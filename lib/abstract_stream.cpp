@@ -9,6 +9,7 @@
 #include "sss/streams/abstract_stream.h"
 #include "sss/host.h"
 #include "sss/forward_ptrs.h"
+#include <algorithm>
 
 namespace sss {
 
@@ -23,6 +24,12 @@ abstract_stream::set_priority(priority_t priority)
     priority_ = priority;
 }
 
+void
+abstract_stream::set_weight(weight_t weight)
+{
+    weight_ = std::max(weight, weight_t(1));
+}
+
 uia::peer_identity
 abstract_stream::local_host_id() const
 {
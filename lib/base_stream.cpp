@@ -12,10 +12,15 @@
 #include "arsenal/byte_array_wrap.h"
 #include "sss/streams/base_stream.h"
 #include "sss/streams/datagram_stream.h"
+#include "sss/streams/stream_frame_dispatch.h"
 #include "sss/host.h"
 #include "sss/channels/channel.h"
+#include "sss/framing/frame_writer.h"
 #include "sss/server.h"
 #include "sss/internal/stream_peer.h"
+#include "sss/internal/slab_pool.h"
+#include <limits>
+#include <cstring>
 
 using namespace std;
 
@@ -30,7 +35,14 @@ constexpr int base_stream::max_attachments;
 base_stream_ptr
 base_stream::create(host_ptr host, uia::peer_identity const& peer_id, base_stream_ptr parent)
 {
-    auto p = std::make_shared<base_stream>(host, peer_id, parent, private_tag{});
+    // Substreams come and go at a high rate, reuse the memory of those gone before.
+    base_stream_ptr p;
+    if (auto pool = host->stream_pool()) {
+        p = std::allocate_shared<base_stream>(
+            slab_allocator<base_stream>(pool), host, peer_id, parent, private_tag{});
+    } else {
+        p = std::make_shared<base_stream>(host, peer_id, parent, private_tag{});
+    }
     // Insert us into the peer's master list of streams
     p->peer_->all_streams_.insert(p);
     return p;
@@ -71,6 +83,7 @@ base_stream::~base_stream()
 {
     logger::debug() << "Destructing base stream";
     clear();
+    host_->release_receive_memory(rx_reserved_);
 }
 
 void
@@ -79,6 +92,10 @@ base_stream::clear()
     state_    = state::disconnected;
     end_read_ = end_write_ = true;
 
+    // Unread data will never be read, give its credit back to the channel.
+    rx_release_credit(rx_buffer_.base_seq(), rx_credit_end_);
+    rx_credit_end_ = rx_credit_base_ = rx_buffer_.base_seq();
+
     // De-register us from our peer
     if (peer_) {
         if (contains(peer_->usid_streams_, usid_)) {
@@ -97,12 +114,23 @@ base_stream::clear()
     }
 
     // Reset any unaccepted incoming substreams too
-    for (auto sub : received_substreams_) {
-        sub->shutdown(stream::shutdown_mode::reset);
-        // should self-destruct automatically when done - clear() call below does it
+    if (rx_sub_) {
+        for (auto sub : rx_sub_->received_substreams_) {
+            sub->shutdown(stream::shutdown_mode::reset);
+            // should self-destruct automatically when done - reset() call below does it
+        }
+        rx_sub_.reset();
+    }
+}
+
+base_stream::substream_rx_state&
+base_stream::rx_sub()
+{
+    if (not rx_sub_) {
+        rx_sub_.reset(new substream_rx_state(host_.get(), child_receive_buf_size_));
+        rx_sub_->datagram_timer_.on_timeout.connect([this](bool) { rx_expire_datagrams(); });
     }
-    received_substreams_.clear();
-    received_datagrams_.clear();
+    return *rx_sub_;
 }
 
 bool
@@ -123,18 +151,25 @@ base_stream::transmit_on(stream_channel* channel)
 
     tx_enqueued_channel_ = false; // Channel has just dequeued us.
 
-    // First garbage-collect any segments that have already been ACKed;
+    // Unreliable frames past their deadline are not worth sending anymore.
+    tx_drop_expired(channel);
+    if (tx_queue_.empty()) {
+        tx_ready_write();
+        return;
+    }
+
+    // Then garbage-collect any segments that have already been ACKed;
     // this can happen if we retransmit a segment but an ACK for the original arrives late.
     auto head_packet = &tx_queue_.front();
 
-    while (head_packet->type() == frame_type::STREAM
-           and !contains(tx_waiting_ack_, head_packet->tx_byte_seq_)) {
+    while (head_packet->type() == frame_type::STREAM and head_packet->payload_size() > 0
+           and not tx_waiting_ack_.intersects(head_packet->tx_byte_seq_,
+                                              head_packet->tx_byte_seq_
+                                                  + head_packet->payload_size())) {
         // No longer waiting for this tsn - must have been ACKed.
         tx_queue_.pop_front();
         if (tx_queue_.empty()) {
-            if (auto stream = owner_.lock()) {
-                stream->on_ready_write();
-            }
+            tx_ready_write();
             return;
         }
         head_packet = &tx_queue_.front();
@@ -142,25 +177,35 @@ base_stream::transmit_on(stream_channel* channel)
 
     int seg_size = head_packet->payload_size();
 
+    // New stream data must fit into the peer's receive window for this stream.
+    byte_seq_t seg_end = head_packet->tx_byte_seq_ + seg_size;
+    if (head_packet->type() == frame_type::STREAM and seg_end > tx_stream_limit_) {
+        logger::debug() << "Stream " << this << " blocked at stream limit " << tx_stream_limit_;
+        tx_stream_data_blocked();
+        return; // MAX_STREAM_DATA requeues us.
+    }
+
+    // New stream data must also fit into the credit all streams on the channel share.
+    if (head_packet->type() == frame_type::STREAM and seg_end > tx_credit_end_) {
+        if (not tx_credit_channel()->tx_consume_credit(seg_end - tx_credit_end_, this)) {
+            return; // Channel requeues us once the peer extends credit.
+        }
+        tx_credit_end_ = seg_end;
+    }
+
+    // Our frame shares a packet with other streams' frames. If it doesn't fit into the one
+    // being assembled, that one goes out first, and we wait if it used up the channel window.
+    if (not channel->tx_make_room(tx_frame_size(*head_packet))) {
+        tx_enqueue_channel();
+        return;
+    }
+
     // Ensure our attachment has been acknowledged before using the SID.
     if (tx_current_attachment_->is_acknowledged()) {
         // Our attachment has been acknowledged, send the data packets freely.
         assert(!init_);
         assert(tx_current_attachment_->is_active());
 
-        // Throttle data transmission if channel window is full
-        if (tx_inflight_ + seg_size > tx_window_) {
-            logger::debug() << "Transmit window full - need " << (tx_inflight_ + seg_size)
-                            << " have " << tx_window_;
-            // XXX query status if latest update is out-of-date!
-            // XXXreturn;
-        }
-
-        // Datagrams get special handling.
-        // @todo packet_type->frame_type
-        // if (head_packet->type() == packet_type::datagram)
-        //    return tx_datagram();
-
         // Register the segment as being in-flight.
         tx_inflight_ += seg_size;
 
@@ -180,48 +225,59 @@ base_stream::transmit_on(stream_channel* channel)
         // header->stream_id = tx_current_attachment_->stream_id_;
         // Preserve flags already set.
         // header->type_subtype = type_and_subtype(packet_type::data, header->type_subtype);
-        // header->window       = receive_window_byte();
+        // header->window       = receive_window();
         // header->tx_seq_no    = p.tx_byte_seq_; // Note: 32-bit TSN
 
         // Transmit
         return tx_data(p);
     }
 
-    // See if we can potentially use an optimized attach/data packet;
-    // this only works for regular stream segments, not datagrams,
-    // and only within the first 2^16 bytes of the stream.
-    // @todo packet_type->frame_type
-    // if (head_packet->type() == packet_type::data and
-    //    head_packet->tx_byte_seq_ <= 0xffff)
+    // A new stream sends data right away in STREAM frames with INIT set, referring to its
+    // parent by LSID, so a request on a fresh substream takes a single round trip.
+    // Works for regular stream data only, not datagrams, which can't create streams.
     {
-        // See if we can attach stream using an optimized Init packet,
-        // allowing us to indicate the parent with a short 16-bit LSID
-        // and piggyback useful data onto the packet.
-        // The parent must be attached to the same channel.
-        // XXX probably should use some state invariant
-        // in place of all these checks.
+        // Established stream adding this channel as another path: the peer finds the stream
+        // by USID in our INIT frames, so data flows at once without any window borrowing.
+        if (tx_joining_path()) {
+            if (head_packet->type() == frame_type::STREAM) {
+                logger::debug() << "Joining path with " << seg_size << " payload bytes";
+                return tx_attach_data();
+            }
+            // Datagrams refer to our LSID, they go on a path where the peer knows it.
+            for (auto& attach : tx_attachments_) {
+                if (attach.is_in_use() and attach.is_acknowledged()) {
+                    tx_current_attachment_ = &attach;
+                }
+            }
+            return tx_enqueue_channel();
+        }
+
         if (top_level_) {
             parent_ = channel->root_;
         }
 
         shared_ptr<base_stream> parent = parent_.lock();
+        if (init_ and not parent) {
+            return fail("Parent stream closed before child stream could be initiated");
+        }
 
-        if (init_ and parent and parent->tx_current_attachment_
-            and parent->tx_current_attachment_->channel_ == channel
-            and parent->tx_current_attachment_->is_active()
-            and usid_.half_channel_id_ == channel->tx_channel_id()
-            and uint16_t(usid_.counter_) == tx_current_attachment_->stream_id_
-            /* XXX  and parent->tx_inflight_ + seg_size <= parent->tx_window_*/) {
-            logger::debug() << "Sending optimized init packet with " << seg_size
-                            << " payload bytes";
-
-            // Adjust the in-flight byte count for channel control.
-            // Init packets get "charged" to the parent stream.
-            parent->tx_inflight_ += seg_size;
-            logger::debug() << "Inflight init " << head_packet->tx_byte_seq_
-                            << ", bytes in flight on parent " << parent->tx_inflight_;
-
-            return tx_attach_data(frame_type::STREAM, parent->tx_current_attachment_->stream_id_);
+        // The parent's own INIT frames go out before ours, so the peer knows it by the time
+        // ours arrive, or holds ours until it does. A parent attached on another channel
+        // only is referred to by its USID, once the peer has acknowledged it there.
+        if (init_ and head_packet->type() == frame_type::STREAM) {
+            if (not parent->tx_attachment_on(channel) and not parent->tx_established()) {
+                logger::debug() << "Parent of " << this << " not attached yet - waiting";
+                parent->on_attached.connect([this]() { parent_attached(); });
+                return;
+            }
+            // Until the attach is acknowledged we can only use the window borrowed
+            // from the parent; the acknowledgement requeues us.
+            if (seg_end > initial_substream_window) {
+                logger::debug() << "Borrowed window used up, waiting for attach ack";
+                return;
+            }
+            logger::debug() << "Sending init frame with " << seg_size << " payload bytes";
+            return tx_attach_data();
         }
 
         // See if our peer has this stream in its SID space,
@@ -237,18 +293,16 @@ base_stream::transmit_on(stream_channel* channel)
                                     << ", bytes in flight " << tx_inflight_;
 
                     /// @todo khustup.
-                    return tx_attach_data(frame_type::EMPTY, rx_attachments_[i].stream_id_);
+                    return tx_attach_data();
                 }
             }
         }
     }
 
-    // We've exhausted all of our optimized-path options:
-    // we have to send a specialized Attach packet instead of useful data.
-    tx_attach();
-
-    // Don't requeue onto our channel at this point -
-    // we can't transmit any data until we get that ack!
+    // Only datagrams are left, they refer to our LSID and can't attach the stream.
+    // Don't requeue onto our channel at this point - stream data attaches us,
+    // and tx_attach_acknowledged() requeues us once the peer knows our LSID.
+    logger::debug() << "Nothing to attach with, waiting for attach ack";
 }
 
 void
@@ -259,43 +313,31 @@ base_stream::recalculate_receive_window()
     assert(receive_buf_size_ > 0);
 
     // Calculate the current receive window size
-    size_t rwin = max(0, receive_buf_size_ - rx_buffer_used_);
+    ssize_t used = rx_buffer_.used();
+    size_t rwin  = max<ssize_t>(0, receive_buf_size_ - used);
 
     // If all of our buffer usage consists of out-of-order packets,
     // ensure that the sender can make progress toward filling the gaps.
     // This should only ever be an issue if we shrink the receive window abruptly,
     // leaving gaps in a formerly-large window.
     // (It's best just to avoid shrinking the receive window abruptly.)
-    if (rx_available_ == 0 and rx_buffer_used_ > 0) {
+    if (rx_buffer_.available() == 0 and used > 0) {
         rwin = max(rwin, min_receive_buffer_size);
     }
 
-    // Calculate the conservative receive window exponent
-    int i = 0;
-    while (size_t((2 << i) - 1) <= rwin) {
-        i++;
-    }
-    receive_window_byte_ = i;
+    receive_window_ = min<size_t>(rwin, numeric_limits<uint32_t>::max());
 
-    logger::debug() << "Buffered " << dec << rx_available_ << "+"
-                    << (rx_buffer_used_ - rx_available_) << ", new receive window " << rwin
-                    << ", exp " << i;
+    logger::debug() << "Buffered " << dec << rx_buffer_.available() << "+"
+                    << rx_buffer_.out_of_order() << ", new receive window " << receive_window_;
 }
 
 void
-base_stream::recalculate_transmit_window(uint8_t window_byte)
+base_stream::recalculate_transmit_window(uint32_t window)
 {
     int32_t old_window = tx_window_;
 
-    if (window_byte > 158) // Spec 4.10.1
-    {
-        logger::warning() << "Received invalid window byte " << dec << window_byte;
-        window_byte = 158;
-    }
-
-    // Calculate the new transmit window
-    int i      = window_byte & 0x1f;
-    tx_window_ = (1 << i) - 1;
+    // Window is exact, sender may use all of it.
+    tx_window_ = min<uint32_t>(window, numeric_limits<int32_t>::max());
 
     logger::debug() << "Transmit window change " << dec << old_window << "->" << tx_window_
                     << ", in use " << tx_inflight_;
@@ -468,6 +510,15 @@ base_stream::set_usid(unique_stream_id_t new_usid)
 
     usid_ = new_usid;
     peer_->usid_streams_.insert(make_pair(usid_, shared_from_this()));
+
+    // Wire format: 8 bytes of counter followed by the half-channel ID.
+    counter_t ctr = usid_.counter_;
+    for (size_t i = sizeof(ctr); i > 0; --i, ctr >>= 8) {
+        usid_wire_[i - 1] = uint8_t(ctr);
+    }
+    memcpy(usid_wire_.data() + sizeof(ctr),
+           usid_.half_channel_id_.data(),
+           min<size_t>(usid_.half_channel_id_.size(), usid_wire_.size() - sizeof(ctr)));
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -477,7 +528,7 @@ base_stream::set_usid(unique_stream_id_t new_usid)
 ssize_t
 base_stream::bytes_available() const
 {
-    return rx_available_;
+    return rx_buffer_.available();
 }
 
 bool
@@ -489,60 +540,88 @@ base_stream::at_end() const
 ssize_t
 base_stream::read_data(char* data, ssize_t max_size)
 {
+    boost::asio::mutable_buffer buffer(data, max_size);
+    return rx_read(&buffer, 1);
+}
+
+ssize_t
+base_stream::read_data(std::vector<boost::asio::mutable_buffer> const& buffers)
+{
+    return rx_read(buffers.data(), buffers.size());
+}
+
+std::vector<boost::asio::const_buffer>
+base_stream::peek_data(ssize_t max_size)
+{
+    std::vector<boost::asio::const_buffer> views;
+    size_t peeked = 0;
+    for (auto const& view : rx_buffer_.peek(max(max_size, ssize_t(0)))) {
+        if (boost::asio::buffer_size(view) > 0) {
+            views.push_back(view);
+            peeked += boost::asio::buffer_size(view);
+        }
+    }
+    rx_peeked_ = max(rx_peeked_, peeked);
+    return views;
+}
+
+ssize_t
+base_stream::consume_data(ssize_t size)
+{
+    // Go through the regular read path with a discarding buffer,
+    // it keeps record boundaries, end of stream and receive window up to date.
     ssize_t actual_size = 0;
+    while (size > actual_size and rx_buffer_.available() > 0) {
+        boost::asio::mutable_buffer discard(nullptr, size - actual_size);
+        ssize_t skipped = rx_read(&discard, 1);
+        if (skipped <= 0) {
+            break;
+        }
+        actual_size += skipped;
+    }
+    return actual_size;
+}
 
-    while (max_size > 0 and rx_available_ > 0) {
-        assert(!end_read_);
-        assert(!rx_segments_.empty());
-        rx_segment_t rseg = rx_segments_.front();
-        rx_segments_.pop_front();
+ssize_t
+base_stream::rx_read(boost::asio::mutable_buffer const* buffers, size_t count)
+{
+    assert(!end_read_ or rx_buffer_.available() == 0);
 
-        ssize_t size = rseg.segment_size();
-        assert(size >= 0);
+    // Always stop at the next message boundary.
+    size_t max_size = rx_buffer_.available();
+    if (has_pending_records()) {
+        max_size = min(max_size, size_t(rx_record_sizes_.front()));
+    }
 
-        // @fixme BUG: this breaks if we try to read a partial segment!
-        assert(max_size >= size);
+    // Copy the data (or just drop it for nullptr buffers), releasing ring space.
+    ssize_t actual_size = rx_buffer_.read(buffers, count, max_size);
+    rx_peeked_ -= min(rx_peeked_, size_t(actual_size));
 
-        // Copy the data (or just drop it if data == nullptr).
-        if (data != nullptr) {
-            /// @todo khustup
-            // memcpy(data, rseg.buf.data() + rseg.header_len, size);
-            data += size;
-        }
-        actual_size += size;
-        max_size -= size;
-
-        // Adjust the receive stats
-        rx_available_ -= size;
-        rx_buffer_used_ -= size;
-        assert(rx_available_ >= 0);
-
-        if (has_pending_records()) {
-            // We're reading data from a queued message.
-            ssize_t& headsize = rx_record_sizes_.front();
-            headsize -= size;
-            assert(headsize >= 0);
-
-            // Always stop at the next message boundary.
-            if (headsize == 0) {
-                rx_record_sizes_.pop_front();
-                break;
-            }
-        } else {
-            // No queued messages - just read raw data.
-            rx_record_available_ -= size;
-            assert(rx_record_available_ >= 0);
+    if (has_pending_records()) {
+        // We're reading data from a queued message.
+        ssize_t& headsize = rx_record_sizes_.front();
+        headsize -= actual_size;
+        assert(headsize >= 0);
+
+        if (headsize == 0) {
+            rx_record_sizes_.pop_front();
         }
+    } else {
+        // No queued messages - just read raw data.
+        rx_record_available_ -= actual_size;
+        assert(rx_record_available_ >= 0);
+    }
 
-        // If this segment has the end-marker set, that's it...
-        /// @todo khustup
-        // if (rseg.flags() & flags::data_close) {
+    // If we've read up to the end marker, that's it...
+    if (rx_end_seen_ and rx_buffer_.base_seq() >= rx_end_seq_) {
         shutdown(stream::shutdown_mode::read);
-        //}
     }
 
     // Recalculate the receive window, now that we've (presumably) freed some buffer space.
+    rx_release_credit(rx_buffer_.base_seq() - actual_size, rx_buffer_.base_seq());
+    rx_autotune(actual_size);
     recalculate_receive_window();
+    rx_extend_stream_limit();
 
     return actual_size;
 }
@@ -590,16 +669,133 @@ base_stream::read_record(ssize_t max_size)
     return buf;
 }
 
-/** @todo writing data only fills the send buffer_ */
+size_t
+base_stream::tx_segment_size() const
+{
+    // Largest STREAM frame header: type, flags, LSID, parent LSID, USID, parent USID,
+    // offset, length.
+    constexpr size_t max_stream_header = 1 + 1 + 4 + 4 + 24 + 24 + 8 + 2;
+
+    // Segments may go over any of our paths, they must fit the smallest one.
+    size_t payload = 0;
+    for (auto& attach : tx_attachments_) {
+        if (attach.is_in_use()) {
+            size_t path_payload = attach.channel_->max_payload_size();
+            payload             = payload ? min(payload, path_payload) : path_payload;
+        }
+    }
+    if (payload == 0) {
+        payload = mtu - datagram_overhead;
+    }
+    return payload - framing::frame_writer::max_packet_header_size - max_stream_header;
+}
+
+void
+base_stream::tx_ready_write()
+{
+    if (tx_write_blocked_) {
+        return;
+    }
+    if (auto stream = owner_.lock()) {
+        stream->on_ready_write();
+    }
+}
+
+void
+base_stream::tx_release_acked()
+{
+    // Everything before the lowest range still waiting for ACK has been acknowledged.
+    byte_seq_t acked_to = tx_waiting_ack_.empty() ? tx_byte_seq_ : tx_waiting_ack_.lowest();
+    buffer_.release_to(acked_to);
+
+    // Receiver may skip abandoned data once nothing before it is still on its way.
+    byte_seq_t skip_to = min(acked_to, tx_skip_end_);
+    if (skip_to > tx_skip_start_) {
+        tx_skip_start_ = skip_to;
+        tx_enqueue_skip(skip_to);
+    }
+
+    if (tx_write_blocked_ and buffer_.below_low_watermark()) {
+        logger::debug() << "Send buffer drained to " << buffer_.size() << " bytes";
+        tx_write_blocked_ = false;
+        tx_ready_write();
+    }
+}
+
+bool
+base_stream::set_send_buffer_size(size_t size)
+{
+    if (not buffer_.empty()) {
+        logger::warning() << "Cannot resize send buffer with " << buffer_.size()
+                          << " bytes still buffered";
+        return false;
+    }
+    logger::debug() << "Setting base stream send buffer size " << dec << size << " bytes";
+    // Ring positions follow stream byte sequence.
+    buffer_ = send_buffer(size, tx_byte_seq_);
+    return true;
+}
+
+void
+base_stream::tx_enqueue_segment(boost::asio::const_buffer payload,
+                                boost::posix_time::ptime deadline)
+{
+    size_t size = boost::asio::buffer_size(payload);
+
+    logger::debug() << "Transmit segment at [byteseq " << tx_byte_seq_ << "], size " << size
+                    << " bytes";
+
+    // Build the appropriate packet header.
+    tx_frame_t p(this, frame_type::STREAM);
+    p.tx_byte_seq_ = tx_byte_seq_;
+    p.payload_     = payload;
+    p.deadline_    = deadline;
+
+    // Partially reliable data is given up on if lost past its lifetime.
+    switch (reliability_) {
+        case stream::reliability::reliable: break;
+        case stream::reliability::time_limited:
+            p.give_up_ = host_->current_time() + lifetime_;
+            break;
+        case stream::reliability::unreliable: p.give_up_ = boost::posix_time::neg_infin; break;
+    }
+
+    // Advance the byte sequence to account for this data.
+    tx_byte_seq_ += size;
+
+    // Hold onto the packet data until it gets ACKed
+    tx_waiting_ack_.add(p.tx_byte_seq_, tx_byte_seq_);
+
+    logger::debug() << "write_data inserted [byteseq " << p.tx_byte_seq_
+                    << "] into waiting ack, size " << size << ", ranges "
+                    << tx_waiting_ack_.intervals() << ", twaitsize "
+                    << tx_waiting_ack_.total_size();
+
+    // Queue up the segment for transmission ASAP
+    tx_enqueue_packet(p);
+}
+
+void
+base_stream::tx_check_write_blocked()
+{
+    // Apply backpressure: the writer is told to continue with on_ready_write
+    // once acknowledgements drain the buffer to the low watermark.
+    if (buffer_.above_high_watermark()) {
+        logger::debug() << "Send buffer full, " << buffer_.size() << " bytes buffered";
+        tx_write_blocked_ = true;
+    }
+}
+
 ssize_t
 base_stream::write_data(char const* data, ssize_t total_size, uint8_t endflags)
 {
     assert(!end_write_);
+    assert(buffer_.end_seq() == tx_byte_seq_);
     ssize_t actual_size = 0;
 
-    do {
+    while (total_size > 0 and buffer_.free_space() > 0) {
         // Choose the size of this segment.
-        ssize_t size = mtu;
+        ssize_t size = tx_segment_size();
         // uint8_t flags = 0;
 
         if (total_size <= size) {
@@ -607,47 +803,20 @@ base_stream::write_data(char const* data, ssize_t total_size, uint8_t endflags)
             size = total_size;
         }
 
-        logger::debug() << "Transmit segment at [byteseq " << tx_byte_seq_ << "], size " << size
-                        << " bytes";
-
-        // Build the appropriate packet header.
-        tx_frame_t p(this, frame_type::STREAM);
-        p.tx_byte_seq_ = tx_byte_seq_;
-
-        // Prepare the header
-        // Accomodate buffer space for payload
-        /// @todo khustup
-        // p.payload_.resize(channel::header_len + sizeof(data_header) + size);
-        // auto header = p.header<data_header>();
-
-        // header->stream_id - later
-        // header->type_subtype = flags; // Major type filled in later
-        // header->window - later
-        // header->tx_byte_seq - later
-
-        // Advance the byte sequence to account for this data.
-        tx_byte_seq_ += size;
-
-        // Copy in the application payload
-        // char* payload = reinterpret_cast<char*>(header + 1);
-        // memcpy(payload, data, size);
-
-        // Hold onto the packet data until it gets ACKed
-        tx_waiting_ack_.insert(p.tx_byte_seq_);
-        tx_waiting_size_ += size;
+        // Copy the application payload into the send buffer, the only copy we make.
+        // Segment may come out shorter at the buffer's wrap point or high watermark.
+        auto slice = buffer_.append(data, size);
+        size       = boost::asio::buffer_size(slice);
 
-        logger::debug() << "write_data inserted [byteseq " << p.tx_byte_seq_
-                        << "] into waiting ack, size " << size << ", new count "
-                        << tx_waiting_ack_.size() << ", twaitsize " << tx_waiting_size_;
-
-        // Queue up the segment for transmission ASAP
-        tx_enqueue_packet(p);
+        tx_enqueue_segment(slice);
 
         // On to the next segment...
         data += size;
         total_size -= size;
         actual_size += size;
-    } while (total_size > 0);
+    }
+
+    tx_check_write_blocked();
 
     // if (endflags & flags::data_close)
     // end_write_ = true;
@@ -655,6 +824,30 @@ base_stream::write_data(char const* data, ssize_t total_size, uint8_t endflags)
     return actual_size;
 }
 
+ssize_t
+base_stream::write_data(boost::asio::const_buffer data,
+                        std::shared_ptr<void const> owner,
+                        uint8_t endflags,
+                        boost::posix_time::ptime deadline)
+{
+    assert(!end_write_);
+    assert(buffer_.end_seq() == tx_byte_seq_);
+
+    // Frames reference the owner's memory directly, no copy is made.
+    auto slice        = buffer_.adopt(data, std::move(owner));
+    size_t total_size = boost::asio::buffer_size(slice);
+
+    for (size_t pos = 0; pos < total_size;) {
+        size_t size = min(tx_segment_size(), total_size - pos);
+        tx_enqueue_segment(boost::asio::buffer(slice + pos, size), deadline);
+        pos += size;
+    }
+
+    tx_check_write_blocked();
+
+    return total_size;
+}
+
 //-------------------------------------------------------------------------------------------------
 // Unreliable datagrams
 //-------------------------------------------------------------------------------------------------
@@ -664,11 +857,12 @@ base_stream::get_datagram()
 {
     // Scan through the list of queued datagrams
     // for one with a complete record waiting to be read.
-    for (size_t i = 0; i < received_datagrams_.size(); i++) {
-        auto sub = received_datagrams_[i];
+    auto received = rx_sub_ ? &rx_sub_->received_datagrams_ : nullptr;
+    for (size_t i = 0; received and i < received->size(); i++) {
+        auto sub = (*received)[i];
         if (!sub->has_pending_records())
             continue;
-        received_datagrams_.erase(received_datagrams_.begin() + i);
+        received->erase(received->begin() + i);
         return sub;
     }
 
@@ -701,68 +895,47 @@ base_stream::read_datagram(ssize_t max_size)
 }
 
 ssize_t
-base_stream::write_datagram(const char* data, ssize_t total_size, stream::datagram_type is_reliable)
+base_stream::write_datagram(const char* data,
+                            ssize_t total_size,
+                            stream::datagram_type is_reliable,
+                            boost::posix_time::ptime deadline)
 {
     logger::debug() << "Sending datagram, size " << total_size << ", "
                     << (is_reliable == stream::datagram_type::reliable ? "reliable" : "unreliable");
-    if (is_reliable == stream::datagram_type::reliable
-        /*or total_size > (ssize_t)max_stateless_datagram_size*/) {
-        // Datagram too large to send using the stateless optimization:
-        // just send it as a regular substream.
-        logger::debug() << "Sending large datagram, size " << total_size;
-        auto sub = open_substream();
+    if (is_reliable == stream::datagram_type::reliable) {
+        // Reliable datagrams need retransmission state: send as a regular substream.
+        auto sub = open_substream(stream::reliability::reliable, {});
         if (sub == nullptr)
             return -1;
 
-        return 0; // sub->write_data(data, total_size, flags::data_close);
+        ssize_t written = sub->write_data(data, total_size, 0);
+        sub->shutdown(stream::shutdown_mode::write);
+        return written;
         // sub will self-destruct when sent and acked.
     }
 
-    ssize_t remain = total_size;
-    // uint8_t flags  = 0; // flags::datagram_begin;
+    // Unreliable datagrams keep no state on either side and are never retransmitted.
+    // One fitting into a packet goes out as a single frame the receiver delivers directly,
+    // a larger one is fragmented and reassembled by the receiver as far as its memory allows.
+    auto datagram = make_shared<byte_array const>(data, total_size);
+    uint32_t id   = tx_datagram_id_++;
+    size_t offset = 0;
     do {
-        // Choose the size of this fragment.
-        ssize_t size = mtu;
-        if (remain <= size) {
-            // flags |= flags::datagram_end;
-            size = remain;
-        }
+        size_t size = min(size_t(total_size) - offset, size_t(tx_segment_size()));
 
-        // Build the appropriate packet header.
-        /// @todo khustup
-        // packet p(this, packet_type::datagram);
         tx_frame_t p(this, frame_type::EMPTY);
-
-        // Assign this packet an ASN as if it were a data segment,
-        // but don't actually allocate any TSN bytes to it -
-        // this positions the datagram in FIFO order in tx_queue_.
-        // XX is this necessarily what we actually want?
-        p.tx_byte_seq_ = tx_byte_seq_;
-
-        // Build the datagram header.
-        ///@todo khustup
-        // p.payload.resize(channel::header_len + sizeof(datagram_header) + size);
-        // auto header = p.header<datagram_header>();
-
-        // header->stream_id - later
-        /// @todo khustup
-        // header->type_subtype = type_and_subtype(packet_type::datagram, flags);
-        // header->window - later
-
-        // Copy in the application payload
-        // char* payload = reinterpret_cast<char*>(header + 1);
-        // memcpy(payload, data, size);
-
-        // Queue up the packet
+        p.deadline_ = deadline;
+        // Position the fragment in FIFO order in tx_queue_, without using any stream bytes.
+        p.tx_byte_seq_     = tx_byte_seq_;
+        p.datagram_        = datagram;
+        p.payload_         = boost::asio::buffer(datagram->data() + offset, size);
+        p.datagram_id_     = id;
+        p.datagram_offset_ = offset;
+        p.datagram_end_    = offset + size == size_t(total_size);
         tx_enqueue_packet(p);
 
-        // On to the next fragment...
-        data += size;
-        remain -= size;
-        // flags &= ~flags::datagram_begin;
-    } while (remain > 0);
-
-    // assert(flags & flags::datagram_end);
+        offset += size;
+    } while (offset < size_t(total_size));
 
     // Once we've enqueued all the fragments of the datagram,
     // add our stream to our flow's transmit queue,
@@ -779,14 +952,26 @@ base_stream::set_priority(priority_t priority)
 {
     if (current_priority() != priority) {
         super::set_priority(priority);
+        reprioritize();
+    }
+}
 
-        if (tx_enqueued_channel_) {
-            stream_channel* chan = tx_current_attachment_->channel_;
-            assert(chan->is_active());
+void
+base_stream::set_weight(weight_t weight)
+{
+    super::set_weight(weight);
+    reprioritize();
+}
 
-            chan->dequeue_stream(this);
-            chan->enqueue_stream(this);
-        }
+/**
+ * Scheduler picks up the change in place, substreams keep their place under this stream
+ * and move along with it.
+ */
+void
+base_stream::reprioritize()
+{
+    if (tx_current_attachment_ and tx_current_attachment_->channel_) {
+        tx_current_attachment_->channel_->reprioritize_stream(this);
     }
 }
 
@@ -795,16 +980,18 @@ base_stream::set_priority(priority_t priority)
 //-------------------------------------------------------------------------------------------------
 
 abstract_stream_ptr
-base_stream::open_substream()
+base_stream::open_substream(stream::reliability mode, boost::posix_time::time_duration lifetime)
 {
     logger::debug() << "Base stream open substream";
 
     // Create a new sub-stream.
     // Note that the parent doesn't have to be attached yet:
     // the substream will attach and wait for the parent if necessary.
-    auto new_stream    = create(host_, peer_id_, shared_from_this());
-    new_stream->state_ = state::connected;
-    new_stream->self_  = new_stream; // UGH! :(
+    auto new_stream          = create(host_, peer_id_, shared_from_this());
+    new_stream->state_       = state::connected;
+    new_stream->self_        = new_stream; // UGH! :(
+    new_stream->reliability_ = mode;
+    new_stream->lifetime_    = lifetime;
 
     // Start trying to attach the new stream, if possible.
     new_stream->attach_for_transmit();
@@ -817,11 +1004,11 @@ base_stream::accept_substream()
 {
     logger::debug() << "Base stream accept substream";
 
-    if (received_substreams_.empty())
+    if (not rx_sub_ or rx_sub_->received_substreams_.empty())
         return nullptr;
 
-    auto sub = received_substreams_.front();
-    received_substreams_.pop_front();
+    auto sub = rx_sub_->received_substreams_.front();
+    rx_sub_->received_substreams_.pop_front();
 
     // sub->on_ready_read_record.disconnect(boost::bind(&base_stream::substream_read_record, this));
 
@@ -838,18 +1025,94 @@ base_stream::set_receive_buffer_size(size_t size)
         size = min_receive_buffer_size;
     }
     logger::debug() << "Setting base stream receive buffer size " << dec << size << " bytes";
-    receive_buf_size_ = size;
+    // Configured size is the auto-tuning floor, growth above it is reserved from the host.
+    rx_tuner_.set_limits(size, max(size, receive_window_tuner::default_max_window));
+    rx_resize_window(size);
+}
+
+void
+base_stream::rx_resize_window(size_t window)
+{
+    rx_tuner_.set_window(window);
+    receive_buf_size_ = window;
+    // Whatever the peer may still send under the limit we gave it must fit.
+    size_t promised = rx_stream_limit_ - rx_buffer_.base_seq();
+    size_t ring     = max(window, promised);
+    if (not rx_buffer_.set_capacity(ring)) {
+        // Keep the larger ring and its memory until buffered data drains,
+        // window shrinks right away.
+        logger::debug() << "Cannot shrink receive buffer below " << rx_buffer_.used()
+                        << " buffered bytes yet";
+        rx_shrink_pending_ = true;
+        return;
+    }
+    rx_shrink_pending_ = ring > window;
+
+    // Host memory goes back only once the ring no longer holds it.
+    size_t reserved = ring > rx_tuner_.min_window() ? ring - rx_tuner_.min_window() : 0;
+    if (reserved < rx_reserved_) {
+        host_->release_receive_memory(rx_reserved_ - reserved);
+        rx_reserved_ = reserved;
+    }
+}
+
+void
+base_stream::rx_autotune(size_t drained)
+{
+    // Drain rate is measured per round trip of the channel the data arrives on,
+    // nothing to go by without one. Receive-only streams have no transmit attachment.
+    stream_channel* channel = rx_credit_channel();
+    if (not channel) {
+        return;
+    }
+    size_t window = rx_tuner_.window();
+    size_t wanted = rx_tuner_.drained(drained, host_->current_time(), channel->smoothed_rtt());
+
+    // Moving the ring would invalidate views the application still holds,
+    // the tuner keeps its estimate and the resize happens once they're consumed.
+    if (rx_peeked_ > 0) {
+        return;
+    }
+
+    if (rx_shrink_pending_) {
+        // Earlier shrink waited for buffered data or the promised window to drain.
+        rx_resize_window(window);
+    }
+
+    if (host_->receive_memory_pressure()) {
+        size_t target = rx_tuner_.shrink_target(rx_buffer_.used());
+        if (target < window) {
+            logger::debug() << "Memory pressure, shrinking receive buffer " << dec << window
+                            << "->" << target;
+            rx_resize_window(target);
+        }
+        return;
+    }
+
+    if (wanted > window) {
+        size_t granted = host_->reserve_receive_memory(wanted - window);
+        if (granted > 0) {
+            logger::debug() << "Growing receive buffer " << dec << window << "->"
+                            << window + granted;
+            rx_reserved_ += granted;
+            rx_resize_window(window + granted);
+        }
+    }
 }
 
 void
 base_stream::set_child_receive_buffer_size(size_t size)
 {
-    if (size < min_receive_buffer_size) {
+    // New substreams must be able to take the data their peer sends before the attach ack.
+    if (size < initial_substream_window) {
         logger::warning() << "Child receive buffer size " << dec << size << " too small";
-        size = min_receive_buffer_size;
+        size = initial_substream_window;
     }
     logger::debug() << "Setting base stream child receive buffer size " << dec << size << " bytes";
     child_receive_buf_size_ = size;
+    if (rx_sub_) {
+        rx_sub_->datagrams_.set_memory_limit(size);
+    }
 }
 
 void
@@ -867,11 +1130,8 @@ base_stream::shutdown(stream::shutdown_mode mode)
 
     if (is_link_up() and !end_read_ and (fmode & to_underlying(stream::shutdown_mode::read))) {
         // Shutdown for reading
-        rx_available_        = 0;
         rx_record_available_ = 0;
-        rx_buffer_used_ = 0;
-        readahead_.clear();
-        rx_segments_.clear();
+        rx_buffer_.clear();
         rx_record_sizes_.clear();
         end_read_ = true;
     }
@@ -907,8 +1167,9 @@ void
 base_stream::dump()
 {
     logger::debug() << "Base stream " << this << " state " << int(state_) << " TSN " << tx_byte_seq_
-                    << " RSN " << rx_byte_seq_ << " rx_avail " << rx_available_ << " readahead "
-                    << readahead_.size() << " rx_segs " << rx_segments_.size() << " rx_rec_avail "
+                    << " RSN " << rx_buffer_.ready_seq() << " rx_avail " << rx_buffer_.available()
+                    << " readahead " << rx_buffer_.out_of_order() << " in "
+                    << rx_buffer_.out_of_order_ranges() << " ranges rx_rec_avail "
                     << rx_record_available_ << " rx_recs " << rx_record_sizes_.size();
 }
 
@@ -927,7 +1188,7 @@ base_stream::tx_enqueue_packet(tx_frame_t& p)
     // just to keep them in the right order with respect to segments.
     // (The assigned TSN is not transmitted in the datagram, of course).
     auto it = tx_queue_.begin();
-    while (it != tx_queue_.end() and ((*it).tx_byte_seq_ - p.tx_byte_seq_) <= 0)
+    while (it != tx_queue_.end() and (*it).tx_byte_seq_ <= p.tx_byte_seq_)
         ++it;
     tx_queue_.insert(it, p);
 
@@ -943,14 +1204,17 @@ base_stream::tx_enqueue_channel(bool tx_immediately)
 
     logger::debug(200) << "Base stream enqueue on channel";
 
+    // Each frame goes on the path to deliver it first, chosen as we get in line to send it.
+    if (!tx_enqueued_channel_ and !tx_queue_.empty()) {
+        tx_select_path();
+    }
+
     stream_channel* channel = tx_current_attachment_->channel_;
     assert(channel and channel->is_active());
 
     if (!tx_enqueued_channel_) {
         if (tx_queue_.empty()) {
-            if (auto stream = owner_.lock()) {
-                stream->on_ready_write();
-            }
+            tx_ready_write();
         } else {
             channel->enqueue_stream(this);
             tx_enqueued_channel_ = true;
@@ -963,136 +1227,328 @@ base_stream::tx_enqueue_channel(bool tx_immediately)
 }
 
 void
-base_stream::tx_attach()
+base_stream::tx_attach_data()
 {
-    logger::debug() << "Base stream tx_attach";
+    auto p = tx_queue_.front();
+    tx_queue_.pop_front();
+
+    assert(p.type() == frame_type::STREAM);
 
-    stream_channel* chan = tx_current_attachment_->channel_;
-    unsigned slot = tx_current_attachment_ - tx_attachments_; // either 0 or 1
-    assert(slot < max_attachments);
+    logger::debug() << p;
 
-    // Build the Attach packet header
-    tx_frame_t p(this, frame_type::STREAM);
-    /// @todo khustup
-    // packet p(this, packet_type::attach);
-    // auto header = p.header<attach_header>();
-
-    // header->stream_id    = tx_current_attachment_->stream_id_;
-    // header->type_subtype = type_and_subtype(
-    // frame_type::STREAM, (init_ ? flags::attach_init : 0) | (slot & flags::attach_slot_mask));
-    // header->window = receive_window_byte();
-
-    // The body of the Attach packet is the stream's full USID,
-    // and the parent's USID too if we're still initiating the stream.
-    byte_array body;
-    {
-        byte_array_owrap<flurry::oarchive> write(body);
-        write.archive() << usid_;
-        if (init_)
-            write.archive() << parent_usid_;
-        else
-            write.archive() << nullptr;
+    // tx_frame_view() makes it an INIT frame while the attach is unacknowledged.
+    return tx_data(p);
+}
+
+void
+base_stream::tx_attach_acknowledged(stream_tx_attachment* attach, packet_seq_t rx_seq)
+{
+    bool new_path = tx_established() or tx_rejoin_;
+
+    // Save the rxseq the ack came in on as the attachment's reference pktseq.
+    logger::debug() << "Got attach ack " << rx_seq << " on channel " << attach->channel_;
+    attach->set_active(rx_seq);
+    init_      = false;
+    tx_rejoin_ = false;
+
+    // Data beyond the borrowed window may now go out.
+    tx_enqueue_channel();
+
+    if (new_path) {
+        return; // Stream was attached already.
     }
-    /// @todo khustup
-    // p.payload_.append(body);
 
-    // Transmit it on the current channel.
-    packet_seq_t pktseq;
-    /// @todo khustup
-    // chan->channel_transmit(p.payload_, pktseq);
+    // Notify anyone interested that we're attached.
+    on_attached();
+    auto stream = owner_.lock();
+    if (stream and state_ == state::connected) {
+        stream->on_link_up();
+    }
+}
 
-    // Save the attach packet in the channel's waiting_ack_ hash,
-    // so that we'll be notified when the attach packet gets acked.
-    p.late = false;
-    chan->waiting_ack_.insert(make_pair(pktseq, p));
+//-------------------------------------------------------------------------------------------------
+// Multipath
+//-------------------------------------------------------------------------------------------------
+
+stream_tx_attachment*
+base_stream::tx_attachment_on(stream_channel* channel)
+{
+    for (auto& attach : tx_attachments_) {
+        if (attach.is_in_use() and attach.channel_ == channel) {
+            return &attach;
+        }
+    }
+    return nullptr;
+}
+
+bool
+base_stream::tx_established() const
+{
+    for (auto& attach : tx_attachments_) {
+        if (attach.is_in_use() and attach.is_acknowledged()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+base_stream::tx_joining_path() const
+{
+    return tx_current_attachment_ and not tx_current_attachment_->is_acknowledged()
+           and (tx_established() or tx_rejoin_);
+}
+
+stream_tx_attachment*
+base_stream::tx_attach_path(stream_channel* channel)
+{
+    for (auto& attach : tx_attachments_) {
+        if (not attach.is_in_use()) {
+            logger::debug() << "Stream " << usid_ << " adding path " << channel;
+            attach.set_attaching(channel, channel->allocate_transmit_sid());
+            return &attach;
+        }
+    }
+    return nullptr;
 }
 
 void
-base_stream::tx_attach_data(frame_type type, local_stream_id_t ref_sid)
+base_stream::tx_select_path()
 {
-    auto p = tx_queue_.front();
-    tx_queue_.pop_front();
+    if (not peer_ or peer_->path_count() < 2 or not tx_established()) {
+        return;
+    }
 
-    assert(p.type() == frame_type::STREAM);
-    assert(p.tx_byte_seq_ <= 0xffff);
-
-    // Build the init_header.
-    // auto header       = p.header<init_header>();
-    // header->stream_id = tx_current_attachment_->stream_id_;
-    // Preserve flags already set.
-    // header->type_subtype  = type_and_subtype(type, header->type_subtype); //@fixme &
-    // dataAllFlags);
-    // header->window        = receive_window_byte();
-    // header->new_stream_id = ref_sid;
-    // header->tx_seq_no     = p.tx_byte_seq; // Note: 16-bit TSN
+    auto const& head        = tx_queue_.front();
+    size_t frame_size       = tx_frame_size(head);
+    stream_channel* channel = peer_->select_path(frame_size);
+    if (not channel or channel == tx_current_attachment_->channel_) {
+        return;
+    }
+    // Segments cut before a smaller MTU path was added stay where they fit,
+    // allowing for the parent LSID and USID an INIT frame adds.
+    if (frame_size + framing::stream_frame_view::usid_size + sizeof(uint32_t)
+            + framing::frame_writer::max_packet_header_size
+        > channel->max_payload_size()) {
+        return;
+    }
 
-    logger::debug() << p;
+    // Only stream data may add a path, datagrams refer to our LSID the peer must know already.
+    auto attach = tx_attachment_on(channel);
+    if (head.type() == frame_type::STREAM) {
+        if (not attach) {
+            attach = tx_attach_path(channel);
+        }
+    } else if (attach and not attach->is_acknowledged()) {
+        attach = nullptr;
+    }
+    if (attach) {
+        logger::debug(200) << "Stream " << usid_ << " switching to path " << channel;
+        tx_current_attachment_ = attach;
+    }
+}
 
-    // Transmit
-    return tx_data(p);
+void
+base_stream::tx_resume(stream_channel* channel)
+{
+    auto attach = tx_attach_path(channel);
+    if (not attach) {
+        return;
+    }
+    logger::info() << "Stream " << usid_ << " resuming on channel " << channel;
+    tx_current_attachment_ = attach;
+
+    // The new path may have a smaller MTU than the one segments were cut for.
+    size_t segment_size = tx_segment_size();
+    for (auto it = tx_queue_.begin(); it != tx_queue_.end(); ++it) {
+        if (it->type() != frame_type::STREAM or size_t(it->payload_size()) <= segment_size) {
+            continue;
+        }
+        // The rest goes right after and gets cut again on the next iteration if needed.
+        tx_frame_t rest = *it;
+        rest.tx_byte_seq_ += segment_size;
+        rest.payload_ = rest.payload_ + segment_size;
+        it->payload_  = boost::asio::buffer(it->payload_, segment_size);
+        it            = tx_queue_.insert(std::next(it), rest) - 1;
+    }
+
+    // Credit on the new channel is charged from the first unacknowledged byte: we can't tell
+    // what the peer got beyond that, and charging it twice keeps us within the peer's limit.
+    if (not tx_waiting_ack_.empty()) {
+        tx_credit_end_ = min(tx_credit_end_, tx_waiting_ack_.lowest());
+    }
+
+    tx_enqueue_channel(/*immediately:*/ true);
+}
+
+stream_channel*
+base_stream::tx_credit_channel() const
+{
+    for (auto& attach : tx_attachments_) {
+        if (attach.is_in_use()) {
+            return attach.channel_;
+        }
+    }
+    return nullptr;
+}
+
+stream_channel*
+base_stream::rx_credit_channel() const
+{
+    for (auto& attach : rx_attachments_) {
+        if (attach.is_active()) {
+            return attach.channel_;
+        }
+    }
+    return nullptr;
+}
+
+bool
+base_stream::rx_join_path(packet_seq_t pktseq, stream_channel* channel, local_stream_id_t sid)
+{
+    for (auto& attach : rx_attachments_) {
+        if (not attach.is_active()) {
+            logger::debug() << "Stream " << usid_ << " joined by peer on channel " << channel;
+            attach.set_active(channel, sid, pktseq);
+            return true;
+        }
+    }
+    logger::warning() << "Stream " << usid_ << " has no free slot for another path";
+    return false;
 }
 
 void
 base_stream::tx_data(tx_frame_t& p)
 {
     stream_channel* channel = tx_current_attachment_->channel_;
+    channel->sending_streams_.charge(this, p.payload_size());
+
+    if (p.has_deadline()) {
+        ++channel->deadline_counters_.sent_frames;
+        if (host_->current_time() > p.deadline_) {
+            // Reliable data still goes out, but it's a miss - and no more urgent on resend.
+            ++channel->deadline_counters_.late_frames;
+            p.deadline_ = boost::posix_time::ptime();
+        }
+    }
 
-    // Transmit the packet on our current channel.
-    packet_seq_t pktseq;
-    channel->channel_transmit(p.payload_, pktseq);
-
-    logger::debug() << "tx_data " << pktseq << " pos " << p.tx_byte_seq_ << " size "
+    logger::debug() << "tx_data pos " << p.tx_byte_seq_ << " size "
                     << boost::asio::buffer_size(p.payload_);
 
-    // Save the data packet in the channel's ackwait hash.
+    // Pack the frame into the channel's current packet, shared with other streams' frames.
+    // Channel keeps it waiting for ACK once the packet is sent.
     p.late = false;
-    channel->waiting_ack_.insert(make_pair(pktseq, p));
+    channel->tx_pack_frame(p, tx_frame_view(p));
 
     // Re-queue us on our channel immediately if we still have more data to send.
     if (tx_queue_.empty()) {
-        if (auto stream = owner_.lock()) {
-            stream->on_ready_write();
+        tx_ready_write();
+    } else {
+        tx_enqueue_channel();
+    }
+}
+
+framing::stream_frame_view
+base_stream::tx_frame_view(tx_frame_t const& p) const
+{
+    framing::stream_frame_view frame{};
+    frame.stream_id     = tx_current_attachment_->stream_id_;
+    frame.stream_offset = p.tx_byte_seq_;
+    frame.data          = {boost::asio::buffer_cast<uint8_t const*>(p.payload_),
+                           boost::asio::buffer_size(p.payload_)};
+    if (p.is_datagram()) {
+        frame.flags = framing::stream_frame_view::init_flag
+                      | framing::stream_frame_view::no_retransmit_flag;
+        if (p.datagram_end_) {
+            frame.flags |= framing::stream_frame_view::fin_flag;
+        }
+        frame.stream_id        = p.datagram_id_;
+        frame.parent_stream_id = tx_current_attachment_->stream_id_;
+        frame.stream_offset    = p.datagram_offset_;
+        return frame;
+    }
+    if (p.is_partially_reliable()) {
+        frame.flags |= framing::stream_frame_view::no_retransmit_flag;
+    }
+    if (tx_joining_path()) {
+        // Peer knows the stream by its USID already, the parent doesn't matter.
+        frame.flags |= framing::stream_frame_view::init_flag
+                       | framing::stream_frame_view::usid_flag;
+        frame.parent_stream_id = framing::stream_frame_view::join_path;
+        frame.usid             = usid_wire_.data();
+    } else if (init_ and not tx_current_attachment_->is_acknowledged()) {
+        // Any of our frames may be the first the peer gets, until it acknowledges one.
+        frame.flags |= framing::stream_frame_view::init_flag;
+        auto parent = parent_.lock();
+        stream_channel* channel = tx_current_attachment_->channel_;
+        if (auto parent_attach = parent ? parent->tx_attachment_on(channel) : nullptr) {
+            frame.parent_stream_id = parent_attach->stream_id_;
+        } else if (parent) {
+            frame.parent_stream_id = framing::stream_frame_view::parent_by_usid;
+            frame.parent_usid      = parent->usid_wire_.data();
+        }
+        // Peer derives our USID from the LSID only if it's the channel's stream counter.
+        if (uint32_t(usid_.counter_) != frame.stream_id
+            or usid_.half_channel_id_ != tx_current_attachment_->channel_->tx_channel_id()) {
+            frame.flags |= framing::stream_frame_view::usid_flag;
+            frame.usid = usid_wire_.data();
         }
-    } else {
-        tx_enqueue_channel();
     }
+    return frame;
 }
 
-void
-base_stream::tx_datagram()
+size_t
+base_stream::tx_frame_size(tx_frame_t const& p) const
 {
-    logger::debug() << "Base stream tx_datagram";
+    auto frame = tx_frame_view(p);
+    return framing::frame_writer::stream_header_size(frame) + frame.data.size;
+}
 
-    // Transmit the whole datagram immediately,
-    // so that all fragments get consecutive packet sequence numbers.
-    while (true) {
-        assert(!tx_queue_.empty());
-        tx_frame_t p = tx_queue_.front();
-        tx_queue_.pop_front();
-        // assert(p.type() == packet_type::datagram);
+boost::posix_time::ptime
+base_stream::tx_next_deadline() const
+{
+    return tx_queue_.empty() ? boost::posix_time::ptime() : tx_queue_.front().deadline_;
+}
 
-        // auto header       = p.header<datagram_header>();
-        // bool at_end       = (header->type_subtype & flags::datagram_end) != 0;
-        // header->stream_id = tx_current_attachment_->stream_id_;
-        // header->window    = receive_window_byte();
+void
+base_stream::tx_drop_expired(stream_channel* channel)
+{
+    if (tx_queue_.empty() or not tx_queue_.front().has_deadline()) {
+        return;
+    }
+    auto now = host_->current_time();
+    while (not tx_queue_.empty() and tx_queue_.front().expired(now)) {
+        logger::debug() << "Dropping expired frame at [byteseq " << tx_queue_.front().tx_byte_seq_
+                        << "]";
+        ++channel->deadline_counters_.dropped_frames;
+        tx_queue_.pop_front();
+    }
+}
 
-        // Adjust the in-flight byte count.
-        // We don't need to register datagram packets in tx_inflight_
-        // because we don't keep them around after they're "missed" -
-        // which is fortunate since we _can't_ register them
-        // because they don't have unique TSNs.
-        tx_inflight_ += p.payload_size();
+void
+base_stream::tx_abandon(byte_seq_t start, byte_seq_t end)
+{
+    if (tx_waiting_ack_.remove(start, end) == 0) {
+        return; // Another copy got acknowledged meanwhile.
+    }
+    bool pending   = tx_skip_start_ < tx_skip_end_;
+    tx_skip_start_ = pending ? min(tx_skip_start_, start) : start;
+    tx_skip_end_   = max(tx_skip_end_, end);
 
-        // Transmit this datagram packet, but don't save it anywhere - just fire & forget.
-        packet_seq_t pktseq;
-        tx_current_attachment_->channel_->channel_transmit(p.payload_, pktseq);
+    // Abandoned bytes are done with just like acknowledged ones.
+    tx_release_acked();
+}
 
-        // if (at_end)
-        // break;
-    }
+void
+base_stream::tx_enqueue_skip(byte_seq_t byte_seq)
+{
+    logger::debug() << "Transmit skip marker at [byteseq " << byte_seq << "]";
 
-    // Re-queue us on our channel immediately if we still have more data to send.
-    return tx_enqueue_channel();
+    // Empty NORETRANSMIT frame, the marker itself is resent until acknowledged.
+    tx_frame_t p(this, frame_type::STREAM);
+    p.tx_byte_seq_ = byte_seq;
+    p.give_up_     = boost::posix_time::pos_infin;
+    tx_enqueue_packet(p);
 }
 
 void
@@ -1153,16 +1609,49 @@ base_stream::acknowledged(stream_channel* channel, tx_frame_t const& pkt, packet
     logger::debug() << "Base stream ACKed packet of size " << dec << pkt.payload_size();
 
     switch (pkt.type()) {
+        case frame_type::STREAM:
+            // First acknowledged INIT frame completes our attach on that channel.
+            if (auto attach = tx_attachment_on(channel)) {
+                if (not attach->is_acknowledged()) {
+                    tx_attach_acknowledged(attach, rx_seq);
+                }
+            }
+            if (pkt.payload_size() == 0) {
+                break;
+            }
+            // Mark the segment no longer "in flight".
+            end_flight(pkt);
+
+            // Record this segment as having been ACKed (if not already),
+            // so that we don't spuriously resend it
+            // if another instance is back in our transmit queue.
+            if (size_t acked = tx_waiting_ack_.remove(pkt.tx_byte_seq_,
+                                                      pkt.tx_byte_seq_ + pkt.payload_size())) {
+                logger::debug() << "tx_waiting_ack remove " << pkt.tx_byte_seq_ << ", size "
+                                << acked << ", new wait ranges " << tx_waiting_ack_.intervals()
+                                << ", waiting to ack " << tx_waiting_ack_.total_size()
+                                << " bytes";
+
+                tx_release_acked();
+                if (auto stream = owner_.lock()) {
+                    stream->on_bytes_written(acked); // XXX delay and coalesce signal
+                }
+            }
+            break;
         case frame_type::EMPTY:
         case frame_type::PADDING:
         case frame_type::SETTINGS:
-        case frame_type::STREAM:
         case frame_type::DETACH:
         case frame_type::DECONGESTION:
         case frame_type::RESET:
         case frame_type::CLOSE:
         case frame_type::ACK:
         case frame_type::PRIORITY:
+        case frame_type::MAX_DATA:
+        case frame_type::DATA_BLOCKED:
+        case frame_type::PATH_CHALLENGE:
+        case frame_type::PATH_RESPONSE:
+        case frame_type::PING:
             break;
             /// @todo
             /*
@@ -1241,21 +1730,35 @@ base_stream::missed(stream_channel* channel, tx_frame_t const& pkt)
                     << pkt.payload_size();
 
     switch (pkt.type()) {
-        case frame_type::EMPTY: {
+        case frame_type::EMPTY:
+            // Datagram fragments are never retransmitted.
+            logger::debug() << "Datagram " << pkt.datagram_id_ << " fragment at "
+                            << pkt.datagram_offset_ << " lost";
+            end_flight(pkt);
+            return false;
+
+        case frame_type::STREAM: {
+            if (pkt.abandoned(host_->current_time())) {
+                logger::debug() << "Abandon seq " << pkt.tx_byte_seq_ << " of size "
+                                << pkt.payload_size();
+                end_flight(pkt);
+                tx_abandon(pkt.tx_byte_seq_, pkt.tx_byte_seq_ + pkt.payload_size());
+                return false; // Gone for good, a late ACK changes nothing.
+            }
+            if (pkt.payload_size() == 0 and not pkt.is_partially_reliable()) {
+                logger::debug() << "Attach packet lost: trying again to attach";
+                tx_enqueue_channel();
+                return true;
+            }
             logger::debug() << "Retransmit seq " << pkt.tx_byte_seq_ << " of size "
                             << pkt.payload_size();
-            // Mark the segment no longer "in flight".
             end_flight(pkt);
-            // Retransmit reliable segments...
+            // Payload still refers to the same bytes in the send buffer,
+            // they are not released until acknowledged.
             tx_frame_t p = pkt;
             tx_enqueue_packet(p);
-            return true; // ...but keep the tx record until expiry in case it gets acked late!
-        }
-
-        case frame_type::STREAM:
-            logger::debug() << "Attach packet lost: trying again to attach";
-            tx_enqueue_channel();
             return true;
+        }
 
         case frame_type::ACK:
             logger::debug() << "Datagram packet lost: oops, gone for good";
@@ -1733,147 +2236,480 @@ base_stream::rx_detach_packet(packet_seq_t pktseq, byte_array const& pkt, stream
     return false;
 }
 
+//-------------------------------------------------------------------------------------------------
+// Frame reception
+//-------------------------------------------------------------------------------------------------
+
+// Full USID on the wire: 8 bytes of counter followed by the half-channel ID.
+static unique_stream_id_t
+wire_usid(uint8_t const* usid)
+{
+    counter_t ctr = 0;
+    for (size_t i = 0; i < sizeof(ctr); ++i) {
+        ctr = (ctr << 8) | usid[i];
+    }
+    return unique_stream_id_t(
+        ctr,
+        byte_array(reinterpret_cast<char const*>(usid) + sizeof(ctr),
+                   framing::stream_frame_view::usid_size - sizeof(ctr)));
+}
+
+// Called from stream_channel::channel_receive_frame() for every STREAM frame in a packet.
+bool
+base_stream::rx_stream_frame(packet_seq_t pktseq,
+                             framing::stream_frame_view const& frame,
+                             stream_channel* channel)
+{
+    if (frame.is_datagram()) {
+        // Stateless datagram, delivered on its parent stream without creating a substream.
+        if (auto attach = channel->rx_attachment(frame.parent_stream_id)) {
+            attach->stream_->rx_datagram_frame(frame);
+        } else {
+            logger::warning() << "rx_stream_frame: datagram for unknown stream ID "
+                              << frame.parent_stream_id;
+        }
+        return true; // Acknowledge for congestion control, lost fragments are not resent.
+    }
+
+    local_stream_id_t sid = frame.stream_id;
+
+    // Stream not attached on this channel: look up what the frame refers to.
+    bool joined = false;
+    base_stream_ptr parent;
+    stream_rx_attachment* parent_attach{nullptr};
+    if (not channel->rx_attachment(sid)) {
+        base_stream_ptr stream;
+        if (frame.is_join()) {
+            stream = channel->target_peer()->find_stream(wire_usid(frame.usid));
+        } else if (frame.has_parent_usid()) {
+            // Parent is attached on another channel only, the sender waited for us to know it.
+            parent = channel->target_peer()->find_stream(wire_usid(frame.parent_usid));
+        } else if (frame.is_init()) {
+            parent_attach = channel->rx_attachment(frame.parent_stream_id);
+        }
+
+        switch (classify_unattached_frame(frame, stream != nullptr, parent or parent_attach)) {
+            case unattached_frame_action::join:
+                // Stream we already have on another channel, adding this one as a path.
+                if (not stream->rx_join_path(pktseq, channel, sid)) {
+                    return false;
+                }
+                joined = true;
+                break;
+
+            case unattached_frame_action::hold:
+                // Parent may be new too, with its INIT frame lost or reordered: hold this one
+                // until the parent's arrives, the packet is acknowledged and won't come again.
+                logger::debug() << "rx_stream_frame: unknown parent stream ID "
+                                << frame.parent_stream_id << ", waiting for its INIT";
+                channel->rx_hold_orphan(pktseq, frame);
+                return true;
+
+            case unattached_frame_action::reset:
+                // Closed here already, a join for a stream we lost or an unknown parent USID.
+                logger::warning() << "rx_stream_frame: unknown stream ID " << sid;
+                channel->acknowledge(pktseq, false);
+                tx_reset(channel, sid, 0);
+                return false;
+
+            case unattached_frame_action::create:
+                break;
+        }
+    }
+
+    // Look up the stream - if it already exists,
+    // just dispatch it directly as a data frame.
+    if (auto attach = channel->rx_attachment(sid)) {
+        if (frame.is_init() and pktseq < attach->sid_seq_) { // earlier init packet; that's OK.
+            attach->sid_seq_ = pktseq;
+        }
+        if (not attach->stream_->rx_charge_credit(frame.stream_offset, frame.data.size)) {
+            return false; // Flow control violation, drop the frame.
+        }
+        channel->ack_sid_ = sid;
+        if (frame.is_skip()) {
+            attach->stream_->rx_skip_to(frame.stream_offset);
+        } else {
+            attach->stream_->rx_data(frame.data.buffer(), frame.stream_offset, frame.is_fin());
+        }
+        if (joined) {
+            channel->rx_replay_orphans(sid, pktseq);
+        }
+        // NORETRANSMIT frames are acknowledged too, sender needs to know what got lost.
+        return true;
+    }
+
+    // Doesn't yet exist - spawn it from the parent stream.
+    if (parent_attach) {
+        if (pktseq < parent_attach->sid_seq_) {
+            logger::warning() << "rx_stream_frame: stale wrt parent SID sequence";
+            return false; // silently drop stale packet
+        }
+        parent = parent_attach->stream_->shared_from_this();
+    }
+
+    unique_stream_id_t usid;
+    if (frame.has_usid()) {
+        usid = wire_usid(frame.usid);
+    } else {
+        // Extrapolate the sender's stream counter from the new SID it sent,
+        // and use it to form the new stream's USID.
+        counter_t ctr = channel->received_sid_counter_
+                        + (int32_t)(sid - (uint32_t)channel->received_sid_counter_);
+        usid = unique_stream_id_t(ctr, channel->rx_channel_id());
+    }
+
+    // Create the new substream.
+    auto new_stream = parent->rx_substream(pktseq, channel, sid, 0, usid);
+    if (!new_stream) {
+        return false;
+    }
+
+    // Now process any data segment contained in this init frame.
+    if (not new_stream->rx_charge_credit(frame.stream_offset, frame.data.size)) {
+        return false;
+    }
+    channel->ack_sid_ = sid;
+    if (frame.is_skip()) {
+        new_stream->rx_skip_to(frame.stream_offset);
+    } else {
+        new_stream->rx_data(frame.data.buffer(), frame.stream_offset, frame.is_fin());
+    }
+    channel->rx_replay_orphans(sid, pktseq);
+
+    return false; // Already acknowledged in rx_substream().
+}
+
 void
-base_stream::rx_data(byte_array const& pkt, uint32_t byte_seq)
-{
-    // if (end_read_) {
-    //     // Ignore anything we receive past end of stream
-    //     // (which we may have forced from our end via close()).
-    //     logger::warning() << "Ignoring segment received after end-of-stream";
-    //     assert(readahead_.empty());
-    //     assert(rx_segments_.empty());
-    //     return;
-    // }
+base_stream::rx_datagram_frame(framing::stream_frame_view const& frame)
+{
+    auto& sub = rx_sub();
+    byte_array datagram;
+    if (frame.stream_offset == 0 and frame.is_fin()) {
+        // Whole datagram in one frame, nothing to keep around.
+        datagram = byte_array(reinterpret_cast<char const*>(frame.data.data), frame.data.size);
+    } else {
+        std::vector<uint8_t> whole;
+        if (not sub.datagrams_.add(frame.stream_id,
+                                   frame.stream_offset,
+                                   frame.data.buffer(),
+                                   frame.is_fin(),
+                                   host_->current_time(),
+                                   whole)) {
+            if (not sub.datagrams_.empty() and not sub.datagram_timer_.is_active()) {
+                sub.datagram_timer_.start(sub.datagrams_.next_expiry() - host_->current_time());
+            }
+            return;
+        }
+        datagram = byte_array(reinterpret_cast<char const*>(whole.data()), whole.size());
+    }
 
-    // rx_segment_t rseg(pkt, byte_seq, channel::header_len + sizeof(data_header));
-    // int seg_size = rseg.segment_size();
-
-    // logger::debug() << "rx_data " << byte_seq << " payload size " << seg_size << " flags "
-    //                 << int(rseg.flags()) << " stream rx_seq " << rx_byte_seq_;
-
-    // // See where this packet fits in
-    // int rx_seq_diff = rseg.rx_byte_seq - rx_byte_seq_;
-    // if (rx_seq_diff <= 0) {
-    //     // The segment is at or before our current receive position.
-    //     // How much of its data, if any, is actually useful?
-    //     // Note that we must process packets at our rx_seq with no data,
-    //     // because they might have important flags.
-    //     int act_size = seg_size + rx_seq_diff;
-    //     if (act_size < 0 or (act_size == 0 and !rseg.has_flags())) {
-    //         // The packet is way out of date -
-    //         // its end doesn't even come up to our current RSN.
-    //         logger::debug() << "Duplicate segment at rx_seq " << rseg.rx_byte_seq << " size "
-    //                         << seg_size;
-    //         return recalculate_receive_window();
-    //     }
-    //     rseg.header_len -= rx_seq_diff; // Merge useless data into "headers"
-    //     logger::debug() << "actual_size " << act_size << " flags " << int(rseg.flags());
+    logger::debug() << "Received datagram " << frame.stream_id << ", size " << datagram.size();
+    sub.received_datagrams_.push_back(make_shared<datagram_stream>(host_, datagram, 0));
+    if (auto stream = owner_.lock()) {
+        stream->on_ready_read_datagram();
+    }
+}
 
-    //     // It gives us exactly the data we want next - very good!
-    //     bool was_empty   = !has_bytes_available();
-    //     bool was_no_recs = !has_pending_records();
-    //     bool closed      = false;
+void
+base_stream::rx_expire_datagrams()
+{
+    auto& sub = rx_sub();
+    if (size_t count = sub.datagrams_.expire(host_->current_time())) {
+        logger::debug() << "Dropped " << count << " incomplete datagrams, "
+                        << sub.datagrams_.dropped() << " total";
+    }
+    if (not sub.datagrams_.empty()) {
+        sub.datagram_timer_.start(sub.datagrams_.next_expiry() - host_->current_time());
+    }
+}
 
-    //     rx_enqueue_segment(rseg, act_size, /*inout*/ closed);
+bool
+base_stream::rx_charge_credit(byte_seq_t byte_seq, size_t size)
+{
+    byte_seq_t end = byte_seq + size;
+    if (end > rx_stream_limit_) {
+        logger::warning() << "Base stream " << this << " - peer exceeded stream limit "
+                          << rx_stream_limit_ << " by " << (end - rx_stream_limit_) << " bytes";
+        return false;
+    }
+    if (end <= rx_credit_end_) {
+        return true; // Retransmission, already charged.
+    }
+    stream_channel* channel = rx_credit_channel();
+    if (not channel->rx_charge_credit(end - rx_credit_end_)) {
+        return false;
+    }
+    if (end_read_) {
+        // Data past end of reading is dropped, but the peer counts it as sent.
+        channel->rx_release_credit(end - rx_credit_end_);
+    }
+    rx_credit_end_ = end;
+    return true;
+}
 
-    //     // Then pull anything we can from the reorder buffer
-    //     for (; !readahead_.empty(); readahead_.pop_front()) {
-    //         rx_segment_t& read_seg = readahead_.front();
-    //         int seg_size           = read_seg.segment_size();
+void
+base_stream::rx_release_credit(byte_seq_t begin, byte_seq_t end)
+{
+    begin = max(begin, rx_credit_base_);
+    if (end <= begin) {
+        return;
+    }
+    if (stream_channel* channel = rx_credit_channel()) {
+        channel->rx_release_credit(end - begin);
+    }
+}
 
-    //         int rx_seq_diff = read_seg.rx_byte_seq - rx_byte_seq_;
-    //         if (rx_seq_diff > 0) {
-    //             break; // There's still a gap
-    //         }
+void
+base_stream::rx_extend_stream_limit()
+{
+    if (end_read_ or not rx_credit_channel()) {
+        return;
+    }
+    // Same as channel credit: extend once half of the window has been read,
+    // so a fast reader never leaves the peer waiting for an update.
+    size_t window    = min<size_t>(receive_buf_size_, rx_buffer_.capacity());
+    byte_seq_t limit = rx_buffer_.base_seq() + window;
+    if (limit >= rx_stream_limit_ + window / 2) {
+        rx_stream_limit_ = limit;
+        tx_max_stream_data();
+    }
+}
 
-    //         // Account for removal of this segment from readhead_;
-    //         // below we'll re-add whatever part of it we use.
-    //         rx_buffer_used_ -= seg_size;
+void
+base_stream::tx_max_stream_data()
+{
+    for (auto& attach : rx_attachments_) {
+        if (attach.is_active() and attach.channel_->is_active()) {
+            logger::debug() << "Base stream " << this << " - sending MAX_STREAM_DATA "
+                            << rx_stream_limit_;
+            framing::max_stream_data_frame_view frame{attach.stream_id_, rx_stream_limit_};
+            attach.channel_->tx_control_packet([&frame](framing::frame_writer& writer) {
+                return writer.write_max_stream_data(frame);
+            });
+            return;
+        }
+    }
+}
 
-    //         logger::debug() << "Pull readahead segment at " << read_seg.rx_byte_seq << " of size
-    //         "
-    //                         << seg_size << " from reorder buffer";
+void
+base_stream::tx_stream_data_blocked()
+{
+    stream_channel* channel = tx_current_attachment_->channel_;
+    if (not channel->is_active()) {
+        return;
+    }
+    framing::stream_data_blocked_frame_view frame{tx_current_attachment_->stream_id_,
+                                                  tx_stream_limit_};
+    channel->tx_control_packet([&frame](framing::frame_writer& writer) {
+        return writer.write_stream_data_blocked(frame);
+    });
+}
 
-    //         int act_size = seg_size + rx_seq_diff;
-    //         if (act_size < 0 or (act_size == 0 and !read_seg.has_flags())) {
-    //             continue; // No useful data: drop
-    //         }
+bool
+base_stream::rx_max_stream_data_frame(framing::max_stream_data_frame_view const& frame)
+{
+    // Updates may arrive reordered, the limit never shrinks.
+    if (frame.maximum_stream_data > tx_stream_limit_) {
+        logger::debug() << "Base stream " << this << " - stream limit raised "
+                        << tx_stream_limit_ << "->" << frame.maximum_stream_data;
+        tx_stream_limit_ = frame.maximum_stream_data;
+        tx_enqueue_channel(/*immediate:*/ true);
+    }
+    return true;
+}
 
-    //         read_seg.header_len -= rx_seq_diff;
+bool
+base_stream::rx_stream_data_blocked_frame(framing::stream_data_blocked_frame_view const& frame)
+{
+    logger::debug() << "Base stream " << this << " - peer blocked at stream limit "
+                    << frame.data_limit;
+    // Peer hasn't seen our latest update, it must have been lost.
+    if (frame.data_limit < rx_stream_limit_) {
+        tx_max_stream_data();
+    }
+    return true;
+}
 
-    //         // Consume this segment too.
-    //         rx_enqueue_segment(read_seg, act_size, /*inout*/ closed);
-    //     }
+void
+base_stream::rx_credit_moved(stream_channel* old_channel)
+{
+    if (old_channel) {
+        byte_seq_t begin = max(rx_buffer_.base_seq(), rx_credit_base_);
+        if (rx_credit_end_ > begin) {
+            old_channel->rx_release_credit(rx_credit_end_ - begin);
+        }
+    }
+    // The peer charges the new channel from its first unacknowledged byte, which is never
+    // past what we've received, so our count never exceeds the peer's.
+    rx_credit_base_ = rx_credit_end_;
+}
 
-    //     // If we're at the end of stream with no data to read,
-    //     // go into the end-of-stream state immediately.
-    //     // We must do this because read_data() may never
-    //     // see our queued zero-length segment if rx_available_ == 0.
-    //     if (closed and rx_available_ == 0) {
-    //         shutdown(stream::shutdown_mode::read);
-    //         on_ready_read_record();
-    //         auto stream = owner_.lock();
-    //         if (is_link_up() and stream) {
-    //             stream->on_ready_read();
-    //             stream->on_ready_read_record();
-    //         }
-    //         return recalculate_receive_window();
-    //     }
+bool
+base_stream::rx_reset_frame(framing::reset_frame_view const& frame)
+{
+    logger::debug() << "Base stream " << this << " - reset by peer, error " << frame.error_code
+                    << " " << string(reinterpret_cast<char const*>(frame.reason_phrase.data),
+                                     frame.reason_phrase.size);
+    shutdown(stream::shutdown_mode::reset);
+    return true;
+}
 
-    //     // Notify the client if appropriate
-    //     if (was_empty) {
-    //         auto stream = owner_.lock();
-    //         if (state_ == state::connected and stream) {
-    //             stream->on_ready_read();
-    //         }
-    //     }
+bool
+base_stream::rx_priority_frame(framing::priority_frame_view const& frame,
+                               stream_channel* channel)
+{
+    logger::debug() << "Base stream " << this << " - peer priority " << frame.priority_value
+                    << " weight " << frame.weight << " parent LSID " << frame.parent_lsid;
+    // Peer tells how it wants our data sent to it, apply to our transmit schedule.
+    set_priority(frame.priority_value);
+    set_weight(frame.weight);
+
+    auto parent = channel->rx_attachment(frame.parent_lsid);
+    if (parent and parent->stream_ != this) {
+        channel->reparent_stream(this, parent->stream_);
+    }
+    return true;
+}
 
-    //     if (was_no_recs and has_pending_records()) {
-    //         if (state_ == state::connected) {
-    //             on_ready_read_record();
-    //             if (auto stream = owner_.lock()) {
-    //                 stream->on_ready_read_record();
-    //             }
-    //         } else if (state_ == state::wait_service) {
-    //             got_service_reply();
-    //         } else if (state_ == state::accepting) {
-    //             got_service_request();
-    //         }
-    //     }
-    // } else if (rx_seq_diff > 0) {
-    //     // @todo Test this section
-
-    //     // It's out of order beyond our current receive sequence -
-    //     // stash it in a re-order buffer, sorted by rx_seq.
-
-    //     logger::debug() << "Received out-of-order segment at " << rseg.rx_byte_seq << " size "
-    //                     << seg_size;
-
-    //     // Binary search for the correct position.
-    //     // lower_bound() because we want to see if there is the same element already in deque
-    //     auto it = lower_bound(
-    //         readahead_.begin(),
-    //         readahead_.end(),
-    //         rx_seq_diff,
-    //         [this](rx_segment_t& itr, int val) { return (itr.rx_byte_seq - rx_byte_seq_) < val;
-    //         });
-
-    //     // Don't save duplicate segments
-    //     // (unless the duplicate actually has more data or new flags).
-    //     if (it != readahead_.end() and (*it).rx_byte_seq == rseg.rx_byte_seq
-    //         and seg_size <= (*it).segment_size()
-    //         and rseg.flags() == (*it).flags()) {
-    //         logger::debug() << "rxseg duplicate out-of-order segment - rx_seq " <<
-    //         rseg.rx_byte_seq;
-    //         return recalculate_receive_window();
-    //     }
+/**
+ * @todo Received a detach frame, disconnect stream from the channel.
+ */
+bool
+base_stream::rx_detach_frame(framing::detach_frame_view const& frame)
+{
+    logger::debug() << "Base stream " << this << " - detach from LSID " << frame.lsid;
+    for (auto& attach : rx_attachments_) {
+        if (attach.is_active() and attach.stream_id_ == frame.lsid) {
+            attach.clear();
+        }
+    }
+    return true;
+}
 
-    //     rx_buffer_used_ += seg_size;
-    //     readahead_.insert(it, rseg);
-    // }
+void
+base_stream::rx_data(boost::asio::const_buffer data, byte_seq_t byte_seq, bool end)
+{
+    if (end_read_) {
+        // Ignore anything we receive past end of stream
+        // (which we may have forced from our end via close()).
+        logger::warning() << "Ignoring segment received after end-of-stream";
+        assert(rx_buffer_.used() == 0);
+        return;
+    }
+
+    size_t seg_size = boost::asio::buffer_size(data);
+
+    logger::debug() << "rx_data " << byte_seq << " payload size " << seg_size
+                    << (end ? " end" : "") << " stream rx_seq " << rx_buffer_.ready_seq();
+
+    if (end and not rx_end_seen_) {
+        rx_end_seen_ = true;
+        rx_end_seq_  = byte_seq + seg_size;
+    }
+
+    // Note that we must process frames at our rx_seq with no data,
+    // because they might carry the end marker.
+    if (not end and rx_buffer_.is_duplicate(byte_seq, seg_size)) {
+        logger::debug() << "Duplicate segment at rx_seq " << byte_seq << " size " << seg_size;
+        return recalculate_receive_window();
+    }
+
+    bool was_empty   = !has_bytes_available();
+    bool was_no_recs = !has_pending_records();
+
+    // Copy the segment into its place in the reassembly ring, in order or not.
+    // Any out-of-order data it makes contiguous becomes available right away.
+    size_t act_size = rx_buffer_.insert(byte_seq, data);
+
+    if (act_size == 0 and byte_seq > rx_buffer_.ready_seq()) {
+        logger::debug() << "Received out-of-order segment at " << byte_seq << " size "
+                        << seg_size << ", " << rx_buffer_.out_of_order_ranges()
+                        << " ranges buffered";
+    }
+
+    rx_data_ready(act_size, was_empty, was_no_recs);
+}
+
+void
+base_stream::rx_skip_to(byte_seq_t byte_seq)
+{
+    if (end_read_) {
+        return;
+    }
+
+    bool was_empty   = !has_bytes_available();
+    bool was_no_recs = !has_pending_records();
+
+    // Holes before the marker are never going to be filled, data after them becomes readable.
+    byte_seq_t ready = rx_buffer_.ready_seq();
+    auto holes       = rx_buffer_.skip_to(byte_seq);
+    if (holes.empty()) {
+        return; // Nothing was missing, or a stale marker.
+    }
+
+    auto stream = owner_.lock();
+    for (auto const& hole : holes) {
+        logger::debug() << "Skipping lost data at " << hole.first << " size "
+                        << hole.second - hole.first;
+        if (stream) {
+            stream->on_receive_gap(hole.first, hole.second - hole.first);
+        }
+    }
+
+    rx_data_ready(rx_buffer_.ready_seq() - ready, was_empty, was_no_recs);
+}
+
+void
+base_stream::rx_data_ready(size_t act_size, bool was_empty, bool was_no_recs)
+{
+    if (act_size > 0) {
+        rx_record_available_ += act_size;
+        logger::debug() << "Received complete record";
+        rx_record_sizes_.push_back(rx_record_available_);
+        rx_record_available_ = 0;
+    }
+
+    bool closed = rx_end_seen_ and rx_buffer_.ready_seq() >= rx_end_seq_;
+
+    // If we're at the end of stream with no data to read,
+    // go into the end-of-stream state immediately.
+    // We must do this because read_data() may never
+    // see the end of stream if there is nothing available to read.
+    if (closed and rx_buffer_.available() == 0) {
+        shutdown(stream::shutdown_mode::read);
+        on_ready_read_record();
+        auto stream = owner_.lock();
+        if (is_link_up() and stream) {
+            stream->on_ready_read();
+            stream->on_ready_read_record();
+        }
+        return recalculate_receive_window();
+    }
+
+    // Notify the client if appropriate
+    if (was_empty and has_bytes_available()) {
+        auto stream = owner_.lock();
+        if (state_ == state::connected and stream) {
+            stream->on_ready_read();
+        }
+    }
+
+    if (was_no_recs and has_pending_records()) {
+        if (state_ == state::connected) {
+            on_ready_read_record();
+            if (auto stream = owner_.lock()) {
+                stream->on_ready_read_record();
+            }
+        } else if (state_ == state::wait_service) {
+            got_service_reply();
+        } else if (state_ == state::accepting) {
+            got_service_request();
+        }
+    }
 
-    // // Recalculate the receive window now that we've probably consumed some buffer space.
-    // recalculate_receive_window();
+    // Recalculate the receive window now that we've probably consumed some buffer space.
+    recalculate_receive_window();
 }
 
 base_stream_ptr
@@ -1907,7 +2743,7 @@ base_stream::rx_substream(packet_seq_t pktseq,
 
     // Extrapolate the sender's stream counter from the new SID it sent.
     counter_t ctr =
-        channel->received_sid_counter_ + (int16_t)(sid - (int16_t)channel->received_sid_counter_);
+        channel->received_sid_counter_ + (int32_t)(sid - (uint32_t)channel->received_sid_counter_);
     if (ctr > channel->received_sid_counter_)
         channel->received_sid_counter_ = ctr;
 
@@ -1917,6 +2753,8 @@ base_stream::rx_substream(packet_seq_t pktseq,
 
     // Automatically attach the child via its appropriate receive-slot.
     new_stream->rx_attachments_[slot].set_active(channel, sid, pktseq);
+    // Let the peer use our whole window rather than the initial one.
+    new_stream->rx_extend_stream_limit();
 
     // If this is a new top-level application stream,
     // we expect a service request before application data.
@@ -1924,7 +2762,7 @@ base_stream::rx_substream(packet_seq_t pktseq,
         new_stream->state_ = state::accepting; // Service request expected on root stream
     } else {
         new_stream->state_ = state::connected;
-        received_substreams_.push_back(new_stream);
+        rx_sub().received_substreams_.push_back(new_stream);
         // new_stream->on_ready_read_record.connect(
         // boost::bind(&base_stream::substream_read_record, this));
         if (auto stream = owner_.lock()) {
@@ -1935,27 +2773,6 @@ base_stream::rx_substream(packet_seq_t pktseq,
     return new_stream;
 }
 
-// Helper function to enqueue useful data segments.
-void
-base_stream::rx_enqueue_segment(rx_segment_t const& seg, size_t actual_size, bool& closed)
-{
-    rx_segments_.push_back(seg);
-    rx_byte_seq_ += actual_size;
-    rx_available_ += actual_size;
-    rx_record_available_ += actual_size;
-    rx_buffer_used_ += actual_size;
-
-    if (/*(seg.flags() bitand (flags::data_record | flags::data_close))
-        and*/ (rx_record_available_
-                                                                         > 0)) {
-        logger::debug() << "Received complete record";
-        rx_record_sizes_.push_back(rx_record_available_);
-        rx_record_available_ = 0;
-    }
-    /*if (seg.flags() & flags::data_close)
-        closed = true;*/
-}
-
 static inline byte_array
 service_reply(stream_protocol::service_code reply, string message)
 {
@@ -2055,8 +2872,9 @@ base_stream::parent_attached()
         parent->on_attached.disconnect(boost::bind(&base_stream::parent_attached, this));
     }
 
-    // Retry attach now that parent hopefully has a USID.
-    attach_for_transmit();
+    // Retry attach now that parent hopefully has a USID, or send our INIT frames referring
+    // to the parent if we're attached already.
+    tx_enqueue_channel();
 }
 
 // void base_stream::substream_read_record()
@@ -2104,8 +2922,17 @@ stream_tx_attachment::clear()
     if (!channel)
         return;
 
-    if (stream_->tx_current_attachment_ == this)
+    // Carry on over another path if there is one.
+    bool was_current = stream_->tx_current_attachment_ == this;
+    if (was_current) {
         stream_->tx_current_attachment_ = nullptr; // @fixme Send notification?
+        for (auto& other : stream_->tx_attachments_) {
+            if (&other != this and other.is_in_use()) {
+                stream_->tx_current_attachment_ = &other;
+                break;
+            }
+        }
+    }
 
     assert(contains(channel->transmit_sids_, stream_id_));
     assert(channel->transmit_sids_[stream_id_] == this);
@@ -2115,31 +2942,47 @@ stream_tx_attachment::clear()
     channel_ = nullptr;
     active_  = false;
 
+    // Connected stream left without any path waits for a new channel to resume on.
+    if (not stream_->tx_current_attachment_ and stream_->state_ == base_stream::state::connected
+        and not stream_->usid_.is_empty()) {
+        stream_->tx_rejoin_ = true;
+    }
+
     // Remove the stream from the channel's waiting streams list
     channel->dequeue_stream(stream_);
-    stream_->tx_enqueued_channel_ = false;
+    if (was_current) {
+        stream_->tx_enqueued_channel_ = false;
+    }
 
     // Clear out packets for this stream from channel's ackwait table
     logger::debug() << "waiting ack size " << channel->waiting_ack_.size();
 
-    auto ack_copy = channel->waiting_ack_;
-    for (auto ackw : ack_copy) {
-        base_stream::tx_frame_t& p = ackw.second;
-        assert(!p.is_null());
-
-        if (p.owner != stream_)
+    // Packets may carry other streams' frames too, take out only ours.
+    std::vector<base_stream::tx_frame_t> frames;
+    for (auto it = channel->waiting_ack_.begin(); it != channel->waiting_ack_.end();) {
+        assert(!it->second.is_null());
+        if (it->second.owner != stream_) {
+            ++it;
             continue;
+        }
+        frames.push_back(it->second);
+        it = channel->waiting_ack_.erase(it);
+    }
 
-        // Move the packet back to the stream's transmit queue
+    for (auto& p : frames) {
+        // Move the frame back to the stream's transmit queue
         if (!p.late) {
             p.late = true;
             stream_->missed(channel, p);
         } else {
             stream_->expire(channel, p);
         }
+        logger::debug() << "Cleared frame";
+    }
 
-        channel->waiting_ack_.erase(ackw.first);
-        logger::debug() << "Cleared packet";
+    // Stream may have been waiting for credit on this channel, try again on the remaining path.
+    if (stream_->tx_current_attachment_ and stream_->state_ != base_stream::state::disconnected) {
+        stream_->tx_enqueue_channel();
     }
 }
 
@@ -2155,12 +2998,18 @@ stream_rx_attachment::set_active(stream_channel* channel, local_stream_id_t sid,
 
     logger::debug() << "Stream receive attachment going active on channel " << channel;
 
+    stream_channel* credit_channel = stream_->rx_credit_channel();
+
     channel_   = channel;
     stream_id_ = sid;
     sid_seq_   = rxseq;
 
     assert(!contains(channel_->receive_sids_, stream_id_));
     channel_->receive_sids_.insert(make_pair(stream_id_, this));
+
+    if (stream_->rx_credit_channel() != credit_channel) {
+        stream_->rx_credit_moved(credit_channel);
+    }
 }
 
 void
@@ -2171,7 +3020,12 @@ stream_rx_attachment::clear()
         assert(contains(channel_->receive_sids_, stream_id_));
         assert(channel_->receive_sids_[stream_id_] == this);
         channel_->receive_sids_.erase(stream_id_);
+
+        stream_channel* credit_channel = stream_->rx_credit_channel();
         channel_ = nullptr;
+        if (stream_->rx_credit_channel() != credit_channel) {
+            stream_->rx_credit_moved(credit_channel);
+        }
     }
 }
 
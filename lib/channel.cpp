@@ -8,6 +8,7 @@
 //
 #define BOOST_OPTIONAL_NO_INPLACE_FACTORY_SUPPORT
 #include <deque>
+#include <random>
 #include <boost/format.hpp>
 #include "arsenal/make_unique.h"
 #include "arsenal/logging.h"
@@ -18,6 +19,11 @@
 #include "sss/framing/packet_format.h"
 #include "sss/framing/frame_format.h"
 #include "sss/framing/framing.h"
+#include "sss/framing/packet_sequence.h"
+#include "sss/framing/frame_writer.h"
+#include "sss/framing/padding_policy.h"
+#include "sss/channels/path_mtu_discovery.h"
+#include "sss/channels/path_validation.h"
 
 using namespace std;
 using namespace sodiumpp;
@@ -47,6 +53,9 @@ static constexpr unsigned CWND_MAX = 1 << 20; // Max congestion window (packets/
 static const async::timer::duration_type RTT_INIT = time_::milliseconds(500);
 static const async::timer::duration_type RTT_MAX  = time_::seconds(30);
 
+/// Period of restarting path MTU search to discover increased MTU (PMTU_RAISE_TIMER).
+static const async::timer::duration_type PMTU_RAISE_PERIOD = time_::minutes(10);
+
 constexpr size_t channel::header_len;
 constexpr packet_seq_t channel::max_packet_sequence;
 
@@ -105,6 +114,8 @@ public:
     uint32_t mark_acks_{0};
     /// Number of ACKs expected after last mark.
     uint32_t mark_sent_{0};
+    /// Include protocol version in packet headers until the peer acks any of our packets.
+    bool tx_send_version_{true};
 
     /**@}*/
     //-------------------------------------------
@@ -115,6 +126,7 @@ public:
     /// Highest sequence number received so far.
     packet_seq_t rx_sequence_{0};
     /// Mask of packets received so far (1 = fictitious packet 0)
+    /// Bit i is set if packet rx_sequence_ - i has been received.
     uint64_t rx_mask_{1};
 
     // Receive-side ACK state
@@ -701,6 +713,20 @@ public:
 
     async::timer stats_timer_;
 
+    // Path MTU discovery state
+    channels::path_mtu_discovery pmtu_;
+    async::timer pmtu_timer_; ///< Search restart timer.
+
+    framing::padding_policy padding_;
+
+    // Connection migration state
+    uia::comm::socket_endpoint peer_ep_; ///< Where the peer is reached now.
+    path_validation<uia::comm::socket_endpoint> path_;
+    async::timer path_timer_; ///< PATH_CHALLENGE retry timer.
+    std::mt19937_64 challenge_generator_{std::random_device{}()};
+    /// Source of the packet being processed, valid only during receive().
+    uia::comm::socket_endpoint const* rx_source_{nullptr};
+
 public:
     private_data(shared_ptr<host> host)
         : host_(host)
@@ -708,6 +734,8 @@ public:
         , ack_timer_(host.get())
         , retransmit_timer_(host.get())
         , stats_timer_(host.get())
+        , pmtu_timer_(host.get())
+        , path_timer_(host.get())
     {
         // Initialize transmit congestion control state
         state_->tx_events_.push_back(transmit_event_t(0, false));
@@ -759,6 +787,12 @@ channel::private_data::stats_timeout()
                           % congestion_control->cwnd_ % congestion_control->ssthresh
                           % congestion_control->cumulative_rtt_
                           % congestion_control->cumulative_pps_ % congestion_control->cumloss;
+
+    auto const& pad = padding_.stats();
+    logger::info() << boost::format("STATS: padded %llu/%llu packets, padding %llu bytes, "
+                                    "payload %llu bytes")
+                          % pad.padded_packets % pad.packets % pad.padding_bytes
+                          % pad.payload_bytes;
 }
 
 void
@@ -801,6 +835,10 @@ channel::channel(shared_ptr<host> host, secret_key local, public_key remote)
 
     // Delayed ACK state
     pimpl_->ack_timer_.on_timeout.connect([this](bool) { ack_timeout(); });
+
+    pimpl_->pmtu_timer_.on_timeout.connect([this](bool) { pmtu_timeout(); });
+
+    pimpl_->path_timer_.on_timeout.connect([this](bool) { path_challenge_timeout(); });
 }
 
 channel::~channel()
@@ -820,21 +858,47 @@ channel::start(bool initiate)
 
     super::start(initiate);
 
+    if (rx_connection_id_) {
+        pimpl_->host_->register_channel(rx_connection_id_, this);
+    }
+
     pimpl_->nocc_ = is_congestion_controlled();
 
     // We're ready to go!
     set_link_status(uia::comm::socket::status::up);
     on_ready_transmit();
     start_retransmit_timer();
+
+    tx_pmtu_probe();
+    pimpl_->pmtu_timer_.start(PMTU_RAISE_PERIOD);
+}
+
+void
+channel::set_connection_ids(channels::connection_id_t tx_cid, channels::connection_id_t rx_cid)
+{
+    if (rx_connection_id_ and is_active()) {
+        pimpl_->host_->unregister_channel(rx_connection_id_);
+    }
+    tx_connection_id_ = tx_cid;
+    rx_connection_id_ = rx_cid;
+    if (rx_connection_id_ and is_active()) {
+        pimpl_->host_->register_channel(rx_connection_id_, this);
+    }
 }
 
 void
 channel::stop()
 {
     logger::debug() << "Channel - stop";
+    if (rx_connection_id_) {
+        pimpl_->host_->unregister_channel(rx_connection_id_);
+    }
     pimpl_->retransmit_timer_.stop();
     pimpl_->ack_timer_.stop();
     pimpl_->stats_timer_.stop();
+    pimpl_->pmtu_timer_.stop();
+    pimpl_->path_timer_.stop();
+    pimpl_->path_.cancel();
 
     super::stop();
 
@@ -860,6 +924,176 @@ channel::may_transmit()
     return 0;
 }
 
+size_t
+channel::path_mtu() const
+{
+    return pimpl_->pmtu_.mtu();
+}
+
+uia::comm::socket_endpoint const&
+channel::peer_endpoint() const
+{
+    return pimpl_->peer_ep_;
+}
+
+void
+channel::set_peer_endpoint(uia::comm::socket_endpoint const& ep)
+{
+    pimpl_->peer_ep_ = ep;
+}
+
+async::timer::duration_type
+channel::smoothed_rtt() const
+{
+    if (not pimpl_->congestion_control) {
+        return RTT_INIT;
+    }
+    return pimpl_->congestion_control->cumulative_rtt_;
+}
+
+path_estimate
+channel::tx_path_estimate() const
+{
+    path_estimate estimate;
+    estimate.srtt = smoothed_rtt();
+    size_t cwnd   = CWND_MAX;
+    if (pimpl_->congestion_control and not pimpl_->nocc_) {
+        cwnd = pimpl_->congestion_control->tx_congestion_window();
+    }
+    estimate.window    = cwnd * path_mtu();
+    estimate.in_flight = pimpl_->state_->tx_inflight_size_;
+    return estimate;
+}
+
+void
+channel::set_max_path_mtu(size_t max_mtu)
+{
+    pimpl_->pmtu_.set_max_mtu(max_mtu);
+    if (is_active()) {
+        tx_pmtu_probe();
+    }
+}
+
+framing::padding_policy&
+channel::tx_padding()
+{
+    return pimpl_->padding_;
+}
+
+void
+channel::tx_pmtu_probe()
+{
+    size_t size = pimpl_->pmtu_.next_probe_size();
+    if (size == 0) {
+        return;
+    }
+
+    // Probe is a packet header and a PING, which makes the peer acknowledge it,
+    // followed by padding up to the probed datagram size.
+    packet_seq_t packet_seq = pimpl_->state_->tx_sequence_;
+    byte_array packet;
+    packet.resize(size - stream_protocol::datagram_overhead);
+
+    framing::frame_writer writer(asio::buffer(packet.data(), packet.size()));
+    writer.write_packet_header(tx_packet_header(packet_seq));
+    writer.write_ping();
+    writer.write_padding(writer.remaining());
+
+    logger::debug() << "Channel " << this << " - PMTU probe of " << size << " bytes, seq "
+                    << packet_seq;
+    pimpl_->pmtu_.probe_sent(packet_seq, size);
+    transmit(asio::buffer(packet.data(), packet.size()), 0, packet_seq, false);
+}
+
+packet_seq_t
+channel::tx_next_sequence() const
+{
+    return pimpl_->state_->tx_sequence_;
+}
+
+bool
+channel::tx_control_packet(function<bool(framing::frame_writer&)> const& write_frames,
+                           uia::comm::socket_endpoint const* to)
+{
+    packet_seq_t packet_seq = tx_next_sequence();
+    byte_array packet;
+    packet.resize(max_payload_size());
+
+    framing::frame_writer writer(asio::buffer(packet.data(), packet.size()));
+    writer.write_packet_header(tx_packet_header(packet_seq));
+    if (not write_frames(writer)) {
+        return false;
+    }
+    tx_padding().pad(writer);
+    return transmit(asio::buffer(packet.data(), writer.size()), 0, packet_seq, false, to);
+}
+
+void
+channel::pmtu_timeout()
+{
+    pimpl_->pmtu_.restart();
+    tx_pmtu_probe();
+    pimpl_->pmtu_timer_.start(PMTU_RAISE_PERIOD);
+}
+
+void
+channel::rx_new_source(uia::comm::socket_endpoint const& src, bool newest)
+{
+    if (not pimpl_->path_.packet_from(src, newest, pimpl_->challenge_generator_())) {
+        return;
+    }
+    logger::info() << "Channel " << this << " - peer moved from " << pimpl_->peer_ep_
+                   << " to " << src << ", validating new path";
+    tx_path_challenge();
+}
+
+void
+channel::tx_path_challenge()
+{
+    auto& path = pimpl_->path_;
+    tx_control_packet(
+        [&path](framing::frame_writer& writer) {
+            return writer.write_path_challenge({path.challenge()});
+        },
+        &path.candidate());
+    path.challenge_sent();
+
+    // Nothing is known about the new path yet, allow it a few round trips of the old one.
+    pimpl_->path_timer_.start(
+        time_::milliseconds(pimpl_->congestion_control->cumulative_rtt_.total_milliseconds() * 3));
+}
+
+void
+channel::path_challenge_timeout()
+{
+    if (pimpl_->path_.challenge_lost()) {
+        tx_path_challenge();
+        return;
+    }
+    logger::warning() << "Channel " << this << " - path validation failed, staying on "
+                      << pimpl_->peer_ep_;
+}
+
+void
+channel::migrate_to(uia::comm::socket_endpoint const& ep)
+{
+    logger::info() << "Channel " << this << " - migrating from " << pimpl_->peer_ep_ << " to "
+                   << ep;
+    pimpl_->path_timer_.stop();
+    pimpl_->peer_ep_ = ep;
+
+    // Start over conservatively: the new path may have less capacity and a different MTU.
+    pimpl_->congestion_control->reset();
+    pimpl_->pmtu_ = channels::path_mtu_discovery(pimpl_->pmtu_.max_mtu());
+    tx_pmtu_probe();
+    pimpl_->pmtu_timer_.start(PMTU_RAISE_PERIOD);
+
+    set_link_status(uia::comm::socket::status::up);
+    if (may_transmit()) {
+        on_ready_transmit();
+    }
+}
+
 bool
 channel::channel_transmit(boost::asio::const_buffer packet, packet_seq_t& packet_seq)
 {
@@ -896,7 +1130,8 @@ bool
 channel::transmit(boost::asio::const_buffer packet,
                   uint32_t ack_seq,
                   uint64_t& packet_seq,
-                  bool is_data)
+                  bool is_data,
+                  uia::comm::socket_endpoint const* to)
 {
     assert(is_active());
 
@@ -915,6 +1150,9 @@ channel::transmit(boost::asio::const_buffer packet,
 
     // logger::file_dump(packet, "sending channel packet before encrypt");
 
+    // Once tx_connection_id_ is set the encrypted packet must start with
+    // tx_message_header(packet_seq) instead of the full MESSAGE header, see receive_decode().
+
     // // Encrypt and compute the MAC for the packet
     // byte_array epkt = transmit_encode(asio::mutable_buffer(packet.data(), packet.size()));
 
@@ -942,7 +1180,7 @@ channel::transmit(boost::asio::const_buffer packet,
     //                 << epkt.size();
 
     // Ship it out
-    // return send(epkt);
+    // return send(to ? *to : pimpl_->peer_ep_, epkt);
     return false;
 }
 
@@ -983,8 +1221,15 @@ channel::retransmit_timeout(bool failed)
             missed(seq, 1);
             logger::debug() << "Retransmit timeout missed seq " << seq << ", in flight "
                             << pimpl_->state_->tx_inflight_count_;
+            pimpl_->pmtu_.packet_lost(e.size_ + stream_protocol::datagram_overhead);
         }
     }
+
+    // Unacknowledged probe counts as lost, retry or move on to a smaller size.
+    if (pimpl_->pmtu_.probe_in_flight()) {
+        pimpl_->pmtu_.probe_lost();
+        tx_pmtu_probe();
+    }
     if (seqlim == pimpl_->state_->tx_sequence_) {
         assert(pimpl_->state_->tx_inflight_count_ == 0);
         assert(pimpl_->state_->tx_inflight_size_ == 0);
@@ -1104,16 +1349,42 @@ channel::transmit_ack(byte_array& packet, packet_seq_t ackseq, int ack_count)
 {
     logger::debug() << "Channel - transmit_ack seq " << ackseq << ", count " << ack_count + 1;
 
-    // assert(ack_count <= max_ack_count);
-
-    // if (packet.size() < header_len)
-    // packet.resize(header_len);
-
-    // uint32_t ack_word = 0; // make_second_header_word(ack_count, ackseq);
-    // packet_seq_t pktseq;
+    // Report everything the receive mask knows: the largest packet seen and NACK runs
+    // for the holes below it. Packets older than the mask count as received.
+    auto const& state = *pimpl_->state_;
+    uint8_t nacks[mask_bits / 2 * framing::ack_frame_view::nack_size];
+    framing::ack_frame_view ack{};
+    ack.largest_observed_packet = state.rx_sequence_;
+    ack.least_unacked_packet =
+        state.rx_sequence_ >= mask_bits ? state.rx_sequence_ - mask_bits + 1 : 1;
+    ack.nacks = {nacks, sizeof(nacks)};
+
+    packet_seq_t run_start = 0;
+    uint16_t run_length    = 0;
+    auto end_run = [&] {
+        if (run_length == 0) {
+            return;
+        }
+        uint8_t* entry = nacks + ack.missing_packets++ * framing::ack_frame_view::nack_size;
+        for (int i = 0; i < 6; ++i) {
+            entry[i] = uint8_t(run_start >> (8 * (5 - i)));
+        }
+        entry[6]   = uint8_t(run_length >> 8);
+        entry[7]   = uint8_t(run_length);
+        run_length = 0;
+    };
+    // Bit 0 is the largest observed packet itself, always received.
+    for (int bit = state.rx_sequence_ - ack.least_unacked_packet; bit > 0; --bit) {
+        if ((state.rx_mask_ >> bit) & 1) {
+            end_run();
+        } else if (run_length++ == 0) {
+            run_start = state.rx_sequence_ - bit;
+        }
+    }
+    end_run();
 
-    // return transmit(packet, ack_word, pktseq, false);
-    return false;
+    return tx_control_packet(
+        [&ack](framing::frame_writer& writer) { return writer.write_ack(ack); });
 }
 
 void
@@ -1135,21 +1406,205 @@ channel::expire(uint64_t txseq, int npackets)
     logger::debug() << "Channel " << this << " - tx seq " << txseq << " expired";
 }
 
+bool
+channel::channel_receive_frame(framing::frame_view const& frame, packet_seq_t packet_seq)
+{
+    switch (frame.type) {
+        case stream_protocol::frame_type::ACK:
+            logger::debug() << "Channel " << this << " - ACK frame in packet " << packet_seq
+                            << ", largest observed " << frame.ack.largest_observed_packet;
+            rx_ack_frame(frame.ack, packet_seq);
+            return false; // ACK-only frames don't need to be acknowledged.
+        case stream_protocol::frame_type::DECONGESTION:
+        case stream_protocol::frame_type::SETTINGS:
+        case stream_protocol::frame_type::CLOSE:
+            logger::debug() << "Channel " << this << " - control frame in packet " << packet_seq;
+            return true;
+        case stream_protocol::frame_type::PATH_CHALLENGE: {
+            // Answer on the path the challenge came in on, that's the one being validated.
+            uint64_t data = frame.path_challenge.data;
+            tx_control_packet(
+                [data](framing::frame_writer& writer) {
+                    return writer.write_path_response({data});
+                },
+                pimpl_->rx_source_);
+            return true;
+        }
+        case stream_protocol::frame_type::PATH_RESPONSE:
+            if (pimpl_->path_.response(frame.path_response.data)) {
+                migrate_to(pimpl_->path_.candidate());
+            }
+            return true;
+        case stream_protocol::frame_type::PING:
+            return true; // Only asks for an ACK, e.g. of a path MTU probe.
+        default:
+            logger::warning() << "Channel " << this << " - no handler for frame type "
+                              << int(frame.type) << " in packet " << packet_seq;
+            return false;
+    }
+}
+
+void
+channel::rx_ack_frame(framing::ack_frame_view const& ack, packet_seq_t rxackseq)
+{
+    auto& state = *pimpl_->state_;
+    if (ack.largest_observed_packet >= state.tx_sequence_) {
+        logger::warning() << "Channel " << this << " - ACK for packet "
+                          << ack.largest_observed_packet << " we haven't sent yet";
+        return;
+    }
+
+    // Transmit event of packet seq, if still recorded.
+    auto event = [&state](packet_seq_t seq) -> transmit_event_t* {
+        if (seq < state.tx_event_sequence_
+            or seq - state.tx_event_sequence_ >= state.tx_events_.size()) {
+            return nullptr;
+        }
+        return &state.tx_events_[seq - state.tx_event_sequence_];
+    };
+    // Packet is no longer in flight, acked or given up on.
+    auto leave_pipe = [&state](transmit_event_t* e) {
+        if (e and e->pipe_) {
+            e->pipe_ = false;
+            state.tx_inflight_count_--;
+            state.tx_inflight_size_ -= e->size_;
+        }
+    };
+
+    if (ack.largest_observed_packet > state.tx_ack_sequence_) {
+        // Packets about to fall out of the ack mask can't be reported on anymore:
+        // forget their events and expire those never acknowledged.
+        while (not state.tx_events_.empty()
+               and state.tx_event_sequence_ + mask_bits <= ack.largest_observed_packet) {
+            packet_seq_t seq = state.tx_event_sequence_;
+            packet_seq_t bit = state.tx_ack_sequence_ - seq;
+            bool acked       = seq <= state.tx_ack_sequence_ and bit < mask_bits
+                               and ((state.tx_ack_mask_ >> bit) & 1);
+            leave_pipe(&state.tx_events_.front());
+            state.tx_events_.pop_front();
+            state.tx_event_sequence_++;
+            if (not acked) {
+                expire(seq, 1);
+            }
+        }
+
+        packet_seq_t shift     = ack.largest_observed_packet - state.tx_ack_sequence_;
+        state.tx_ack_mask_     = shift < mask_bits ? state.tx_ack_mask_ << shift : 0;
+        state.tx_ack_sequence_ = ack.largest_observed_packet;
+    }
+
+    // Report packets newly acknowledged and those the peer is still missing
+    // miss_threshold_ packets after, the ack mask remembers what was reported already.
+    unsigned new_packets = 0;
+    packet_seq_t low     = max(ack.least_unacked_packet, state.tx_event_sequence_);
+    if (state.tx_ack_sequence_ >= mask_bits) {
+        low = max(low, state.tx_ack_sequence_ - mask_bits + 1);
+    }
+    for (packet_seq_t seq = max(low, packet_seq_t(1)); seq <= ack.largest_observed_packet;
+         ++seq) {
+        packet_seq_t bit = state.tx_ack_sequence_ - seq;
+        if (ack.is_acked(seq)) {
+            if ((state.tx_ack_mask_ >> bit) & 1) {
+                continue;
+            }
+            state.tx_ack_mask_ |= uint64_t(1) << bit;
+            leave_pipe(event(seq));
+            state.mark_acks_++;
+            new_packets++;
+            acknowledged(seq, 1, rxackseq);
+        } else if (ack.largest_observed_packet - seq >= state.miss_threshold_) {
+            auto e = event(seq);
+            if (e and e->pipe_) {
+                leave_pipe(e);
+                if (not pimpl_->nocc_) {
+                    pimpl_->congestion_control->missed(seq);
+                }
+                missed(seq, 1);
+            }
+        }
+    }
+
+    if (new_packets > 0) {
+        pimpl_->cc_and_rtt_update(new_packets, state.tx_ack_sequence_);
+        // Forward progress, give the packets still in flight a full timeout.
+        if (state.tx_inflight_count_ > 0) {
+            start_retransmit_timer();
+        } else {
+            pimpl_->retransmit_timer_.stop();
+        }
+    }
+
+    auto& pmtu = pimpl_->pmtu_;
+    if (pmtu.probe_in_flight() and pmtu.probe_sequence() <= ack.largest_observed_packet) {
+        if (ack.is_acked(pmtu.probe_sequence())) {
+            if (pmtu.probe_acked()) {
+                logger::info() << "Channel " << this << " - path MTU is now " << pmtu.mtu();
+            }
+        } else {
+            pmtu.probe_lost();
+        }
+        tx_pmtu_probe();
+    }
+    if (auto e = event(ack.largest_observed_packet)) {
+        pmtu.packet_acked(e->size_ + stream_protocol::datagram_overhead);
+    }
+    // All packets carry the version until the first ack, so any acked packet was versioned.
+    if (state.tx_send_version_ and state.tx_ack_sequence_ > 0) {
+        logger::debug() << "Channel " << this << " - peer acked versioned packet, "
+                        << "dropping version from packet headers";
+        state.tx_send_version_ = false;
+    }
+}
+
+framing::packet_header_view
+channel::tx_packet_header(packet_seq_t packet_seq) const
+{
+    framing::packet_header_view header{};
+    header.packet_sequence = packet_seq;
+    header.sequence_size =
+        framing::packet_sequence_size(packet_seq, pimpl_->state_->tx_ack_sequence_);
+    if (pimpl_->state_->tx_send_version_) {
+        header.flags |= framing::packet_header_view::version_flag;
+        header.version = stream_protocol::protocol_version;
+    }
+    return header;
+}
+
+channels::compact_message_header
+channel::tx_message_header(packet_seq_t packet_seq) const
+{
+    channels::compact_message_header header;
+    header.connection_id = tx_connection_id_;
+    header.nonce         = packet_seq;
+    header.nonce_size =
+        framing::packet_sequence_size(packet_seq, pimpl_->state_->tx_ack_sequence_);
+    return header;
+}
+
 // Determine the full 64-bit packet sequence number
 packet_seq_t
-channel::derive_packet_seq(packet_seq_t tx_seq)
+channel::derive_packet_seq(uint64_t truncated_seq, uint8_t sequence_size)
 {
-    // kill high 8 bits (channel number)
-    int32_t seqdiff = ((int32_t)(tx_seq << 8) - ((int32_t)pimpl_->state_->rx_sequence_ << 8)) >> 8;
-
-    packet_seq_t pktseq = pimpl_->state_->rx_sequence_ + seqdiff;
+    auto const& state   = *pimpl_->state_;
+    packet_seq_t pktseq = framing::expand_packet_sequence(
+        truncated_seq, sequence_size, state.rx_sequence_);
 
     // Immediately drop too-old or already-received packets
-    static_assert(sizeof(pimpl_->state_->rx_mask_) * 8 == mask_bits, "Invalid RX mask size");
+    static_assert(sizeof(state.rx_mask_) * 8 == mask_bits, "Invalid RX mask size");
 
-    if (seqdiff > 0) {
-        if (pktseq < pimpl_->state_->rx_sequence_) {
-            logger::warning() << "Channel receive - 64-bit wraparound detected!";
+    if (pktseq == 0 or pktseq == max_packet_sequence) {
+        logger::warning() << "Channel receive - invalid packet sequence " << pktseq;
+        return 0;
+    }
+    if (pktseq <= state.rx_sequence_) {
+        packet_seq_t age = state.rx_sequence_ - pktseq;
+        if (age >= mask_bits) {
+            logger::debug() << "Channel receive - packet " << pktseq << " too old, highest "
+                            << state.rx_sequence_;
+            return 0;
+        }
+        if ((state.rx_mask_ >> age) & 1) {
+            logger::debug() << "Channel receive - duplicate packet " << pktseq;
             return 0;
         }
     }
@@ -1172,6 +1627,23 @@ bool
 channel::receive_decode(asio::const_buffer in, byte_array& out)
 {
     try {
+        if (channels::compact_message_header::is_compact(in)) {
+            // Nonce of compact packets is their packet sequence, expand it accordingly.
+            channels::compact_message_header hdr;
+            size_t size = hdr.read(in, pimpl_->state_->rx_sequence_);
+            if (size == 0 or hdr.connection_id != rx_connection_id_) {
+                throw "Bad compact message header";
+            }
+            string nonce = MESSAGE_NONCE_PREFIX;
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                nonce += char(hdr.nonce >> shift);
+            }
+            unboxer<recv_nonce> unseal(remote_key_.get(), local_key_, nonce);
+
+            out = unseal.unbox(as_string(in + size));
+            return true;
+        }
+
         sss::channels::message_packet_header msg;
         in = fusionary::read(msg, in);
 
@@ -1197,7 +1669,10 @@ channel::receive(asio::const_buffer pkt, uia::comm::socket_endpoint const& src)
         logger::warning() << "Channel receive - inactive channel";
         return;
     }
-    if (asio::buffer_size(pkt) < MIN_PACKET_SIZE) {
+    size_t min_size = channels::compact_message_header::is_compact(pkt)
+                          ? channels::compact_message_header::min_size + crypto_box_MACBYTES
+                          : MIN_PACKET_SIZE;
+    if (asio::buffer_size(pkt) < min_size) {
         logger::warning() << "Channel receive - runt packet";
         runt_packet_received(src);
         return;
@@ -1218,16 +1693,59 @@ channel::receive(asio::const_buffer pkt, uia::comm::socket_endpoint const& src)
     // Log decoded packet.
     logger::file_dump(msg, "decoded channel packet");
 
-    sss::framing::packet_header phdr;
-    asio::const_buffer packet_buf(asio::buffer(msg.as_string()));
-    // if (phdr.flags bitand flags::fec) {
+    // Parse the packet in place, frames are delivered as views into msg.
+    sss::framing::frame_parser parser(asio::const_buffer(msg.const_data(), msg.size()));
+    sss::framing::packet_header_view phdr;
+
+    auto status = parser.read_packet_header(phdr);
+    if (status != sss::framing::parse_status::ok) {
+        logger::warning() << "Channel receive - bad packet header: " << to_string(status);
+        runt_packet_received(src);
+        return;
+    }
+    // if (phdr.has_fec_group()) {
     // Insert packet to FEC queue
     // }
-    // else
+
+    if (phdr.has_version() and phdr.version != stream_protocol::protocol_version) {
+        logger::warning() << "Channel receive - unsupported protocol version " << phdr.version;
+        return;
+    }
+
+    packet_seq_t pktseq = derive_packet_seq(phdr.packet_sequence, phdr.sequence_size);
+    if (pktseq == 0) {
+        return;
+    }
+
+    bool needs_ack = false;
     sss::framing::framing_t fr(static_pointer_cast<channel>(shared_from_this()));
-    fr.deframe(packet_buf);
+    pimpl_->rx_source_ = &src;
+    status             = fr.deframe(parser, pktseq, needs_ack);
+    pimpl_->rx_source_ = nullptr;
+    if (status != sss::framing::parse_status::ok) {
+        // @todo Protocol error, close channel?
+        return;
+    }
 
-    // packet_seq_t pktseq = derive_packet_seq(phdr.packet_sequence.value());
+    // Packet is authenticated, so a different source means the peer moved or its NAT
+    // rebound the mapping. Only newer packets may trigger migration, old ones can be replayed.
+    if (pimpl_->peer_ep_ == uia::comm::socket_endpoint()) {
+        pimpl_->peer_ep_ = src;
+    } else if (src != pimpl_->peer_ep_) {
+        rx_new_source(src, pktseq > pimpl_->state_->rx_sequence_);
+    }
+
+    // Truncated sequences of subsequent packets are expanded around this one.
+    auto& state = *pimpl_->state_;
+    if (pktseq > state.rx_sequence_) {
+        packet_seq_t shift = pktseq - state.rx_sequence_;
+        state.rx_mask_     = shift < mask_bits ? (state.rx_mask_ << shift) | 1 : 1;
+        state.rx_sequence_ = pktseq;
+    } else if (state.rx_sequence_ - pktseq < mask_bits) {
+        state.rx_mask_ |= uint64_t(1) << (state.rx_sequence_ - pktseq);
+    }
+
+    acknowledge(pktseq, needs_ack);
 
     // Signal upper layer that we can transmit more, if appropriate
     if (/*new_packets > 0 and*/ may_transmit()) {
@@ -1235,4 +1753,21 @@ channel::receive(asio::const_buffer pkt, uia::comm::socket_endpoint const& src)
     }
 }
 
+//=================================================================================================
+// channel_host_state
+//=================================================================================================
+
+bool
+channel_host_state::receive_compact_message(asio::const_buffer pkt,
+                                            uia::comm::socket_endpoint const& src)
+{
+    channel* ch = channel_for(channels::compact_message_header::peek_connection_id(pkt));
+    if (!ch) {
+        logger::debug() << "Compact message for unknown connection id";
+        return false;
+    }
+    ch->receive(pkt, src);
+    return true;
+}
+
 } // sss namespace
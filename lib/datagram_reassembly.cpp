@@ -0,0 +1,152 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/streams/datagram_reassembly.h"
+#include <algorithm>
+#include <cstring>
+
+namespace sss {
+
+const datagram_reassembly::time_duration datagram_reassembly::default_expiry =
+    boost::posix_time::seconds(2);
+
+datagram_reassembly::datagram_reassembly(size_t memory_limit, time_duration expiry)
+    : memory_limit_(memory_limit)
+    , expiry_(expiry)
+{
+}
+
+void
+datagram_reassembly::set_memory_limit(size_t limit)
+{
+    memory_limit_ = limit;
+    make_room(0, nullptr);
+}
+
+void
+datagram_reassembly::drop(std::map<uint32_t, partial_datagram>::iterator it)
+{
+    used_ -= it->second.data.size();
+    partial_.erase(it);
+    ++dropped_;
+}
+
+bool
+datagram_reassembly::make_room(size_t size, partial_datagram const* keep)
+{
+    while (used_ + size > memory_limit_) {
+        auto oldest = partial_.end();
+        for (auto it = partial_.begin(); it != partial_.end(); ++it) {
+            if (&it->second != keep
+                and (oldest == partial_.end() or it->second.started < oldest->second.started)) {
+                oldest = it;
+            }
+        }
+        if (oldest == partial_.end()) {
+            return false;
+        }
+        drop(oldest);
+    }
+    return true;
+}
+
+bool
+datagram_reassembly::add(uint32_t id,
+                         size_t offset,
+                         boost::asio::const_buffer fragment,
+                         bool end,
+                         ptime now,
+                         std::vector<uint8_t>& datagram)
+{
+    size_t size = boost::asio::buffer_size(fragment);
+
+    // Offset comes from the peer, a fragment reaching past the memory limit can't fit anyway
+    // and checking it here keeps offset + size from wrapping around.
+    if (offset > memory_limit_ or size > memory_limit_ - offset) {
+        auto it = partial_.find(id);
+        if (it != partial_.end()) {
+            drop(it);
+        } else {
+            ++dropped_;
+        }
+        return false;
+    }
+
+    size_t frag_end      = offset + size;
+    auto ins             = partial_.insert({id, partial_datagram()});
+    partial_datagram& dg = ins.first->second;
+    if (ins.second) {
+        dg.started = now;
+    }
+
+    // Fragments must agree on where the datagram ends.
+    if ((dg.end_seen and frag_end > dg.end) or (end and frag_end < dg.data.size())) {
+        drop(ins.first);
+        return false;
+    }
+    if (end) {
+        dg.end_seen = true;
+        dg.end      = frag_end;
+    }
+
+    // Grow the buffer to hold this fragment, evicting older datagrams if needed.
+    if (frag_end > dg.data.size()) {
+        size_t growth = frag_end - dg.data.size();
+        if (not make_room(growth, &dg)) {
+            drop(ins.first);
+            return false;
+        }
+        dg.data.resize(frag_end);
+        used_ += growth;
+    }
+    memcpy(dg.data.data() + offset, boost::asio::buffer_cast<uint8_t const*>(fragment), size);
+    dg.received.add(offset, frag_end);
+
+    if (not dg.end_seen or dg.received.total_size() < dg.end) {
+        return false;
+    }
+
+    used_ -= dg.data.size();
+    datagram.swap(dg.data);
+    partial_.erase(ins.first);
+    return true;
+}
+
+size_t
+datagram_reassembly::expire(ptime now)
+{
+    size_t count = 0;
+    for (auto it = partial_.begin(); it != partial_.end();) {
+        if (now - it->second.started >= expiry_) {
+            drop(it++);
+            ++count;
+        } else {
+            ++it;
+        }
+    }
+    return count;
+}
+
+datagram_reassembly::ptime
+datagram_reassembly::next_expiry() const
+{
+    auto oldest = std::min_element(
+        partial_.begin(), partial_.end(), [](auto const& a, auto const& b) {
+            return a.second.started < b.second.started;
+        });
+    return oldest->second.started + expiry_;
+}
+
+void
+datagram_reassembly::clear()
+{
+    partial_.clear();
+    used_ = 0;
+}
+
+} // sss namespace
@@ -54,7 +54,35 @@ byte_array datagram_stream::read_record(ssize_t max_size)
 ssize_t datagram_stream::read_data(char* data, ssize_t max_size)
 {
     ssize_t actual_size = min(remain(), max_size);
-    memcpy(data, payload_.const_data() + pos_, actual_size);
+    if (data != nullptr) {
+        memcpy(data, payload_.const_data() + pos_, actual_size);
+    }
+    pos_ += actual_size;
+    return actual_size;
+}
+
+ssize_t datagram_stream::read_data(std::vector<boost::asio::mutable_buffer> const& buffers)
+{
+    ssize_t actual_size = 0;
+    for (auto const& buf : buffers) {
+        actual_size += datagram_stream::read_data(boost::asio::buffer_cast<char*>(buf),
+                                                  boost::asio::buffer_size(buf));
+    }
+    return actual_size;
+}
+
+std::vector<boost::asio::const_buffer> datagram_stream::peek_data(ssize_t max_size)
+{
+    ssize_t size = min(remain(), max_size);
+    if (size <= 0) {
+        return {};
+    }
+    return {boost::asio::const_buffer(payload_.const_data() + pos_, size)};
+}
+
+ssize_t datagram_stream::consume_data(ssize_t size)
+{
+    ssize_t actual_size = min(remain(), size);
     pos_ += actual_size;
     return actual_size;
 }
@@ -65,7 +93,17 @@ ssize_t datagram_stream::write_data(const char* data, ssize_t size, uint8_t endf
     return -1;
 }
 
-shared_ptr<abstract_stream> datagram_stream::open_substream()
+ssize_t datagram_stream::write_data(boost::asio::const_buffer data,
+                                    std::shared_ptr<void const> owner,
+                                    uint8_t endflags,
+                                    boost::posix_time::ptime deadline)
+{
+    set_error("Can't write to ephemeral datagram-streams");
+    return -1;
+}
+
+shared_ptr<abstract_stream> datagram_stream::open_substream(stream::reliability,
+                                                            boost::posix_time::time_duration)
 {
     set_error("Ephemeral datagram-streams cannot have substreams");
     return nullptr;
@@ -89,7 +127,10 @@ byte_array datagram_stream::read_datagram(ssize_t max_size)
     return byte_array();
 }
 
-ssize_t datagram_stream::write_datagram(const char* data, ssize_t size, stream::datagram_type is_reliable)
+ssize_t datagram_stream::write_datagram(const char* data,
+                                        ssize_t size,
+                                        stream::datagram_type is_reliable,
+                                        boost::posix_time::ptime deadline)
 {
     set_error("Ephemeral datagram-streams cannot have sub-datagrams");
     return -1;
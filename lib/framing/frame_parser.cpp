@@ -0,0 +1,476 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/framing/frame_parser.h"
+#include "arsenal/underlying.h"
+
+using namespace boost::asio;
+
+namespace sss {
+namespace framing {
+
+constexpr uint8_t packet_header_view::version_flag;
+constexpr uint8_t packet_header_view::fec_flag;
+constexpr uint8_t packet_header_view::seq_size_mask;
+constexpr uint8_t packet_header_view::seq_size_shift;
+constexpr uint8_t packet_header_view::fec_last_flag;
+constexpr uint8_t stream_frame_view::fin_flag;
+constexpr uint8_t stream_frame_view::data_length_flag;
+constexpr uint8_t stream_frame_view::offset_size_mask;
+constexpr uint8_t stream_frame_view::offset_size_shift;
+constexpr uint8_t stream_frame_view::usid_flag;
+constexpr uint8_t stream_frame_view::init_flag;
+constexpr uint8_t stream_frame_view::no_retransmit_flag;
+constexpr size_t stream_frame_view::usid_size;
+constexpr size_t ack_frame_view::nack_size;
+
+namespace {
+
+/// Packet sequence sizes indexed by ss bits.
+constexpr uint8_t sequence_sizes[4] = {2, 4, 6, 8};
+/// Stream offset sizes indexed by ooo bits.
+constexpr uint8_t offset_sizes[8] = {0, 2, 3, 4, 5, 6, 7, 8};
+
+/// Decongestion subtypes with known contents size (spec 4.2.6).
+constexpr uint8_t decongestion_none    = 0;
+constexpr uint8_t decongestion_tcp     = 1;
+constexpr uint8_t decongestion_chicago = 2;
+
+/// Settings tags (spec 4.2.10).
+constexpr uint16_t setting_fec = 1;
+constexpr uint16_t setting_cc  = 2;
+
+inline uint64_t
+load_big(uint8_t const* p, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+/**
+ * Bounds-checked cursor over a part of the packet.
+ * All reads fail softly by setting the error flag instead of throwing.
+ */
+class cursor
+{
+    uint8_t const* pos_;
+    uint8_t const* end_;
+    bool failed_{false};
+
+public:
+    cursor(uint8_t const* pos, uint8_t const* end)
+        : pos_(pos)
+        , end_(end)
+    {
+    }
+
+    inline uint8_t const* position() const { return pos_; }
+    inline size_t remaining() const { return end_ - pos_; }
+    inline bool failed() const { return failed_; }
+
+    inline uint8_t const* skip(size_t size)
+    {
+        if (failed_ or remaining() < size) {
+            failed_ = true;
+            return nullptr;
+        }
+        uint8_t const* p = pos_;
+        pos_ += size;
+        return p;
+    }
+
+    inline uint64_t big(size_t size)
+    {
+        uint8_t const* p = skip(size);
+        return p ? load_big(p, size) : 0;
+    }
+
+    inline byte_range range(size_t size)
+    {
+        uint8_t const* p = skip(size);
+        return {p, p ? size : 0};
+    }
+};
+
+} // anonymous namespace
+
+char const*
+to_string(parse_status status)
+{
+    switch (status) {
+        case parse_status::ok: return "ok";
+        case parse_status::end_of_packet: return "end of packet";
+        case parse_status::truncated: return "truncated frame";
+        case parse_status::unknown_frame_type: return "unknown frame type";
+        case parse_status::invalid: return "invalid frame";
+    }
+    return "unknown";
+}
+
+uint64_t
+ack_frame_view::nack_sequence(size_t i) const
+{
+    return load_big(nacks.data + i * nack_size, 6);
+}
+
+uint16_t
+ack_frame_view::nack_run_length(size_t i) const
+{
+    return load_big(nacks.data + i * nack_size + 6, 2);
+}
+
+bool
+ack_frame_view::is_acked(uint64_t packet_seq) const
+{
+    if (packet_seq > largest_observed_packet) {
+        return false;
+    }
+    uint64_t low_bits = packet_seq & 0xffffffffffffULL;
+    for (size_t i = 0; i < missing_packets; ++i) {
+        uint64_t first = nack_sequence(i);
+        if (low_bits >= first and low_bits - first < nack_run_length(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+frame_parser::frame_parser(const_buffer packet)
+    : begin_(buffer_cast<uint8_t const*>(packet))
+    , pos_(begin_)
+    , end_(begin_ + buffer_size(packet))
+{
+}
+
+parse_status
+frame_parser::read_packet_header(packet_header_view& header)
+{
+    cursor in(pos_, end_);
+    header.flags = in.big(1);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    if (header.flags & 0xe0) {
+        return parse_status::invalid; // Reserved bits must be zero.
+    }
+    if ((header.flags & packet_header_view::fec_last_flag) and not header.has_fec_group()) {
+        return parse_status::invalid;
+    }
+    header.version   = header.has_version() ? in.big(2) : 0;
+    header.fec_group = header.has_fec_group() ? in.big(1) : 0;
+    header.sequence_size =
+        sequence_sizes[(header.flags & packet_header_view::seq_size_mask)
+                       >> packet_header_view::seq_size_shift];
+    header.packet_sequence = in.big(header.sequence_size);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::next(frame_view& frame)
+{
+    if (pos_ == end_) {
+        return parse_status::end_of_packet;
+    }
+
+    uint8_t type = *pos_;
+    if (type > to_underlying(stream_protocol::frame_type::STREAM_DATA_BLOCKED)) {
+        return parse_status::unknown_frame_type;
+    }
+
+    uint8_t const* frame_start = pos_;
+    ++pos_;
+
+    parse_status status = parse_status::ok;
+    frame.type          = stream_protocol::frame_type(type);
+
+    switch (frame.type) {
+        case stream_protocol::frame_type::EMPTY: break;
+        case stream_protocol::frame_type::PING: break;
+        case stream_protocol::frame_type::STREAM: status = read_stream(frame.stream); break;
+        case stream_protocol::frame_type::ACK: status = read_ack(frame.ack); break;
+        case stream_protocol::frame_type::PADDING: status = read_padding(frame.padding); break;
+        case stream_protocol::frame_type::DECONGESTION:
+            status = read_decongestion(frame.decongestion);
+            break;
+        case stream_protocol::frame_type::DETACH: status = read_detach(frame.detach); break;
+        case stream_protocol::frame_type::RESET: status = read_reset(frame.reset); break;
+        case stream_protocol::frame_type::CLOSE: status = read_close(frame.close); break;
+        case stream_protocol::frame_type::SETTINGS: status = read_settings(frame.settings); break;
+        case stream_protocol::frame_type::PRIORITY: status = read_priority(frame.priority); break;
+        case stream_protocol::frame_type::MAX_DATA: status = read_max_data(frame.max_data); break;
+        case stream_protocol::frame_type::DATA_BLOCKED:
+            status = read_data_blocked(frame.data_blocked);
+            break;
+        case stream_protocol::frame_type::PATH_CHALLENGE:
+            status = read_path_data(frame.path_challenge.data);
+            break;
+        case stream_protocol::frame_type::PATH_RESPONSE:
+            status = read_path_data(frame.path_response.data);
+            break;
+        case stream_protocol::frame_type::MAX_STREAM_DATA:
+            status = read_stream_limit(frame.max_stream_data.lsid,
+                                       frame.max_stream_data.maximum_stream_data);
+            break;
+        case stream_protocol::frame_type::STREAM_DATA_BLOCKED:
+            status = read_stream_limit(frame.stream_data_blocked.lsid,
+                                       frame.stream_data_blocked.data_limit);
+            break;
+    }
+
+    if (status != parse_status::ok) {
+        pos_ = frame_start;
+        return status;
+    }
+
+    frame.raw = {frame_start, size_t(pos_ - frame_start)};
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_stream(stream_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.flags            = in.big(1);
+    frame.stream_id        = in.big(4);
+    frame.parent_stream_id = frame.is_init() ? in.big(4) : 0;
+    frame.usid             = nullptr;
+    if (frame.has_usid()) {
+        if (not frame.is_init()) {
+            return parse_status::invalid; // USID is only allowed in INIT frames.
+        }
+        frame.usid = in.skip(stream_frame_view::usid_size);
+    } else if (frame.is_join()) {
+        return parse_status::invalid; // Stream joining a path is found by its USID.
+    }
+    frame.parent_usid = nullptr;
+    if (frame.has_parent_usid()) {
+        frame.parent_usid = in.skip(stream_frame_view::usid_size);
+    }
+    frame.stream_offset = in.big(offset_sizes[(frame.flags & stream_frame_view::offset_size_mask)
+                                              >> stream_frame_view::offset_size_shift]);
+    if (frame.flags & stream_frame_view::data_length_flag) {
+        size_t length = in.big(2);
+        frame.data    = in.range(length);
+    } else {
+        // Data extends until the end of this packet.
+        frame.data = in.range(in.remaining());
+    }
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    if (frame.data.empty() and not frame.is_fin() and not frame.is_skip()) {
+        return parse_status::invalid;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_ack(ack_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.sent_entropy                = in.big(1);
+    frame.received_entropy            = in.big(1);
+    frame.missing_packets             = in.big(1);
+    frame.least_unacked_packet        = in.big(8);
+    frame.largest_observed_packet     = in.big(8);
+    frame.largest_observed_delta_time = in.big(4);
+    frame.nacks = in.range(size_t(frame.missing_packets) * ack_frame_view::nack_size);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    if (frame.least_unacked_packet > frame.largest_observed_packet + 1) {
+        return parse_status::invalid;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_padding(padding_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    size_t length = in.big(2);
+    frame.padding = in.range(length);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_decongestion(decongestion_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.subtype = in.big(1);
+    switch (frame.subtype) {
+        case decongestion_none: frame.data = in.range(0); break;
+        case decongestion_tcp: frame.data = in.range(2 + 2); break;
+        case decongestion_chicago: frame.data = in.range(4 * 4); break;
+        default: return in.failed() ? parse_status::truncated : parse_status::invalid;
+    }
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_detach(detach_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.lsid = in.big(4);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_reset(reset_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.lsid          = in.big(4);
+    frame.error_code    = in.big(4);
+    size_t length       = in.big(2);
+    frame.reason_phrase = in.range(length);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_close(close_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.error_code    = in.big(4);
+    size_t length       = in.big(2);
+    frame.reason_phrase = in.range(length);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    // Final ACK is a complete ACK frame, including its type byte.
+    if (in.big(1) != to_underlying(stream_protocol::frame_type::ACK)) {
+        return in.failed() ? parse_status::truncated : parse_status::invalid;
+    }
+    pos_ = in.position();
+    return read_ack(frame.final_ack);
+}
+
+parse_status
+frame_parser::read_settings(settings_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.number_of_settings = in.big(2);
+    uint8_t const* settings  = in.position();
+    uint16_t previous_tag    = 0;
+    for (uint16_t i = 0; i < frame.number_of_settings and not in.failed(); ++i) {
+        uint16_t tag = in.big(2);
+        if (in.failed()) {
+            break;
+        }
+        // Tags must be sorted in the order of increasing tag number, no duplicates.
+        if (tag <= previous_tag) {
+            return parse_status::invalid;
+        }
+        previous_tag = tag;
+        switch (tag) {
+            case setting_fec: in.skip(1); break;
+            case setting_cc: in.skip(2); break;
+            default: return parse_status::invalid;
+        }
+    }
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    frame.settings = {settings, size_t(in.position() - settings)};
+    pos_           = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_priority(priority_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.lsid           = in.big(4);
+    frame.priority_value = in.big(4);
+    frame.parent_lsid    = in.big(4);
+    frame.weight         = in.big(2);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    if (frame.weight == 0) {
+        return parse_status::invalid;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_max_data(max_data_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.maximum_data = in.big(8);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_data_blocked(data_blocked_frame_view& frame)
+{
+    cursor in(pos_, end_);
+    frame.data_limit = in.big(8);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_path_data(uint64_t& data)
+{
+    cursor in(pos_, end_);
+    data = in.big(8);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+parse_status
+frame_parser::read_stream_limit(uint32_t& lsid, uint64_t& limit)
+{
+    cursor in(pos_, end_);
+    lsid  = in.big(4);
+    limit = in.big(8);
+    if (in.failed()) {
+        return parse_status::truncated;
+    }
+    pos_ = in.position();
+    return parse_status::ok;
+}
+
+} // framing namespace
+} // sss namespace
@@ -0,0 +1,380 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/framing/frame_writer.h"
+#include "arsenal/underlying.h"
+#include <cassert>
+#include <cstring>
+
+using namespace boost::asio;
+
+namespace sss {
+namespace framing {
+
+constexpr size_t frame_writer::min_padding_size;
+constexpr size_t frame_writer::max_packet_header_size;
+
+namespace {
+
+constexpr uint8_t offset_sizes[8] = {0, 2, 3, 4, 5, 6, 7, 8};
+
+/// Packet sequence size in bytes to ss bits.
+inline int
+sequence_size_code(uint8_t size)
+{
+    switch (size) {
+        case 2: return 0;
+        case 4: return 1;
+        case 6: return 2;
+        case 8: return 3;
+        default: return -1;
+    }
+}
+
+inline uint8_t
+type_byte(stream_protocol::frame_type type)
+{
+    return to_underlying(type);
+}
+
+} // anonymous namespace
+
+uint8_t
+stream_offset_size_code(uint64_t offset)
+{
+    if (offset == 0) {
+        return 0;
+    }
+    for (uint8_t code = 1; code < 7; ++code) {
+        if (offset < (1ULL << (offset_sizes[code] * 8))) {
+            return code;
+        }
+    }
+    return 7;
+}
+
+uint8_t
+stream_offset_size(uint8_t code)
+{
+    return offset_sizes[code & 7];
+}
+
+frame_writer::frame_writer(mutable_buffer packet)
+    : begin_(buffer_cast<uint8_t*>(packet))
+    , pos_(begin_)
+    , end_(begin_ + buffer_size(packet))
+{
+}
+
+frame_writer::frame_writer(mutable_buffer packet, size_t written)
+    : frame_writer(packet)
+{
+    assert(written <= remaining());
+    pos_ += written;
+}
+
+void
+frame_writer::put(uint64_t value, size_t size)
+{
+    for (size_t i = size; i > 0; --i) {
+        *pos_++ = uint8_t(value >> ((i - 1) * 8));
+    }
+}
+
+void
+frame_writer::put(byte_range range)
+{
+    if (range.size) {
+        memcpy(pos_, range.data, range.size);
+        pos_ += range.size;
+    }
+}
+
+size_t
+frame_writer::packet_header_size(packet_header_view const& header)
+{
+    return 1 + (header.has_version() ? 2 : 0) + (header.has_fec_group() ? 1 : 0)
+           + header.sequence_size;
+}
+
+bool
+frame_writer::write_packet_header(packet_header_view const& header)
+{
+    int ss = sequence_size_code(header.sequence_size);
+    if (ss < 0 or remaining() < packet_header_size(header)) {
+        return false;
+    }
+    uint8_t flags = (header.flags & ~packet_header_view::seq_size_mask)
+                    | (ss << packet_header_view::seq_size_shift);
+    put(flags, 1);
+    if (header.has_version()) {
+        put(header.version, 2);
+    }
+    if (header.has_fec_group()) {
+        put(header.fec_group, 1);
+    }
+    put(header.packet_sequence, header.sequence_size);
+    return true;
+}
+
+size_t
+frame_writer::stream_header_size(stream_frame_view const& frame, bool last)
+{
+    return 1 + 1 + 4 + (frame.is_init() ? 4 : 0)
+           + (frame.has_usid() ? stream_frame_view::usid_size : 0)
+           + (frame.has_parent_usid() ? stream_frame_view::usid_size : 0)
+           + stream_offset_size(stream_offset_size_code(frame.stream_offset)) + (last ? 0 : 2);
+}
+
+bool
+frame_writer::write_stream(stream_frame_view const& frame, bool last)
+{
+    if (remaining() < stream_header_size(frame, last) + frame.data.size
+        or frame.data.size > 0xffff) {
+        return false;
+    }
+    uint8_t code  = stream_offset_size_code(frame.stream_offset);
+    uint8_t flags = frame.flags
+                    & ~(stream_frame_view::offset_size_mask | stream_frame_view::data_length_flag);
+    flags |= code << stream_frame_view::offset_size_shift;
+    if (not last) {
+        flags |= stream_frame_view::data_length_flag;
+    }
+
+    put(type_byte(stream_protocol::frame_type::STREAM), 1);
+    put(flags, 1);
+    put(frame.stream_id, 4);
+    if (frame.is_init()) {
+        put(frame.parent_stream_id, 4);
+    }
+    if (frame.has_usid()) {
+        put({frame.usid, stream_frame_view::usid_size});
+    }
+    if (frame.has_parent_usid()) {
+        put({frame.parent_usid, stream_frame_view::usid_size});
+    }
+    put(frame.stream_offset, stream_offset_size(code));
+    if (not last) {
+        put(frame.data.size, 2);
+    }
+    put(frame.data);
+    return true;
+}
+
+size_t
+frame_writer::ack_frame_size(ack_frame_view const& frame)
+{
+    return 1 + 1 + 1 + 1 + 8 + 8 + 4 + frame.missing_packets * ack_frame_view::nack_size;
+}
+
+void
+frame_writer::put_ack_body(ack_frame_view const& frame)
+{
+    put(type_byte(stream_protocol::frame_type::ACK), 1);
+    put(frame.sent_entropy, 1);
+    put(frame.received_entropy, 1);
+    put(frame.missing_packets, 1);
+    put(frame.least_unacked_packet, 8);
+    put(frame.largest_observed_packet, 8);
+    put(frame.largest_observed_delta_time, 4);
+    put({frame.nacks.data, frame.missing_packets * ack_frame_view::nack_size});
+}
+
+bool
+frame_writer::write_ack(ack_frame_view const& frame)
+{
+    if (remaining() < ack_frame_size(frame)
+        or frame.nacks.size < frame.missing_packets * ack_frame_view::nack_size) {
+        return false;
+    }
+    put_ack_body(frame);
+    return true;
+}
+
+bool
+frame_writer::write_padding(size_t frame_size)
+{
+    if (frame_size < min_padding_size or frame_size - min_padding_size > 0xffff
+        or remaining() < frame_size) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::PADDING), 1);
+    put(frame_size - min_padding_size, 2);
+    memset(pos_, 0, frame_size - min_padding_size);
+    pos_ += frame_size - min_padding_size;
+    return true;
+}
+
+bool
+frame_writer::write_empty()
+{
+    if (remaining() < 1) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::EMPTY), 1);
+    return true;
+}
+
+bool
+frame_writer::write_decongestion(decongestion_frame_view const& frame)
+{
+    if (remaining() < 2 + frame.data.size) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::DECONGESTION), 1);
+    put(frame.subtype, 1);
+    put(frame.data);
+    return true;
+}
+
+bool
+frame_writer::write_detach(detach_frame_view const& frame)
+{
+    if (remaining() < 5) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::DETACH), 1);
+    put(frame.lsid, 4);
+    return true;
+}
+
+bool
+frame_writer::write_reset(reset_frame_view const& frame)
+{
+    if (remaining() < 11 + frame.reason_phrase.size or frame.reason_phrase.size > 0xffff) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::RESET), 1);
+    put(frame.lsid, 4);
+    put(frame.error_code, 4);
+    put(frame.reason_phrase.size, 2);
+    put(frame.reason_phrase);
+    return true;
+}
+
+bool
+frame_writer::write_close(close_frame_view const& frame)
+{
+    if (remaining() < 7 + frame.reason_phrase.size + ack_frame_size(frame.final_ack)
+        or frame.reason_phrase.size > 0xffff) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::CLOSE), 1);
+    put(frame.error_code, 4);
+    put(frame.reason_phrase.size, 2);
+    put(frame.reason_phrase);
+    put_ack_body(frame.final_ack);
+    return true;
+}
+
+bool
+frame_writer::write_settings(settings_frame_view const& frame)
+{
+    if (remaining() < 3 + frame.settings.size) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::SETTINGS), 1);
+    put(frame.number_of_settings, 2);
+    put(frame.settings);
+    return true;
+}
+
+bool
+frame_writer::write_priority(priority_frame_view const& frame)
+{
+    if (remaining() < 15) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::PRIORITY), 1);
+    put(frame.lsid, 4);
+    put(frame.priority_value, 4);
+    put(frame.parent_lsid, 4);
+    put(frame.weight, 2);
+    return true;
+}
+
+bool
+frame_writer::write_max_data(max_data_frame_view const& frame)
+{
+    if (remaining() < 9) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::MAX_DATA), 1);
+    put(frame.maximum_data, 8);
+    return true;
+}
+
+bool
+frame_writer::write_data_blocked(data_blocked_frame_view const& frame)
+{
+    if (remaining() < 9) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::DATA_BLOCKED), 1);
+    put(frame.data_limit, 8);
+    return true;
+}
+
+bool
+frame_writer::write_path_challenge(path_challenge_frame_view const& frame)
+{
+    if (remaining() < 9) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::PATH_CHALLENGE), 1);
+    put(frame.data, 8);
+    return true;
+}
+
+bool
+frame_writer::write_path_response(path_response_frame_view const& frame)
+{
+    if (remaining() < 9) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::PATH_RESPONSE), 1);
+    put(frame.data, 8);
+    return true;
+}
+
+bool
+frame_writer::write_ping()
+{
+    if (remaining() < 1) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::PING), 1);
+    return true;
+}
+
+bool
+frame_writer::write_max_stream_data(max_stream_data_frame_view const& frame)
+{
+    if (remaining() < 13) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::MAX_STREAM_DATA), 1);
+    put(frame.lsid, 4);
+    put(frame.maximum_stream_data, 8);
+    return true;
+}
+
+bool
+frame_writer::write_stream_data_blocked(stream_data_blocked_frame_view const& frame)
+{
+    if (remaining() < 13) {
+        return false;
+    }
+    put(type_byte(stream_protocol::frame_type::STREAM_DATA_BLOCKED), 1);
+    put(frame.lsid, 4);
+    put(frame.data_limit, 8);
+    return true;
+}
+
+} // framing namespace
+} // sss namespace
@@ -11,67 +11,14 @@
 #include "sss/framing/reset_frame.h"
 #include "sss/framing/settings_frame.h"
 #include "sss/framing/stream_frame.h"
+#include "sss/channels/channel.h"
+#include "arsenal/logging.h"
 
 using namespace boost::asio;
 
 namespace sss {
 namespace framing {
 
-namespace {
-
-template <typename T>
-class has_dispatch
-{
-    template <typename U>
-    static char
-    check(decltype(static_cast<U*>(nullptr)->dispatch(static_cast<channel_ptr>(nullptr)))*);
-
-    template <typename U>
-    static int check(...);
-
-public:
-    static constexpr bool value = (sizeof(check<T>(nullptr)) == sizeof(char));
-};
-
-template <typename T, bool c>
-struct dispatch_caller__
-{
-public:
-    static void call(T&, channel_ptr) {}
-};
-
-template <typename T>
-struct dispatch_caller__<T, true>
-{
-public:
-    static void call(T& o, channel_ptr c) { o.dispatch(c); }
-};
-
-template <typename T>
-using dispatch_caller = dispatch_caller__<T, has_dispatch<T>::value>;
-}
-
-template <typename T>
-void
-framing_t::read_handler(const_buffer input)
-{
-    T frame;
-    frame.read(input);
-    dispatch_caller<T>::call(frame, channel_);
-}
-
-std::array<framing_t::read_handler_type, max_frame_count_t::value> framing_t::handlers_ = {
-    {&framing_t::read_handler<empty_frame_t>,
-     &framing_t::read_handler<stream_frame_t>,
-     &framing_t::read_handler<ack_frame_t>,
-     &framing_t::read_handler<padding_frame_t>,
-     &framing_t::read_handler<decongestion_frame_t>,
-     &framing_t::read_handler<detach_frame_t>,
-     &framing_t::read_handler<reset_frame_t>,
-     &framing_t::read_handler<close_frame_t>,
-     &framing_t::read_handler<settings_frame_t>,
-     &framing_t::read_handler<priority_frame_t>}};
-
 framing_t::framing_t(channel_ptr c)
     : channel_{c}
 {
@@ -91,16 +38,33 @@ framing_t::enframe(mutable_buffer output)
     */
 }
 
-// Read packet frames and deliver decoded frames to appropriate handlers.
-void
-framing_t::deframe(const_buffer input)
+// Read packet frames and deliver decoded frame views to the channel.
+parse_status
+framing_t::deframe(frame_parser& parser, packet_seq_t packet_seq, bool& needs_ack)
 {
-    while (buffer_size(input) > 0) {
-        uint8_t frame_type = *buffer_cast<const uint8_t*>(input);
-        if (frame_type >= max_frame_count_t::value)
-            throw "Invalid frame type";
-        (this->*handlers_[frame_type])(input);
+    frame_view frame;
+    parse_status status;
+
+    while ((status = parser.next(frame)) == parse_status::ok) {
+        switch (frame.type) {
+            case stream_protocol::frame_type::EMPTY:
+            case stream_protocol::frame_type::PADDING:
+                // Nothing to deliver, padding contents are simply skipped.
+                break;
+            default:
+                if (channel_->channel_receive_frame(frame, packet_seq)) {
+                    needs_ack = true;
+                }
+                break;
+        }
+    }
+
+    if (status != parse_status::end_of_packet) {
+        logger::warning() << "Deframing packet " << packet_seq << " failed at offset "
+                          << parser.offset() << ": " << to_string(status);
+        return status;
     }
+    return parse_status::ok;
 }
 
 } // framing namespace
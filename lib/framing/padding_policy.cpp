@@ -0,0 +1,76 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/framing/padding_policy.h"
+#include <algorithm>
+
+namespace sss {
+namespace framing {
+
+constexpr size_t padding_policy::granularity;
+
+namespace {
+
+inline size_t
+round_up(size_t size)
+{
+    return (size + padding_policy::granularity - 1) / padding_policy::granularity
+           * padding_policy::granularity;
+}
+
+} // anonymous namespace
+
+size_t
+padding_policy::padded_size(size_t size, size_t max_size) const
+{
+    size_t target = size;
+    switch (mode_) {
+        case mode::none:
+            break;
+        case mode::multiple_16:
+            target = round_up(size);
+            break;
+        case mode::buckets: {
+            auto it = std::lower_bound(buckets_.begin(), buckets_.end(), size);
+            target  = it == buckets_.end() ? max_size : *it;
+            target  = round_up(target);
+            break;
+        }
+        case mode::full:
+            target = max_size;
+            break;
+    }
+    return std::max(size, std::min(target, max_size));
+}
+
+size_t
+padding_policy::pad(frame_writer& writer)
+{
+    size_t size   = writer.size();
+    size_t target = padded_size(size, size + writer.remaining());
+    size_t amount = target - size;
+
+    if (amount >= frame_writer::min_padding_size) {
+        writer.write_padding(amount);
+    } else {
+        for (size_t i = 0; i < amount; ++i) {
+            writer.write_empty();
+        }
+    }
+
+    counters_.packets += 1;
+    counters_.payload_bytes += size;
+    if (amount > 0) {
+        counters_.padded_packets += 1;
+        counters_.padding_bytes += amount;
+    }
+    return amount;
+}
+
+} // framing namespace
+} // sss namespace
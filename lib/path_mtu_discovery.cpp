@@ -0,0 +1,147 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/channels/path_mtu_discovery.h"
+#include "arsenal/logging.h"
+
+namespace sss {
+namespace channels {
+
+constexpr size_t path_mtu_discovery::base_mtu;
+constexpr int path_mtu_discovery::max_probes;
+constexpr int path_mtu_discovery::black_hole_threshold;
+constexpr size_t path_mtu_discovery::search_granularity;
+
+namespace {
+
+inline size_t
+align_down(size_t size)
+{
+    return size - size % path_mtu_discovery::search_granularity;
+}
+
+} // anonymous namespace
+
+path_mtu_discovery::path_mtu_discovery(size_t max_mtu)
+    : max_mtu_(max_mtu < base_mtu ? base_mtu : max_mtu)
+    , search_high_(align_down(max_mtu_))
+{
+    check_complete();
+}
+
+void
+path_mtu_discovery::set_max_mtu(size_t max_mtu)
+{
+    max_mtu_ = max_mtu < base_mtu ? base_mtu : max_mtu;
+    if (mtu_ > max_mtu_) {
+        mtu_ = base_mtu;
+    }
+    restart();
+}
+
+size_t
+path_mtu_discovery::next_probe_size() const
+{
+    if (state_ != state::searching or probe_in_flight()) {
+        return 0;
+    }
+    // Optimistically try the upper limit first, bisect after it fails.
+    if (search_high_ == align_down(max_mtu_)) {
+        return search_high_;
+    }
+    size_t size = align_down(mtu_ + (search_high_ - mtu_) / 2);
+    return size > mtu_ ? size : mtu_ + search_granularity;
+}
+
+void
+path_mtu_discovery::probe_sent(packet_seq_t packet_seq, size_t size)
+{
+    probe_seq_  = packet_seq;
+    probe_size_ = size;
+}
+
+bool
+path_mtu_discovery::probe_acked()
+{
+    if (not probe_in_flight()) {
+        return false;
+    }
+    logger::debug() << "PMTU probe of " << probe_size_ << " bytes acknowledged";
+    mtu_          = probe_size_;
+    probe_size_   = 0;
+    probe_count_  = 0;
+    large_losses_ = 0;
+    check_complete();
+    return true;
+}
+
+void
+path_mtu_discovery::probe_lost()
+{
+    if (not probe_in_flight()) {
+        return;
+    }
+    if (++probe_count_ >= max_probes) {
+        logger::debug() << "PMTU probe of " << probe_size_ << " bytes failed";
+        search_high_ = probe_size_ - search_granularity;
+        probe_count_ = 0;
+        check_complete();
+    }
+    probe_size_ = 0;
+}
+
+void
+path_mtu_discovery::packet_acked(size_t size)
+{
+    if (size > base_mtu) {
+        large_losses_ = 0;
+    }
+}
+
+bool
+path_mtu_discovery::packet_lost(size_t size)
+{
+    if (size <= base_mtu or mtu_ == base_mtu) {
+        return false;
+    }
+    if (++large_losses_ < black_hole_threshold) {
+        return false;
+    }
+    logger::warning() << "PMTU black hole detected at " << mtu_ << " bytes, falling back to "
+                      << base_mtu;
+    state_        = state::black_hole;
+    mtu_          = base_mtu;
+    search_high_  = align_down(max_mtu_);
+    probe_size_   = 0;
+    probe_count_  = 0;
+    large_losses_ = 0;
+    return true;
+}
+
+void
+path_mtu_discovery::restart()
+{
+    state_        = state::searching;
+    search_high_  = align_down(max_mtu_);
+    probe_size_   = 0;
+    probe_count_  = 0;
+    large_losses_ = 0;
+    check_complete();
+}
+
+void
+path_mtu_discovery::check_complete()
+{
+    if (search_high_ < mtu_ + search_granularity) {
+        logger::debug() << "PMTU search complete at " << mtu_ << " bytes";
+        state_ = state::search_complete;
+    }
+}
+
+} // channels namespace
+} // sss namespace
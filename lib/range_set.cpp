@@ -0,0 +1,111 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/streams/range_set.h"
+#include <algorithm>
+#include <iterator>
+
+namespace sss {
+
+size_t
+range_set::add(byte_seq_t start, byte_seq_t end)
+{
+    if (start >= end) {
+        return 0;
+    }
+    size_t old_total = total_;
+
+    // Find the first interval which could touch [start, end).
+    auto it = ranges_.upper_bound(start);
+    if (it != ranges_.begin() and std::prev(it)->second >= start) {
+        --it;
+    }
+
+    // Swallow all touching intervals into the new one.
+    while (it != ranges_.end() and it->first <= end) {
+        start = std::min(start, it->first);
+        end   = std::max(end, it->second);
+        total_ -= it->second - it->first;
+        it = ranges_.erase(it);
+    }
+
+    ranges_.emplace_hint(it, start, end);
+    total_ += end - start;
+    return total_ - old_total;
+}
+
+size_t
+range_set::remove(byte_seq_t start, byte_seq_t end)
+{
+    if (start >= end) {
+        return 0;
+    }
+    size_t removed = 0;
+
+    auto it = ranges_.upper_bound(start);
+    if (it != ranges_.begin() and std::prev(it)->second > start) {
+        --it;
+    }
+
+    while (it != ranges_.end() and it->first < end) {
+        byte_seq_t first = it->first;
+        byte_seq_t last  = it->second;
+        removed += std::min(last, end) - std::max(first, start);
+        it = ranges_.erase(it);
+
+        // Keep the parts sticking out of the removed range.
+        if (first < start) {
+            ranges_.emplace_hint(it, first, start);
+        }
+        if (last > end) {
+            it = ranges_.emplace_hint(it, end, last);
+            break;
+        }
+    }
+
+    total_ -= removed;
+    return removed;
+}
+
+bool
+range_set::intersects(byte_seq_t start, byte_seq_t end) const
+{
+    if (start >= end) {
+        return false;
+    }
+    auto it = ranges_.lower_bound(end);
+    if (it == ranges_.begin()) {
+        return false;
+    }
+    return std::prev(it)->second > start;
+}
+
+bool
+range_set::contains(byte_seq_t start, byte_seq_t end) const
+{
+    if (start >= end) {
+        return true;
+    }
+    auto it = ranges_.upper_bound(start);
+    if (it == ranges_.begin()) {
+        return false;
+    }
+    return std::prev(it)->second >= end;
+}
+
+byte_seq_t
+range_set::contiguous_end(byte_seq_t seq) const
+{
+    auto it = ranges_.upper_bound(seq);
+    if (it == ranges_.begin() or std::prev(it)->second <= seq) {
+        return seq;
+    }
+    return std::prev(it)->second;
+}
+
+} // sss namespace
@@ -0,0 +1,172 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/streams/receive_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace sss {
+
+size_t
+receive_buffer::round_capacity(size_t capacity)
+{
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+receive_buffer::receive_buffer(size_t capacity, byte_seq_t start_seq)
+    : mask_(round_capacity(capacity) - 1)
+    , base_(start_seq)
+    , ready_(start_seq)
+{
+}
+
+void
+receive_buffer::copy_in(byte_seq_t seq, uint8_t const* data, size_t size)
+{
+    if (not storage_) {
+        storage_.reset(new uint8_t[capacity()]);
+    }
+    size_t offset = seq & mask_;
+    size_t first  = std::min(size, capacity() - offset);
+    if (data == nullptr) {
+        memset(storage_.get() + offset, 0, first);
+        memset(storage_.get(), 0, size - first);
+        return;
+    }
+    memcpy(storage_.get() + offset, data, first);
+    if (first < size) {
+        memcpy(storage_.get(), data + first, size - first);
+    }
+}
+
+size_t
+receive_buffer::insert(byte_seq_t seq, boost::asio::const_buffer data)
+{
+    auto bytes       = boost::asio::buffer_cast<uint8_t const*>(data);
+    byte_seq_t start = seq;
+    byte_seq_t end   = seq + boost::asio::buffer_size(data);
+
+    // Clip to the window we can hold: already received prefix and beyond capacity.
+    start = std::max(start, ready_);
+    end   = std::min(end, base_ + capacity());
+    if (start >= end) {
+        return 0;
+    }
+
+    if (start == ready_) {
+        // In order: copy and advance, then pull whatever out-of-order data now follows.
+        copy_in(start, bytes + (start - seq), end - start);
+        ready_ = end;
+        if (not ahead_.empty()) {
+            ready_ = std::max(ready_, ahead_.contiguous_end(ready_));
+            ahead_.remove(0, ready_);
+        }
+        return ready_ - start;
+    }
+
+    // Out of order: copy only what we have not seen yet.
+    if (ahead_.contains(start, end)) {
+        return 0;
+    }
+    copy_in(start, bytes + (start - seq), end - start);
+    ahead_.add(start, end);
+    return 0;
+}
+
+std::vector<receive_buffer::byte_range_t>
+receive_buffer::skip_to(byte_seq_t seq)
+{
+    std::vector<byte_range_t> holes;
+    seq = std::min(seq, base_ + capacity());
+    while (ready_ < seq) {
+        // Hole extends up to the next out-of-order range, or all the way to seq.
+        byte_seq_t hole_end = seq;
+        if (not ahead_.empty() and ahead_.lowest() < seq) {
+            hole_end = ahead_.lowest();
+        }
+        copy_in(ready_, nullptr, hole_end - ready_);
+        holes.emplace_back(ready_, hole_end);
+        ready_ = ahead_.contiguous_end(hole_end);
+        ahead_.remove(0, ready_);
+    }
+    return holes;
+}
+
+size_t
+receive_buffer::read(char* data, size_t size)
+{
+    size = std::min(size, available());
+    if (data != nullptr and size > 0) {
+        size_t offset = base_ & mask_;
+        size_t first  = std::min(size, capacity() - offset);
+        memcpy(data, storage_.get() + offset, first);
+        if (first < size) {
+            memcpy(data + first, storage_.get(), size - first);
+        }
+    }
+    base_ += size;
+    return size;
+}
+
+size_t
+receive_buffer::read(boost::asio::mutable_buffer const* buffers, size_t count, size_t max_size)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < count and total < max_size and available() > 0; ++i) {
+        size_t size = std::min(boost::asio::buffer_size(buffers[i]), max_size - total);
+        total += read(boost::asio::buffer_cast<char*>(buffers[i]), size);
+    }
+    return total;
+}
+
+std::array<boost::asio::const_buffer, 2>
+receive_buffer::peek(size_t max_size) const
+{
+    size_t size = std::min(max_size, available());
+    if (size == 0) {
+        return {};
+    }
+    size_t offset = base_ & mask_;
+    size_t first  = std::min(size, capacity() - offset);
+    return {{{storage_.get() + offset, first}, {storage_.get(), size - first}}};
+}
+
+bool
+receive_buffer::set_capacity(size_t capacity)
+{
+    capacity = round_capacity(capacity);
+    if (capacity == this->capacity()) {
+        return true; // Windows round up, most resizes don't change the ring at all.
+    }
+    byte_seq_t end = ahead_.empty() ? ready_ : ahead_.highest();
+    if (end - base_ > capacity) {
+        return false;
+    }
+    if (storage_) {
+        std::unique_ptr<uint8_t[]> storage(new uint8_t[capacity]);
+        for (byte_seq_t seq = base_; seq < end; ++seq) {
+            storage[seq & (capacity - 1)] = storage_[seq & mask_];
+        }
+        storage_.swap(storage);
+    }
+    mask_ = capacity - 1;
+    return true;
+}
+
+void
+receive_buffer::clear()
+{
+    base_ = ready_;
+    ahead_.clear();
+}
+
+} // sss namespace
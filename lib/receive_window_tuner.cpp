@@ -0,0 +1,68 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/streams/receive_window_tuner.h"
+#include <algorithm>
+
+namespace sss {
+
+constexpr size_t receive_window_tuner::rtts_of_data;
+constexpr size_t receive_window_tuner::default_max_window;
+
+receive_window_tuner::receive_window_tuner(size_t window, size_t min_window, size_t max_window)
+    : window_(window)
+    , min_window_(min_window)
+    , max_window_(max_window)
+{
+    set_window(window);
+}
+
+void
+receive_window_tuner::set_limits(size_t min_window, size_t max_window)
+{
+    min_window_ = min_window;
+    max_window_ = std::max(min_window, max_window);
+    set_window(window_);
+}
+
+void
+receive_window_tuner::set_window(size_t window)
+{
+    window_ = std::min(std::max(window, min_window_), max_window_);
+}
+
+size_t
+receive_window_tuner::drained(size_t bytes, ptime now, time_duration rtt)
+{
+    if (epoch_start_.is_not_a_date_time()) {
+        epoch_start_ = now;
+    }
+    epoch_bytes_ += bytes;
+
+    time_duration elapsed = now - epoch_start_;
+    if (elapsed < rtt or elapsed.total_microseconds() <= 0) {
+        return window_;
+    }
+
+    // Bytes the application is able to drain per round trip.
+    uint64_t per_rtt = uint64_t(epoch_bytes_) * rtt.total_microseconds()
+                       / elapsed.total_microseconds();
+    epoch_start_ = now;
+    epoch_bytes_ = 0;
+
+    size_t target = std::min<uint64_t>(max_window_, per_rtt * rtts_of_data);
+    return std::max(window_, target);
+}
+
+size_t
+receive_window_tuner::shrink_target(size_t buffered) const
+{
+    return std::max({window_ / 2, min_window_, buffered});
+}
+
+} // sss namespace
@@ -0,0 +1,84 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/streams/send_buffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace sss {
+
+constexpr size_t send_buffer::default_capacity;
+
+send_buffer::send_buffer(size_t capacity, byte_seq_t start_seq)
+    : capacity_(capacity)
+    , base_(start_seq)
+    , end_(start_seq)
+    , high_watermark_(capacity)
+    , low_watermark_(capacity / 2)
+{
+}
+
+void
+send_buffer::set_watermarks(size_t low, size_t high)
+{
+    high_watermark_ = std::min(high, capacity());
+    low_watermark_  = std::min(low, high_watermark_);
+}
+
+boost::asio::const_buffer
+send_buffer::append(char const* data, size_t size)
+{
+    if (capacity() == 0) {
+        return {};
+    }
+    if (not storage_) {
+        storage_.reset(new uint8_t[capacity()]);
+    }
+    size_t offset = end_ % capacity();
+    size          = std::min({size, free_space(), capacity() - offset});
+
+    memcpy(storage_.get() + offset, data, size);
+    end_ += size;
+    return {storage_.get() + offset, size};
+}
+
+boost::asio::const_buffer
+send_buffer::adopt(boost::asio::const_buffer data, std::shared_ptr<void const> owner)
+{
+    end_ += boost::asio::buffer_size(data);
+    adopted_.push_back({end_, std::move(owner)});
+    return data;
+}
+
+boost::asio::const_buffer
+send_buffer::slice(byte_seq_t seq, size_t size) const
+{
+    assert(seq >= base_ and seq + size <= end_);
+    size_t offset = seq % capacity();
+    assert(offset + size <= capacity());
+    return {storage_.get() + offset, size};
+}
+
+size_t
+send_buffer::release_to(byte_seq_t seq)
+{
+    if (seq <= base_) {
+        return 0;
+    }
+    seq           = std::min(seq, end_);
+    size_t amount = seq - base_;
+    base_         = seq;
+
+    while (not adopted_.empty() and adopted_.front().end_ <= base_) {
+        adopted_.pop_front();
+    }
+    return amount;
+}
+
+} // sss namespace
@@ -0,0 +1,75 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "sss/internal/slab_pool.h"
+#include <algorithm>
+#include <cassert>
+
+namespace sss {
+
+constexpr size_t slab_pool::default_blocks_per_slab;
+
+slab_pool::slab_pool(size_t blocks_per_slab)
+    : blocks_per_slab_(blocks_per_slab)
+{
+    assert(blocks_per_slab_ > 0);
+}
+
+size_t
+slab_pool::round_size(size_t size)
+{
+    constexpr size_t align = alignof(std::max_align_t);
+    size                   = std::max(size, sizeof(free_block));
+    return (size + align - 1) / align * align;
+}
+
+void
+slab_pool::grow()
+{
+    // Arrays of char from new[] are aligned for any fundamental type, so are the blocks.
+    slabs_.emplace_back(new char[block_size_ * blocks_per_slab_]);
+    char* slab = slabs_.back().get();
+    for (size_t i = blocks_per_slab_; i > 0; --i) {
+        auto block  = reinterpret_cast<free_block*>(slab + (i - 1) * block_size_);
+        block->next = free_;
+        free_       = block;
+    }
+}
+
+void*
+slab_pool::allocate(size_t size)
+{
+    size = round_size(size);
+    if (block_size_ == 0) {
+        block_size_ = size;
+    }
+    if (size != block_size_) {
+        return ::operator new(size);
+    }
+    if (free_ == nullptr) {
+        grow();
+    }
+    free_block* block = free_;
+    free_             = block->next;
+    ++in_use_;
+    return block;
+}
+
+void
+slab_pool::deallocate(void* p, size_t size)
+{
+    if (round_size(size) != block_size_) {
+        return ::operator delete(p);
+    }
+    auto block  = static_cast<free_block*>(p);
+    block->next = free_;
+    free_       = block;
+    --in_use_;
+}
+
+} // sss namespace
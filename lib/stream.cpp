@@ -212,6 +212,29 @@ stream::current_priority() const
     return stream_->current_priority();
 }
 
+void
+stream::set_weight(int weight)
+{
+    if (!stream_) {
+        set_error("Stream not connected");
+        return;
+    }
+    if (weight <= 0) {
+        set_error("Stream weight must be positive");
+        return;
+    }
+    stream_->set_weight(weight);
+}
+
+int
+stream::current_weight() const
+{
+    if (!stream_) {
+        return 1;
+    }
+    return stream_->current_weight();
+}
+
 void
 stream::set_error(string const& error)
 {
@@ -285,6 +308,36 @@ stream::read_data(char* data, ssize_t max_size)
     return stream_->read_data(data, max_size);
 }
 
+ssize_t
+stream::read_data(std::vector<boost::asio::mutable_buffer> const& buffers)
+{
+    if (!stream_) {
+        set_error("Stream not connected");
+        return -1;
+    }
+    return stream_->read_data(buffers);
+}
+
+std::vector<boost::asio::const_buffer>
+stream::peek_data(ssize_t max_size)
+{
+    if (!stream_) {
+        set_error("Stream not connected");
+        return {};
+    }
+    return stream_->peek_data(max_size);
+}
+
+ssize_t
+stream::consume_data(ssize_t size)
+{
+    if (!stream_) {
+        set_error("Stream not connected");
+        return -1;
+    }
+    return stream_->consume_data(size);
+}
+
 byte_array
 stream::read_data(ssize_t max_size)
 {
@@ -309,6 +362,25 @@ stream::write_data(const char* data, ssize_t size)
     return 0; // stream_->write_data(data, size, stream_protocol::flags::data_push);
 }
 
+ssize_t
+stream::write_data(byte_array&& data)
+{
+    auto owner = make_shared<byte_array>(move(data));
+    return write_data(boost::asio::buffer(owner->const_data(), owner->size()), owner);
+}
+
+ssize_t
+stream::write_data(boost::asio::const_buffer data,
+                   shared_ptr<void const> owner,
+                   boost::posix_time::ptime deadline)
+{
+    if (!stream_) {
+        set_error("Stream not connected");
+        return -1;
+    }
+    return stream_->write_data(data, move(owner), 0, deadline);
+}
+
 ssize_t
 stream::write_record(const char* data, ssize_t size)
 {
@@ -340,13 +412,16 @@ stream::read_datagram(ssize_t max_size)
 }
 
 ssize_t
-stream::write_datagram(const char* data, ssize_t size, datagram_type is_reliable)
+stream::write_datagram(const char* data,
+                       ssize_t size,
+                       datagram_type is_reliable,
+                       boost::posix_time::ptime deadline)
 {
     if (!stream_) {
         set_error("Stream not connected");
         return -1;
     }
-    return stream_->write_datagram(data, size, is_reliable);
+    return stream_->write_datagram(data, size, is_reliable, deadline);
 }
 
 uia::peer_identity
@@ -417,14 +492,14 @@ stream::accept_substream()
 }
 
 shared_ptr<stream>
-stream::open_substream()
+stream::open_substream(reliability mode, boost::posix_time::time_duration lifetime)
 {
     if (!stream_) {
         set_error("Stream not connected");
         return nullptr;
     }
 
-    auto new_stream = stream_->open_substream();
+    auto new_stream = stream_->open_substream(mode, lifetime);
     if (!new_stream) {
         set_error("Unable to create substream"); // @todo Forward stream_'s error?
         return nullptr;
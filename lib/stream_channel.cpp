@@ -9,6 +9,7 @@
 #include "arsenal/logging.h"
 #include "arsenal/algorithm.h"
 #include "sss/channels/channel.h"
+#include "sss/framing/frame_writer.h"
 #include "sss/internal/stream_peer.h"
 
 using namespace std;
@@ -61,23 +62,82 @@ stream_channel::~stream_channel()
 void
 stream_channel::got_ready_transmit()
 {
-    if (sending_streams_.empty()) {
+    if (not has_sending_streams()) {
         return;
     }
 
     logger::debug() << "Stream channel - ready to transmit";
 
-    // Round-robin between our streams for now.
     do {
-        // Grab the next stream in line to transmit
-        base_stream* stream = sending_streams_.front();
-        sending_streams_.pop_front();
+        // Grab the next stream in line to transmit: deadline data goes first,
+        // then streams share what's left by priority and weight.
+        base_stream* stream =
+            deadline_streams_.empty() ? sending_streams_.pop() : deadline_streams_.pop();
 
-        // Allow it to transmit one packet.
+        // Allow it to add one frame to the packet being assembled.
         // It will add itself back onto sending_streams_ if it has more.
         stream->transmit_on(this);
 
-    } while (not sending_streams_.empty() and may_transmit());
+    } while (has_sending_streams() and may_transmit());
+
+    tx_flush();
+}
+
+bool
+stream_channel::tx_make_room(size_t frame_size)
+{
+    if (not tx_writer_ or tx_writer_->remaining() >= frame_size) {
+        return true;
+    }
+    tx_flush();
+    return may_transmit();
+}
+
+void
+stream_channel::tx_pack_frame(base_stream::tx_frame_t const& p,
+                              framing::stream_frame_view const& frame)
+{
+    if (not tx_writer_) {
+        constexpr size_t reserved = framing::frame_writer::max_packet_header_size;
+        tx_packet_.resize(max_payload_size());
+        tx_writer_.reset(new framing::frame_writer(
+            boost::asio::buffer(tx_packet_.data() + reserved, tx_packet_.size() - reserved)));
+    }
+    // Datagram fragments are STREAM frames on the wire too.
+    bool written = tx_writer_->write_stream(frame);
+    assert(written);
+    (void)written;
+    tx_packed_.push_back(p);
+}
+
+void
+stream_channel::tx_flush()
+{
+    if (not tx_writer_) {
+        return;
+    }
+    // Put the header right before the frames, now that the packet sequence is known.
+    packet_seq_t packet_seq = tx_next_sequence();
+    auto header             = tx_packet_header(packet_seq);
+    size_t header_size      = framing::frame_writer::packet_header_size(header);
+    size_t offset           = framing::frame_writer::max_packet_header_size - header_size;
+    auto start              = tx_packet_.data() + offset;
+    size_t size             = tx_packet_.size() - offset;
+
+    framing::frame_writer(boost::asio::buffer(start, header_size)).write_packet_header(header);
+    framing::frame_writer writer(boost::asio::buffer(start, size),
+                                 header_size + tx_writer_->size());
+    tx_padding().pad(writer);
+
+    logger::debug() << "Stream channel - sending " << tx_packed_.size() << " frames in "
+                    << writer.size() << " bytes";
+    channel_transmit(writer.written(), packet_seq);
+
+    for (auto& p : tx_packed_) {
+        waiting_ack_.insert(make_pair(packet_seq, p));
+    }
+    tx_packed_.clear();
+    tx_writer_.reset();
 }
 
 void
@@ -91,6 +151,7 @@ stream_channel::got_link_status_changed(uia::comm::socket::status new_status)
     }
 
     // Link went down indefinitely - self-destruct.
+    // Our streams outlive us, the peer resumes them on a new channel.
     auto peer = target_peer();
     assert(peer);
 
@@ -143,6 +204,7 @@ stream_channel::start(bool initiate)
     // If our target doesn't yet have an active channel, use this one.
     // This way either an incoming or outgoing channel can be a primary.
     target_peer()->channel_started(this);
+    peer_->add_path(this);
 }
 
 void
@@ -164,6 +226,11 @@ stream_channel::stop()
         assert(it.second->channel_ == this);
         it.second->clear();
     }
+    rx_orphans_.clear();
+    rx_orphan_bytes_ = 0;
+
+    // Streams left without a path stay around to resume on the peer's next channel.
+    peer_->remove_path(this);
 }
 
 //=================================================================================================
@@ -200,6 +267,13 @@ stream_channel::assemble_packet(asio::mutable_buffer out_packet)
         types_by_priority = [
             SETTINGS,
             ACK,
+            MAX_DATA,
+            DATA_BLOCKED,
+            MAX_STREAM_DATA,
+            STREAM_DATA_BLOCKED,
+            PATH_CHALLENGE,
+            PATH_RESPONSE,
+            PING,
             RESET,
             PRIORITY,
             DECONGESTION,
@@ -261,27 +335,66 @@ stream_channel::enqueue_stream(base_stream* stream)
 {
     logger::debug() << "Stream channel - enqueue stream " << stream;
 
-    // Find the correct position at which to enqueue this stream,
-    // based on priority.
-    auto it = upper_bound(sending_streams_.begin(),
-                          sending_streams_.end(),
-                          stream->current_priority(),
-                          [this](base_stream::priority_t prio, base_stream* str) {
-                              return str->current_priority() >= prio;
-                          });
+    auto deadline = stream->tx_next_deadline();
+    if (not deadline.is_special()) {
+        deadline_streams_.push(stream, deadline);
+        return;
+    }
+    if (not sending_streams_.contains(stream)) {
+        sending_streams_.insert(stream, schedule_parent(stream), stream->current_priority(),
+                                stream->current_weight());
+    }
+    sending_streams_.push(stream);
 
-    logger::debug() << "Stream channel - enqueue stream at pos " << (it - sending_streams_.begin())
-                    << " of total " << sending_streams_.size() << " streams";
+    logger::debug() << "Stream channel - " << sending_streams_.size() << " streams waiting";
+}
 
-    sending_streams_.insert(it, stream);
+void
+stream_channel::reprioritize_stream(base_stream* stream)
+{
+    // Streams not scheduled yet pick up their settings when first enqueued.
+    if (sending_streams_.contains(stream)) {
+        sending_streams_.set_weight(stream, stream->current_priority(), stream->current_weight());
+    }
+}
+
+void
+stream_channel::reparent_stream(base_stream* stream, base_stream* parent)
+{
+    logger::debug() << "Stream channel - move stream " << stream << " under " << parent;
+    if (sending_streams_.contains(stream)) {
+        sending_streams_.set_parent(stream, parent);
+    } else {
+        sending_streams_.insert(stream, parent, stream->current_priority(),
+                                stream->current_weight());
+    }
+}
+
+/**
+ * Substreams are scheduled under their parent, top-level streams under the root stream
+ * and the root stream itself at the top.
+ */
+base_stream*
+stream_channel::schedule_parent(base_stream* stream)
+{
+    if (stream == root_.get()) {
+        return nullptr;
+    }
+    if (stream->top_level_) {
+        return root_.get();
+    }
+    return stream->parent_.lock().get();
 }
 
 void
 stream_channel::dequeue_stream(base_stream* stream)
 {
     logger::debug() << "Stream channel - dequeue stream " << stream;
-    sending_streams_.erase(remove(sending_streams_.begin(), sending_streams_.end(), stream),
-                           sending_streams_.end());
+    sending_streams_.remove(stream);
+    deadline_streams_.remove(stream);
+    tx_credit_blocked_.erase(
+        remove(tx_credit_blocked_.begin(), tx_credit_blocked_.end(), stream),
+        tx_credit_blocked_.end());
 }
 
 void
@@ -300,6 +413,7 @@ stream_channel::detach_all()
         v.second->clear();
     }
     assert(transmit_sids_.empty());
+    tx_credit_blocked_.clear();
 
     // Finally, send back all the waiting packets to their streams.
     logger::debug() << "Returning " << ack_copy.size() << " channel packets for retransmission";
@@ -334,7 +448,7 @@ stream_channel::transmit_ack(byte_array& pkt, packet_seq_t ackseq, int ack_count
     /*    auto header          = as_header<ack_header>(pkt);
         header->stream_id    = attach->stream_id_;
         header->type_subtype = type_and_subtype(packet_type::ack, 0);
-        header->window       = attach->stream_->receive_window_byte();
+        header->window       = attach->stream_->receive_window();
     */
     // Let channel protocol put together its part of the packet and send it.
     return super::transmit_ack(pkt, ackseq, ack_count);
@@ -345,16 +459,19 @@ stream_channel::acknowledged(packet_seq_t txseq, int npackets, packet_seq_t rxac
 {
     logger::debug() << "Stream channel - ACKed seq " << txseq;
     for (; npackets > 0; txseq++, npackets--) {
-        // find and remove the packet
-        if (!contains(waiting_ack_, txseq))
-            continue;
-
-        base_stream::tx_frame_t p = waiting_ack_[txseq];
-        waiting_ack_.erase(txseq);
+        // find and remove the packet's frames
+        auto range = waiting_ack_.equal_range(txseq);
+        std::vector<base_stream::tx_frame_t> frames;
+        for (auto it = range.first; it != range.second; ++it) {
+            frames.push_back(it->second);
+        }
+        waiting_ack_.erase(range.first, range.second);
 
-        logger::debug() << "Stream channel - acknowledged packet " << txseq << " of size "
-                        << p.payload_size();
-        p.owner->acknowledged(this, p, rxackseq);
+        for (auto& p : frames) {
+            logger::debug() << "Stream channel - acknowledged frame in packet " << txseq
+                            << " of size " << p.payload_size();
+            p.owner->acknowledged(this, p, rxackseq);
+        }
     }
 }
 
@@ -364,20 +481,26 @@ stream_channel::missed(packet_seq_t txseq, int npackets)
     logger::debug() << "Stream channel - missed seq " << txseq;
     for (; npackets > 0; txseq++, npackets--) {
         // find but don't remove (common case for missed packets)
-        if (!contains(waiting_ack_, txseq)) {
+        auto range = waiting_ack_.equal_range(txseq);
+        if (range.first == range.second) {
             logger::warning() << "Missed packet " << txseq << " but can't find it!";
             continue;
         }
 
-        base_stream::tx_frame_t p = waiting_ack_[txseq];
-
-        logger::debug() << "Stream channel - missed packet " << txseq << " of size "
-                        << p.payload_size();
+        // Streams requeue missed frames, which may transmit right away - work on a copy.
+        std::vector<base_stream::tx_frame_t> frames;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (!it->second.late) {
+                it->second.late = true;
+                frames.push_back(it->second);
+            }
+        }
 
-        if (!p.late) {
-            p.late = true;
+        for (auto& p : frames) {
+            logger::debug() << "Stream channel - missed frame in packet " << txseq << " of size "
+                            << p.payload_size();
             if (!p.owner->missed(this, p)) {
-                waiting_ack_.erase(txseq);
+                erase_waiting_ack(txseq, p);
             }
         }
     }
@@ -388,19 +511,261 @@ stream_channel::expire(packet_seq_t txseq, int npackets)
 {
     logger::debug() << "Stream channel - expire seq " << txseq;
     for (; npackets > 0; txseq++, npackets--) {
-        // find and unconditionally remove packet when it expires
-        base_stream::tx_frame_t p = waiting_ack_[txseq];
-        waiting_ack_.erase(txseq);
-
-        if (p.is_null()) {
+        // find and unconditionally remove packet's frames when it expires
+        auto range = waiting_ack_.equal_range(txseq);
+        if (range.first == range.second) {
             logger::debug() << "Expired packet " << txseq << " but can't find it!";
             continue;
         }
+        std::vector<base_stream::tx_frame_t> frames;
+        for (auto it = range.first; it != range.second; ++it) {
+            frames.push_back(it->second);
+        }
+        waiting_ack_.erase(range.first, range.second);
+
+        for (auto& p : frames) {
+            logger::debug() << "Stream channel - expired frame in packet " << txseq << " of size "
+                            << p.payload_size();
+            p.owner->expire(this, p);
+        }
+    }
+}
+
+void
+stream_channel::erase_waiting_ack(packet_seq_t packet_seq, base_stream::tx_frame_t const& p)
+{
+    auto range = waiting_ack_.equal_range(packet_seq);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.owner == p.owner and it->second.tx_byte_seq_ == p.tx_byte_seq_
+            and it->second.type() == p.type()) {
+            waiting_ack_.erase(it);
+            return;
+        }
+    }
+}
+
+stream_rx_attachment*
+stream_channel::rx_attachment(local_stream_id_t sid) const
+{
+    auto it = receive_sids_.find(sid);
+    return it == receive_sids_.end() ? nullptr : it->second;
+}
 
-        logger::debug() << "Stream channel - expired packet " << txseq << " of size "
-                        << p.payload_size();
+void
+stream_channel::rx_hold_orphan(packet_seq_t pktseq, framing::stream_frame_view const& frame)
+{
+    size_t usid_size = frame.has_usid() ? framing::stream_frame_view::usid_size : 0;
+    size_t size      = usid_size + frame.data.size;
+
+    while (not rx_orphans_.empty()
+           and (rx_orphans_.size() >= max_orphan_frames
+                or rx_orphan_bytes_ + size > max_orphan_bytes)) {
+        auto& oldest = rx_orphans_.front();
+        logger::warning() << "Stream channel - too many orphan INIT frames, resetting stream ID "
+                          << oldest.frame.stream_id;
+        base_stream::tx_reset(this, oldest.frame.stream_id, 0);
+        rx_orphan_bytes_ -= oldest.bytes.size();
+        rx_orphans_.pop_front();
+    }
+    if (size > max_orphan_bytes) {
+        base_stream::tx_reset(this, frame.stream_id, 0);
+        return;
+    }
 
-        p.owner->expire(this, p);
+    orphan_frame orphan{pktseq, frame, {}};
+    orphan.bytes.reserve(size);
+    if (usid_size) {
+        orphan.bytes.insert(orphan.bytes.end(), frame.usid, frame.usid + usid_size);
+    }
+    orphan.bytes.insert(orphan.bytes.end(), frame.data.data, frame.data.data + frame.data.size);
+    rx_orphan_bytes_ += size;
+    rx_orphans_.push_back(std::move(orphan));
+}
+
+void
+stream_channel::rx_replay_orphans(local_stream_id_t parent_sid, packet_seq_t parent_seq)
+{
+    // Take them out first, replaying may attach more parents and recurse.
+    std::vector<orphan_frame> children;
+    for (auto it = rx_orphans_.begin(); it != rx_orphans_.end();) {
+        if (it->frame.parent_stream_id == parent_sid) {
+            rx_orphan_bytes_ -= it->bytes.size();
+            children.push_back(std::move(*it));
+            it = rx_orphans_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto& child : children) {
+        size_t usid_size = child.frame.has_usid() ? framing::stream_frame_view::usid_size : 0;
+        child.frame.usid = usid_size ? child.bytes.data() : nullptr;
+        child.frame.data = {child.bytes.data() + usid_size, child.bytes.size() - usid_size};
+        // Child may have been sent before the parent's INIT arrived, don't let it look stale.
+        base_stream::rx_stream_frame(max(child.pktseq, parent_seq), child.frame, this);
+    }
+}
+
+bool
+stream_channel::channel_receive_frame(framing::frame_view const& frame, packet_seq_t packet_seq)
+{
+    stream_rx_attachment* attach{nullptr};
+
+    switch (frame.type) {
+        case frame_type::STREAM:
+            return base_stream::rx_stream_frame(packet_seq, frame.stream, this);
+
+        case frame_type::DETACH:
+            if ((attach = rx_attachment(frame.detach.lsid))) {
+                return attach->stream_->rx_detach_frame(frame.detach);
+            }
+            break;
+
+        case frame_type::RESET:
+            if ((attach = rx_attachment(frame.reset.lsid))) {
+                return attach->stream_->rx_reset_frame(frame.reset);
+            }
+            // Stream is already gone, nothing to reset.
+            return true;
+
+        case frame_type::PRIORITY:
+            if ((attach = rx_attachment(frame.priority.lsid))) {
+                return attach->stream_->rx_priority_frame(frame.priority, this);
+            }
+            break;
+
+        case frame_type::MAX_DATA:
+            rx_max_data_frame(frame.max_data);
+            return true;
+
+        case frame_type::DATA_BLOCKED:
+            rx_data_blocked_frame(frame.data_blocked);
+            return true;
+
+        case frame_type::MAX_STREAM_DATA: {
+            // Peer names the stream by the LSID we send it with.
+            auto it = transmit_sids_.find(frame.max_stream_data.lsid);
+            if (it != transmit_sids_.end()) {
+                return it->second->stream_->rx_max_stream_data_frame(frame.max_stream_data);
+            }
+            break;
+        }
+
+        case frame_type::STREAM_DATA_BLOCKED:
+            if ((attach = rx_attachment(frame.stream_data_blocked.lsid))) {
+                return attach->stream_->rx_stream_data_blocked_frame(frame.stream_data_blocked);
+            }
+            break;
+
+        default: return super::channel_receive_frame(frame, packet_seq);
+    }
+
+    logger::warning() << "Stream channel - frame type " << int(frame.type)
+                      << " for unknown stream in packet " << packet_seq;
+    return true;
+}
+
+//=================================================================================================
+// Channel-level flow control
+//=================================================================================================
+
+bool
+stream_channel::tx_consume_credit(size_t bytes, base_stream* stream)
+{
+    if (tx_credit_used_ + bytes <= tx_credit_limit_) {
+        tx_credit_used_ += bytes;
+        return true;
+    }
+
+    logger::debug() << "Stream channel - out of credit at " << tx_credit_limit_ << ", stream "
+                    << stream << " needs " << bytes;
+    if (find(tx_credit_blocked_.begin(), tx_credit_blocked_.end(), stream)
+        == tx_credit_blocked_.end()) {
+        tx_credit_blocked_.push_back(stream);
+    }
+    // Repeated on every blocked attempt, so a lost DATA_BLOCKED doesn't stall us for good.
+    tx_data_blocked();
+    return false;
+}
+
+bool
+stream_channel::rx_charge_credit(size_t bytes)
+{
+    if (rx_credit_used_ + bytes > rx_credit_limit_) {
+        logger::warning() << "Stream channel - peer exceeded credit " << rx_credit_limit_
+                          << " by " << (rx_credit_used_ + bytes - rx_credit_limit_) << " bytes";
+        return false;
+    }
+    rx_credit_used_ += bytes;
+    return true;
+}
+
+void
+stream_channel::rx_release_credit(size_t bytes)
+{
+    rx_credit_consumed_ += bytes;
+    assert(rx_credit_consumed_ <= rx_credit_used_);
+
+    // Extend credit once half of the window has been read,
+    // so a fast reader never leaves the peer waiting for an update.
+    if (rx_credit_limit_ - rx_credit_consumed_ <= rx_credit_window_ / 2) {
+        rx_credit_limit_ = rx_credit_consumed_ + rx_credit_window_;
+        tx_max_data();
+    }
+}
+
+void
+stream_channel::tx_max_data()
+{
+    if (not is_active()) {
+        return;
+    }
+    logger::debug() << "Stream channel - sending MAX_DATA " << rx_credit_limit_;
+    tx_control_packet([this](framing::frame_writer& writer) {
+        return writer.write_max_data({rx_credit_limit_});
+    });
+}
+
+void
+stream_channel::tx_data_blocked()
+{
+    if (not is_active()) {
+        return;
+    }
+    logger::debug() << "Stream channel - sending DATA_BLOCKED " << tx_credit_limit_;
+    tx_control_packet([this](framing::frame_writer& writer) {
+        return writer.write_data_blocked({tx_credit_limit_});
+    });
+}
+
+void
+stream_channel::rx_max_data_frame(framing::max_data_frame_view const& frame)
+{
+    // Updates may arrive reordered, credit never shrinks.
+    if (frame.maximum_data <= tx_credit_limit_) {
+        return;
+    }
+    logger::debug() << "Stream channel - credit raised " << tx_credit_limit_ << "->"
+                    << frame.maximum_data;
+    tx_credit_limit_ = frame.maximum_data;
+
+    auto blocked = move(tx_credit_blocked_);
+    tx_credit_blocked_.clear();
+    for (auto stream : blocked) {
+        stream->tx_enqueue_channel();
+    }
+    if (has_sending_streams() and may_transmit()) {
+        got_ready_transmit();
+    }
+}
+
+void
+stream_channel::rx_data_blocked_frame(framing::data_blocked_frame_view const& frame)
+{
+    logger::debug() << "Stream channel - peer blocked at credit " << frame.data_limit;
+    // Peer hasn't seen our latest update, it must have been lost.
+    if (frame.data_limit < rx_credit_limit_) {
+        tx_max_data();
     }
 }
 
@@ -51,6 +51,59 @@ stream_peer::~stream_peer()
     assert(usid_streams_.empty());
 }
 
+void
+stream_peer::add_path(stream_channel* channel)
+{
+    paths_.add(channel);
+    logger::debug() << "Stream peer - added path " << channel << ", " << paths_.size()
+                    << " paths";
+
+    // Streams which lost their channel carry on from where acknowledgments left off.
+    auto streams_copy = all_streams_;
+    for (auto stream : streams_copy) {
+        if (stream->tx_needs_path()) {
+            stream->tx_resume(channel);
+        }
+    }
+}
+
+void
+stream_peer::remove_path(stream_channel* channel)
+{
+    logger::debug() << "Stream peer - removing path " << channel;
+    paths_.remove(channel);
+
+    if (paths_.empty() and has_streams_to_resume()) {
+        logger::info() << "Stream peer - lost last channel to " << remote_id_
+                       << ", reconnecting to resume streams";
+        connect_channel();
+    }
+}
+
+bool
+stream_peer::has_streams_to_resume() const
+{
+    for (auto const& stream : all_streams_) {
+        if (stream->tx_needs_path()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+stream_channel*
+stream_peer::select_path(size_t bytes) const
+{
+    return paths_.select(bytes);
+}
+
+base_stream_ptr
+stream_peer::find_stream(unique_stream_id_t const& usid) const
+{
+    auto it = usid_streams_.find(usid);
+    return it == usid_streams_.end() ? nullptr : it->second.lock();
+}
+
 void
 stream_peer::routing_client_ready(ur::client* rc)
 {
@@ -10,6 +10,10 @@
 
 namespace sss {
 constexpr size_t stream_protocol::mtu;
+constexpr size_t stream_protocol::datagram_overhead;
+constexpr size_t stream_protocol::ethernet_mtu;
+constexpr size_t stream_protocol::jumbo_mtu;
 constexpr size_t stream_protocol::min_receive_buffer_size;
+constexpr uint16_t stream_protocol::protocol_version;
 constexpr int stream_protocol::max_service_record_size;
 }
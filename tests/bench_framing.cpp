@@ -0,0 +1,261 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Framing codec microbenchmarks.
+// Run with --benchmark_out=bench_framing.json --benchmark_out_format=json
+// (the run_bench_framing target does this) to track regressions.
+//
+#include "sss/framing/frame_format.h"
+#include "sss/framing/frame_parser.h"
+#include "sss/framing/frame_writer.h"
+#include "sss/framing/ack_frame.h"
+#include "sss/framing/close_frame.h"
+#include "sss/framing/decongestion_frame.h"
+#include "sss/framing/detach_frame.h"
+#include "sss/framing/empty_frame.h"
+#include "sss/framing/padding_frame.h"
+#include "sss/framing/priority_frame.h"
+#include "sss/framing/reset_frame.h"
+#include "sss/framing/settings_frame.h"
+#include "sss/framing/stream_frame.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <vector>
+
+using namespace sss;
+using namespace sss::framing;
+
+namespace {
+
+constexpr size_t packet_size = 1168; // Max MESSAGE payload, see spec 4.1.
+
+std::array<uint8_t, packet_size> packet_buf;
+std::array<uint8_t, packet_size> payload_buf;
+
+// Largest offset representable by each ooo bits code.
+uint64_t
+offset_for_code(int code)
+{
+    return code == 0 ? 0 : (~0ULL >> (64 - stream_offset_size(code) * 8));
+}
+
+stream_frame_view
+make_stream_frame(uint64_t offset, size_t payload)
+{
+    stream_frame_view frame{};
+    frame.stream_id     = 5;
+    frame.stream_offset = offset;
+    frame.data          = {payload_buf.data(), payload};
+    return frame;
+}
+
+//=================================================================================================
+// fusionary codecs for every frame in frame_format.h
+//=================================================================================================
+
+template <typename Frame>
+void
+BM_fusionary_encode(benchmark::State& state)
+{
+    Frame frame;
+    while (state.KeepRunning()) {
+        boost::asio::mutable_buffer out(packet_buf.data(), packet_buf.size());
+        benchmark::DoNotOptimize(frame.write(out));
+    }
+}
+
+template <typename Frame>
+void
+BM_fusionary_decode(benchmark::State& state)
+{
+    Frame frame;
+    boost::asio::mutable_buffer out(packet_buf.data(), packet_buf.size());
+    size_t size = frame.write(out);
+
+    while (state.KeepRunning()) {
+        Frame decoded;
+        boost::asio::const_buffer in(packet_buf.data(), size);
+        benchmark::DoNotOptimize(decoded.read(in));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK_TEMPLATE(BM_fusionary_encode, empty_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, stream_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, ack_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, padding_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, decongestion_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, detach_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, reset_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, close_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, settings_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_encode, priority_frame_t);
+
+BENCHMARK_TEMPLATE(BM_fusionary_decode, empty_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, stream_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, ack_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, padding_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, decongestion_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, detach_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, reset_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, close_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, settings_frame_t);
+BENCHMARK_TEMPLATE(BM_fusionary_decode, priority_frame_t);
+
+//=================================================================================================
+// Varsize fields: packet sequence (ss bits) and stream offset (ooo bits, size0-size8).
+//=================================================================================================
+
+void
+BM_packet_header_encode(benchmark::State& state)
+{
+    packet_header_view hdr{};
+    hdr.sequence_size   = state.range(0);
+    hdr.packet_sequence = 0x0102030405060708ULL;
+    while (state.KeepRunning()) {
+        frame_writer writer(boost::asio::buffer(packet_buf));
+        benchmark::DoNotOptimize(writer.write_packet_header(hdr));
+    }
+}
+BENCHMARK(BM_packet_header_encode)->Arg(2)->Arg(4)->Arg(6)->Arg(8);
+
+void
+BM_packet_header_decode(benchmark::State& state)
+{
+    packet_header_view hdr{};
+    hdr.sequence_size = state.range(0);
+    frame_writer writer(boost::asio::buffer(packet_buf));
+    writer.write_packet_header(hdr);
+
+    while (state.KeepRunning()) {
+        frame_parser parser(writer.written());
+        packet_header_view out;
+        benchmark::DoNotOptimize(parser.read_packet_header(out));
+    }
+}
+BENCHMARK(BM_packet_header_decode)->Arg(2)->Arg(4)->Arg(6)->Arg(8);
+
+// Args: ooo code (0-7), payload size.
+void
+stream_frame_args(benchmark::internal::Benchmark* b)
+{
+    for (int code = 0; code < 8; ++code) {
+        for (int payload : {16, 128, 1024}) {
+            b->Args({code, payload});
+        }
+    }
+}
+
+void
+BM_stream_frame_encode(benchmark::State& state)
+{
+    auto frame = make_stream_frame(offset_for_code(state.range(0)), state.range(1));
+    while (state.KeepRunning()) {
+        frame_writer writer(boost::asio::buffer(packet_buf));
+        benchmark::DoNotOptimize(writer.write_stream(frame));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_stream_frame_encode)->Apply(stream_frame_args);
+
+void
+BM_stream_frame_decode(benchmark::State& state)
+{
+    auto frame = make_stream_frame(offset_for_code(state.range(0)), state.range(1));
+    frame_writer writer(boost::asio::buffer(packet_buf));
+    writer.write_stream(frame);
+
+    while (state.KeepRunning()) {
+        frame_parser parser(writer.written());
+        frame_view out;
+        benchmark::DoNotOptimize(parser.next(out));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_stream_frame_decode)->Apply(stream_frame_args);
+
+//=================================================================================================
+// Whole-packet deframe for realistic frame mixes.
+//=================================================================================================
+
+enum packet_mix
+{
+    bulk,    ///< ACK + one full-size STREAM frame.
+    chatty,  ///< ACK + many small STREAM frames from different streams, padded.
+    control, ///< Control frames only.
+};
+
+size_t
+build_packet(packet_mix mix)
+{
+    frame_writer writer(boost::asio::buffer(packet_buf));
+
+    packet_header_view hdr{};
+    hdr.sequence_size   = 4;
+    hdr.packet_sequence = 123456;
+    writer.write_packet_header(hdr);
+
+    ack_frame_view ack{};
+    ack.least_unacked_packet    = 123000;
+    ack.largest_observed_packet = 123400;
+    writer.write_ack(ack);
+
+    switch (mix) {
+        case bulk: {
+            auto frame = make_stream_frame(1ULL << 30, 0);
+            frame.data.size =
+                writer.remaining() - frame_writer::stream_header_size(frame, /*last*/ true);
+            writer.write_stream(frame, /*last*/ true);
+            break;
+        }
+        case chatty: {
+            for (uint32_t sid = 1; writer.remaining() > 64; ++sid) {
+                auto frame      = make_stream_frame(sid * 1000, 40);
+                frame.stream_id = sid;
+                writer.write_stream(frame);
+            }
+            writer.write_padding(writer.remaining());
+            break;
+        }
+        case control: {
+            writer.write_priority({7, 1});
+            writer.write_detach({9});
+            writer.write_reset({11, 1, {payload_buf.data(), 16}});
+            writer.write_decongestion({0, {nullptr, 0}});
+            break;
+        }
+    }
+    return writer.size();
+}
+
+void
+BM_deframe_packet(benchmark::State& state)
+{
+    size_t size   = build_packet(packet_mix(state.range(0)));
+    size_t frames = 0;
+
+    while (state.KeepRunning()) {
+        frame_parser parser(boost::asio::const_buffer(packet_buf.data(), size));
+        packet_header_view hdr;
+        frame_view frame;
+        parser.read_packet_header(hdr);
+        while (parser.next(frame) == parse_status::ok) {
+            benchmark::DoNotOptimize(frame);
+            ++frames;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetItemsProcessed(frames);
+}
+BENCHMARK(BM_deframe_packet)->Arg(bulk)->Arg(chatty)->Arg(control);
+
+} // anonymous namespace
+
+BENCHMARK_MAIN();
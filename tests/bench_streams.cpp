@@ -0,0 +1,313 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Stream buffer and scheduling microbenchmarks.
+// Run with --benchmark_out=bench_streams.json --benchmark_out_format=json
+// (the run_bench_streams target does this) to track regressions.
+//
+#include "sss/streams/receive_buffer.h"
+#include "sss/streams/base_stream.h"
+#include "sss/host.h"
+#include "sss/channels/stride_scheduler.h"
+#include "sss/channels/priority_tree.h"
+#include "sss/framing/frame_writer.h"
+#include "sss/framing/stream_protocol.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstring>
+
+using namespace sss;
+
+namespace {
+
+constexpr size_t segment_size = 1168; // Max MESSAGE payload, see spec 4.1.
+constexpr size_t window_size  = 65536;
+constexpr size_t segments     = window_size / segment_size;
+
+std::array<char, segment_size> segment_buf;
+std::array<char, window_size> app_buf;
+
+//=================================================================================================
+// Small-buffer read loops: application reads a window worth of data in chunks of given size.
+//=================================================================================================
+
+/**
+ * Previous design: every received segment is a heap copy queued in a deque,
+ * and read_data() can only consume whole segments. An application with small reads
+ * has to read each segment into a segment-sized bounce buffer and copy out of it.
+ */
+void
+BM_read_segment_queue(benchmark::State& state)
+{
+    size_t chunk = state.range(0);
+    std::array<char, segment_size> bounce;
+
+    while (state.KeepRunning()) {
+        std::deque<std::vector<char>> rx_segments;
+        for (size_t i = 0; i < segments; ++i) {
+            rx_segments.emplace_back(segment_buf.begin(), segment_buf.end());
+        }
+        size_t pos = 0;
+        for (; !rx_segments.empty(); rx_segments.pop_front()) {
+            auto const& seg = rx_segments.front();
+            memcpy(bounce.data(), seg.data(), seg.size());
+            for (size_t off = 0; off < seg.size(); off += chunk) {
+                size_t size = std::min(chunk, seg.size() - off);
+                memcpy(app_buf.data() + pos, bounce.data() + off, size);
+                pos += size;
+            }
+        }
+        benchmark::DoNotOptimize(app_buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * segments * segment_size);
+}
+BENCHMARK(BM_read_segment_queue)->Arg(16)->Arg(64)->Arg(256)->Arg(1024);
+
+/// Reassembly ring: partial reads copy straight from the ring into the application buffer.
+void
+BM_read_ring_partial(benchmark::State& state)
+{
+    size_t chunk = state.range(0);
+    receive_buffer rx(window_size);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < segments; ++i) {
+            rx.insert(rx.ready_seq(), boost::asio::buffer(segment_buf));
+        }
+        size_t pos = 0;
+        while (rx.available() > 0) {
+            pos += rx.read(app_buf.data() + pos, chunk);
+        }
+        benchmark::DoNotOptimize(app_buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * segments * segment_size);
+}
+BENCHMARK(BM_read_ring_partial)->Arg(16)->Arg(64)->Arg(256)->Arg(1024);
+
+/// Reassembly ring: scatter reads fill 16 chunk-sized buffers per call.
+void
+BM_read_ring_scatter(benchmark::State& state)
+{
+    constexpr size_t buffers_per_read = 16;
+    size_t chunk = state.range(0);
+    receive_buffer rx(window_size);
+    std::vector<boost::asio::mutable_buffer> buffers(buffers_per_read);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < segments; ++i) {
+            rx.insert(rx.ready_seq(), boost::asio::buffer(segment_buf));
+        }
+        size_t pos = 0;
+        while (rx.available() > 0) {
+            for (size_t i = 0; i < buffers_per_read; ++i) {
+                size_t off = std::min(pos + i * chunk, window_size);
+                buffers[i] = {app_buf.data() + off, std::min(chunk, window_size - off)};
+            }
+            pos += rx.read(buffers.data(), buffers.size(), rx.available());
+        }
+        benchmark::DoNotOptimize(app_buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * segments * segment_size);
+}
+BENCHMARK(BM_read_ring_scatter)->Arg(16)->Arg(64)->Arg(256)->Arg(1024);
+
+//=================================================================================================
+// Channel send scheduling with n active streams in 4 priority levels. Every packet the channel
+// takes the next stream, sends a segment and requeues it; also one random stream drops out of
+// the queue and comes back, as streams going idle and getting new writes do.
+//=================================================================================================
+
+struct fake_stream
+{
+    uint32_t priority;
+};
+
+std::vector<fake_stream>
+make_streams(size_t n)
+{
+    std::vector<fake_stream> streams(n);
+    for (size_t i = 0; i < n; ++i) {
+        streams[i].priority = i % 4;
+    }
+    return streams;
+}
+
+/// Previous design: deque sorted by priority, linear removal.
+void
+BM_schedule_sorted_deque(benchmark::State& state)
+{
+    auto streams = make_streams(state.range(0));
+    std::deque<fake_stream*> sending;
+    auto enqueue = [&sending](fake_stream* s) {
+        auto it = std::upper_bound(
+            sending.begin(), sending.end(), s->priority,
+            [](uint32_t prio, fake_stream* str) { return str->priority >= prio; });
+        sending.insert(it, s);
+    };
+    for (auto& s : streams) {
+        enqueue(&s);
+    }
+    uint32_t rnd = 1;
+
+    while (state.KeepRunning()) {
+        fake_stream* s = sending.front();
+        sending.pop_front();
+        enqueue(s);
+
+        rnd = rnd * 1103515245 + 12345;
+        fake_stream* idle = &streams[rnd % streams.size()];
+        sending.erase(std::remove(sending.begin(), sending.end(), idle), sending.end());
+        enqueue(idle);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_schedule_sorted_deque)->Arg(10)->Arg(1000)->Arg(100000);
+
+/// Stride scheduler, byte-accurate fairness within a priority level.
+void
+BM_schedule_stride(benchmark::State& state)
+{
+    auto streams = make_streams(state.range(0));
+    stride_scheduler<fake_stream> sending;
+    for (auto& s : streams) {
+        sending.push(&s, s.priority);
+    }
+    uint32_t rnd = 1;
+
+    while (state.KeepRunning()) {
+        fake_stream* s = sending.pop();
+        sending.charge(s, segment_size);
+        sending.push(s, s->priority);
+
+        rnd = rnd * 1103515245 + 12345;
+        fake_stream* idle = &streams[rnd % streams.size()];
+        sending.remove(idle);
+        sending.push(idle, idle->priority);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_schedule_stride)->Arg(10)->Arg(1000)->Arg(100000);
+
+//=================================================================================================
+// Many small streams: each of n streams has a 50-byte chat message to send every round.
+// The channel takes streams in scheduler order and builds packets of their STREAM frames.
+// Counters show packets and bytes on the wire (with per-datagram overhead) per message,
+// each packet also costs a crypto box and a sendmsg() not measured here.
+//
+// This is a model of stream_channel::tx_pack_frame() and tx_flush(), not the channel itself:
+// it uses the same frame_writer and priority_tree, but a real stream_channel needs a
+// connected peer and the uia socket layer. Changes to the channel packer must be mirrored here.
+//=================================================================================================
+
+constexpr size_t message_size = 50;
+
+std::array<uint8_t, segment_size> packet_buf;
+
+/// Model packet assembly for one message from every stream, 1 frame per packet or as many as fit.
+void
+BM_small_streams(benchmark::State& state, bool pack)
+{
+    auto streams = make_streams(state.range(0));
+    priority_tree<fake_stream> sending;
+    for (auto& s : streams) {
+        sending.insert(&s, nullptr, s.priority);
+    }
+    framing::packet_header_view header{};
+    header.sequence_size = 4;
+
+    uint64_t offset  = 0;
+    size_t packets   = 0;
+    size_t wire_size = 0;
+    while (state.KeepRunning()) {
+        for (auto& s : streams) {
+            sending.push(&s);
+        }
+        framing::frame_writer writer(boost::asio::buffer(packet_buf));
+        writer.write_packet_header(header);
+        size_t frames = 0;
+
+        while (not sending.empty()) {
+            fake_stream* s = sending.pop();
+            framing::stream_frame_view frame{};
+            frame.stream_id     = s - streams.data();
+            frame.stream_offset = offset;
+            frame.data          = {reinterpret_cast<uint8_t const*>(app_buf.data()), message_size};
+
+            if (frames > 0 and (not pack or not writer.write_stream(frame))) {
+                ++packets;
+                wire_size += writer.size() + stream_protocol::datagram_overhead;
+                writer = framing::frame_writer(boost::asio::buffer(packet_buf));
+                writer.write_packet_header(header);
+                frames = 0;
+            }
+            if (frames == 0) {
+                writer.write_stream(frame);
+            }
+            ++frames;
+            sending.charge(s, message_size);
+        }
+        ++packets;
+        wire_size += writer.size() + stream_protocol::datagram_overhead;
+        offset += message_size;
+        benchmark::DoNotOptimize(packet_buf.data());
+    }
+    size_t messages = state.iterations() * streams.size();
+    state.SetItemsProcessed(messages);
+    state.SetBytesProcessed(messages * message_size);
+    state.counters["packets_per_msg"] = double(packets) / messages;
+    state.counters["wire_bytes_per_msg"] = double(wire_size) / messages;
+}
+BENCHMARK_CAPTURE(BM_small_streams, frame_per_packet, false)->Arg(10)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_small_streams, packed, true)->Arg(10)->Arg(1000)->Arg(10000);
+
+//=================================================================================================
+// Substream churn: n substreams of one parent are open at a time, each iteration closes
+// the oldest and opens a new one through base_stream::create(), with the host's slab pool
+// and with plain heap allocation.
+//=================================================================================================
+
+void
+BM_substream_churn(benchmark::State& state, bool pooled)
+{
+    std::shared_ptr<host> h(host::create());
+    if (not pooled) {
+        h->set_stream_pool(nullptr);
+    }
+    auto peer_id = h->host_identity().id();
+    auto parent  = base_stream::create(h, peer_id, nullptr);
+
+    std::vector<base_stream_ptr> open(state.range(0));
+    for (auto& s : open) {
+        s = base_stream::create(h, peer_id, parent);
+    }
+    size_t oldest = 0;
+    while (state.KeepRunning()) {
+        // clear() drops the peer's reference, the stream is destroyed on reassignment.
+        open[oldest]->clear();
+        open[oldest] = base_stream::create(h, peer_id, parent);
+        oldest       = (oldest + 1) % open.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    for (auto& s : open) {
+        s->clear();
+    }
+    parent->clear();
+}
+BENCHMARK_CAPTURE(BM_substream_churn, heap, false)->Arg(1)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_substream_churn, pooled, true)->Arg(1)->Arg(100)->Arg(10000);
+
+} // anonymous namespace
+
+BENCHMARK_MAIN();
@@ -10,7 +10,64 @@
 #include <boost/test/unit_test.hpp>
 
 #include "sss/channels/channel.h"
+#include "sss/host.h"
+
+using namespace sss;
+
+namespace {
+
+class test_channel : public channel
+{
+public:
+    test_channel(std::shared_ptr<host> host)
+        : channel(host, sodiumpp::secret_key(), sodiumpp::public_key(""))
+    {
+    }
+
+    bool channel_receive(boost::asio::mutable_buffer, packet_seq_t) override { return true; }
+
+    using channel::tx_message_header;
+};
+
+} // anonymous namespace
 
 BOOST_AUTO_TEST_CASE(created_channel)
 {
 }
+
+BOOST_AUTO_TEST_CASE(compact_message_routing)
+{
+    std::shared_ptr<host> h(host::create());
+    test_channel a(h), b(h);
+
+    // Each side sends with the id the other one issued.
+    auto a_rx = h->allocate_connection_id();
+    auto b_rx = h->allocate_connection_id();
+    a.set_connection_ids(b_rx, a_rx);
+    b.set_connection_ids(a_rx, b_rx);
+
+    // Channels are reachable only while active.
+    BOOST_CHECK(h->channel_for(b_rx) == nullptr);
+    a.start(true);
+    b.start(false);
+    BOOST_CHECK(h->channel_for(a_rx) == &a);
+    BOOST_CHECK(h->channel_for(b_rx) == &b);
+
+    // Packet sent by a carries b's id and is dispatched to b.
+    uint8_t packet[channels::compact_message_header::max_size + 32] = {0};
+    auto header = a.tx_message_header(1);
+    BOOST_CHECK_EQUAL(header.connection_id, b_rx);
+    BOOST_REQUIRE(header.write(boost::asio::buffer(packet)) != 0);
+    BOOST_CHECK(h->channel_for(
+                    channels::compact_message_header::peek_connection_id(
+                        boost::asio::buffer(packet)))
+                == &b);
+    BOOST_CHECK(h->receive_compact_message(boost::asio::buffer(packet),
+                                           uia::comm::socket_endpoint()));
+
+    b.stop();
+    BOOST_CHECK(h->channel_for(b_rx) == nullptr);
+    BOOST_CHECK(not h->receive_compact_message(boost::asio::buffer(packet),
+                                               uia::comm::socket_endpoint()));
+    a.stop();
+}
@@ -0,0 +1,111 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_datagram_reassembly
+#include "sss/streams/datagram_reassembly.h"
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+using namespace sss;
+using namespace boost::posix_time;
+using boost::asio::buffer;
+
+namespace {
+
+ptime const start(boost::gregorian::date(2015, 1, 1));
+
+std::string
+to_string(std::vector<uint8_t> const& data)
+{
+    return std::string(data.begin(), data.end());
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(out_of_order_fragments)
+{
+    datagram_reassembly reasm(1024);
+    std::vector<uint8_t> dg;
+
+    BOOST_CHECK(not reasm.add(1, 8, buffer("89", 2), true, start, dg));
+    BOOST_CHECK(not reasm.add(2, 0, buffer("xx", 2), false, start, dg)); // Interleaved.
+    BOOST_CHECK(not reasm.add(1, 0, buffer("0123", 4), false, start, dg));
+    BOOST_CHECK(not reasm.add(1, 0, buffer("0123", 4), false, start, dg)); // Duplicate.
+    BOOST_CHECK_EQUAL(reasm.pending(), 2u);
+
+    BOOST_CHECK(reasm.add(1, 4, buffer("4567", 4), false, start, dg));
+    BOOST_CHECK_EQUAL(to_string(dg), "0123456789");
+    BOOST_CHECK_EQUAL(reasm.pending(), 1u);
+    BOOST_CHECK_EQUAL(reasm.memory_used(), 2u);
+
+    // Fragments disagreeing on the datagram end drop it.
+    BOOST_CHECK(not reasm.add(2, 4, buffer("yy", 2), true, start, dg));
+    BOOST_CHECK(not reasm.add(2, 6, buffer("zz", 2), false, start, dg));
+    BOOST_CHECK_EQUAL(reasm.pending(), 0u);
+    BOOST_CHECK_EQUAL(reasm.dropped(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(memory_limit)
+{
+    datagram_reassembly reasm(16);
+    std::vector<uint8_t> dg;
+
+    BOOST_CHECK(not reasm.add(1, 0, buffer("aaaaaaaa", 8), false, start, dg));
+    BOOST_CHECK(not reasm.add(2, 0, buffer("bbbbbbbb", 8), false, start + seconds(1), dg));
+    BOOST_CHECK_EQUAL(reasm.memory_used(), 16u);
+
+    // The oldest partial datagram makes room for a new one.
+    BOOST_CHECK(not reasm.add(3, 0, buffer("cccc", 4), false, start + seconds(1), dg));
+    BOOST_CHECK_EQUAL(reasm.pending(), 2u);
+    BOOST_CHECK_EQUAL(reasm.dropped(), 1u);
+    BOOST_CHECK(reasm.add(2, 8, buffer("b", 1), true, start + seconds(1), dg));
+
+    // Datagrams larger than the limit are never buffered.
+    BOOST_CHECK(not reasm.add(4, 100, buffer("d", 1), false, start, dg));
+    BOOST_CHECK_EQUAL(reasm.pending(), 1u);
+    BOOST_CHECK_EQUAL(reasm.memory_used(), 4u);
+
+    reasm.set_memory_limit(2);
+    BOOST_CHECK(reasm.empty());
+}
+
+BOOST_AUTO_TEST_CASE(expiry)
+{
+    datagram_reassembly reasm(1024, seconds(2));
+    std::vector<uint8_t> dg;
+
+    reasm.add(1, 0, buffer("a", 1), false, start, dg);
+    reasm.add(2, 0, buffer("b", 1), false, start + seconds(1), dg);
+    BOOST_CHECK(reasm.next_expiry() == start + seconds(2));
+
+    BOOST_CHECK_EQUAL(reasm.expire(start + seconds(2)), 1u);
+    BOOST_CHECK(reasm.next_expiry() == start + seconds(3));
+    BOOST_CHECK_EQUAL(reasm.memory_used(), 1u);
+    BOOST_CHECK_EQUAL(reasm.expire(start + seconds(5)), 1u);
+    BOOST_CHECK(reasm.empty());
+}
+
+BOOST_AUTO_TEST_CASE(offset_overflow)
+{
+    datagram_reassembly reasm(1024);
+    std::vector<uint8_t> dg;
+    std::string fragment(100, 'x');
+
+    // Offset + size wraps around, the fragment must be rejected rather than written.
+    BOOST_CHECK(not reasm.add(1, size_t(-10), buffer(fragment), false, start, dg));
+    BOOST_CHECK(reasm.empty());
+    BOOST_CHECK_EQUAL(reasm.dropped(), 1u);
+
+    // A bogus fragment of a datagram in progress drops the whole datagram.
+    BOOST_CHECK(not reasm.add(2, 0, buffer("ab", 2), false, start, dg));
+    BOOST_CHECK(not reasm.add(2, 1020, buffer("cdefg", 5), true, start, dg));
+    BOOST_CHECK(reasm.empty());
+    BOOST_CHECK_EQUAL(reasm.memory_used(), 0u);
+    BOOST_CHECK_EQUAL(reasm.dropped(), 2u);
+}
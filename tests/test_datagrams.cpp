@@ -15,6 +15,8 @@
  *  - sending datagrams on multiple streams at once,
  *    to make sure fragmented datagrams interleave properly.
  *  - response to different line error rates.
+ *
+ * Also serves as a datagram benchmark: reports delivery ratio and goodput in simulated time.
  */
 
 #include "simulator_fixture.h"
@@ -30,6 +32,8 @@ static constexpr int max_datagram_size = 1 << max_datagram_size_log2;
 BOOST_FIXTURE_TEST_CASE(transmit_datagrams, simulator_fixture)
 {
     int n_datagrams_arrived{0};
+    size_t bytes_sent{0}, bytes_arrived{0};
+    boost::posix_time::ptime start_time, last_arrival;
     shared_ptr<sss::stream> server_stream{nullptr};
 
     auto got_datagram = [&] {
@@ -39,6 +43,8 @@ BOOST_FIXTURE_TEST_CASE(transmit_datagrams, simulator_fixture)
         }
         logger::debug() << "Received datagram size " << dec << dg.size();
         n_datagrams_arrived++;
+        bytes_arrived += dg.size();
+        last_arrival = server_host->current_time();
     };
 
     server->on_new_connection.connect([&] {
@@ -61,9 +67,13 @@ BOOST_FIXTURE_TEST_CASE(transmit_datagrams, simulator_fixture)
         if (i < DATAGRAMS_TO_SEND)
         {
             ++i;
+            if (i == 1) {
+                start_time = client_host->current_time();
+            }
             byte_array buf;
             buf.resize(1 << log2);
             client->write_datagram(buf, stream::datagram_type::non_reliable);
+            bytes_sent += buf.size();
             if (++log2 > max_datagram_size_log2) {
                 log2 = 4;
             }
@@ -78,6 +88,15 @@ BOOST_FIXTURE_TEST_CASE(transmit_datagrams, simulator_fixture)
     logger::debug() << "Datagram test completed: " << n_datagrams_arrived
         << " of " << DATAGRAMS_TO_SEND << " datagrams delivered";
 
+    if (n_datagrams_arrived > 0) {
+        double ratio   = 100.0 * n_datagrams_arrived / DATAGRAMS_TO_SEND;
+        double seconds = (last_arrival - start_time).total_microseconds() / 1e6;
+        double goodput = seconds > 0 ? bytes_arrived / seconds / 1024 : 0;
+        logger::info() << "Datagram delivery ratio " << ratio << "%, " << bytes_arrived << " of "
+                       << bytes_sent << " bytes in " << seconds << "s simulated, " << goodput
+                       << " KB/s";
+    }
+
     BOOST_CHECK(n_datagrams_arrived >= DATAGRAMS_TO_SEND*90/100);
 }
 
@@ -0,0 +1,59 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_deadline_queue
+#include "sss/channels/deadline_queue.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using namespace boost::posix_time;
+
+namespace {
+
+struct fake_stream
+{
+};
+
+ptime const start(boost::gregorian::date(2015, 1, 1));
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(earliest_deadline_first)
+{
+    deadline_queue<fake_stream> queue;
+    fake_stream a, b, c;
+    queue.push(&a, start + milliseconds(30));
+    queue.push(&b, start + milliseconds(10));
+    queue.push(&c, start + milliseconds(10));
+    BOOST_CHECK_EQUAL(queue.size(), 3u);
+    BOOST_CHECK(queue.earliest() == start + milliseconds(10));
+
+    BOOST_CHECK_EQUAL(queue.pop(), &b); // Equal deadlines in FIFO order.
+    BOOST_CHECK_EQUAL(queue.pop(), &c);
+    BOOST_CHECK_EQUAL(queue.pop(), &a);
+    BOOST_CHECK(queue.empty());
+}
+
+BOOST_AUTO_TEST_CASE(move_and_remove)
+{
+    deadline_queue<fake_stream> queue;
+    fake_stream a, b;
+    queue.push(&a, start + milliseconds(10));
+    queue.push(&b, start + milliseconds(20));
+
+    queue.push(&b, start + milliseconds(5)); // Earlier data arrived for b.
+    BOOST_CHECK_EQUAL(queue.size(), 2u);
+    BOOST_CHECK(queue.earliest() == start + milliseconds(5));
+
+    queue.remove(&b);
+    BOOST_CHECK(not queue.is_ready(&b));
+    queue.remove(&b); // Removing twice is harmless.
+    BOOST_CHECK_EQUAL(queue.pop(), &a);
+    BOOST_CHECK(queue.empty());
+}
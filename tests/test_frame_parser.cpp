@@ -0,0 +1,481 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_frame_parser
+#include "sss/framing/frame_parser.h"
+#include "sss/framing/frame_writer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+#include <string>
+#include <cstring>
+
+using namespace std;
+using namespace sss;
+using namespace sss::framing;
+
+namespace {
+
+// Build packets byte by byte, multi-byte values in network order.
+struct packet_builder
+{
+    vector<uint8_t> bytes;
+
+    packet_builder& u8(uint8_t v)
+    {
+        bytes.push_back(v);
+        return *this;
+    }
+
+    packet_builder& big(uint64_t v, size_t size)
+    {
+        for (size_t i = size; i > 0; --i) {
+            bytes.push_back(uint8_t(v >> ((i - 1) * 8)));
+        }
+        return *this;
+    }
+
+    packet_builder& raw(string const& s)
+    {
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        return *this;
+    }
+
+    boost::asio::const_buffer buffer() const { return {bytes.data(), bytes.size()}; }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(parse_packet_header)
+{
+    packet_builder p;
+    p.u8(0x01 | 0x04).big(0x0102, 2).big(0xdeadbeef, 4); // version, 4 byte sequence
+
+    frame_parser parser(p.buffer());
+    packet_header_view hdr;
+    BOOST_CHECK(parser.read_packet_header(hdr) == parse_status::ok);
+    BOOST_CHECK(hdr.has_version());
+    BOOST_CHECK(not hdr.has_fec_group());
+    BOOST_CHECK_EQUAL(hdr.version, 0x0102);
+    BOOST_CHECK_EQUAL(hdr.sequence_size, 4);
+    BOOST_CHECK_EQUAL(hdr.packet_sequence, 0xdeadbeefULL);
+    BOOST_CHECK_EQUAL(parser.offset(), 7u);
+
+    frame_view frame;
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+}
+
+BOOST_AUTO_TEST_CASE(parse_frames_in_place)
+{
+    packet_builder p;
+    p.u8(0x00).big(42, 2); // minimal header
+    // ACK with a single NACK run
+    p.u8(2).u8(1).u8(2).u8(1).big(10, 8).big(12, 8).big(500, 4).big(11, 6).big(1, 2);
+    // PRIORITY
+    p.u8(9).big(5, 4).big(7, 4).big(2, 4).big(16, 2);
+    // RESET
+    p.u8(6).big(5, 4).big(3, 4).big(4, 2).raw("oops");
+    // PADDING
+    p.u8(3).big(3, 2).big(0, 3);
+    // EMPTY
+    p.u8(0);
+    // STREAM with data length and 2-byte offset
+    p.u8(1).u8(0x02 | (1 << 2)).big(5, 4).big(1000, 2).big(5, 2).raw("hello");
+    // STREAM INIT+FIN with 8-byte offset, data until the end of packet
+    p.u8(1).u8(0x40 | 0x01 | (7 << 2)).big(6, 4).big(5, 4).big(1ULL << 40, 8).raw("tail");
+
+    frame_parser parser(p.buffer());
+    packet_header_view hdr;
+    BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+    BOOST_CHECK_EQUAL(hdr.packet_sequence, 42u);
+
+    frame_view frame;
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::ACK);
+    BOOST_CHECK_EQUAL(frame.ack.least_unacked_packet, 10u);
+    BOOST_CHECK_EQUAL(frame.ack.largest_observed_packet, 12u);
+    BOOST_CHECK_EQUAL(frame.ack.missing_packets, 1);
+    BOOST_CHECK_EQUAL(frame.ack.nack_sequence(0), 11u);
+    BOOST_CHECK_EQUAL(frame.ack.nack_run_length(0), 1);
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PRIORITY);
+    BOOST_CHECK_EQUAL(frame.priority.lsid, 5u);
+    BOOST_CHECK_EQUAL(frame.priority.priority_value, 7u);
+    BOOST_CHECK_EQUAL(frame.priority.parent_lsid, 2u);
+    BOOST_CHECK_EQUAL(frame.priority.weight, 16u);
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::RESET);
+    BOOST_CHECK_EQUAL(frame.reset.error_code, 3u);
+    BOOST_CHECK_EQUAL(string(reinterpret_cast<char const*>(frame.reset.reason_phrase.data),
+                             frame.reset.reason_phrase.size),
+                      "oops");
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PADDING);
+    BOOST_CHECK_EQUAL(frame.padding.padding.size, 3u);
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::EMPTY);
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::STREAM);
+    BOOST_CHECK_EQUAL(frame.stream.stream_id, 5u);
+    BOOST_CHECK_EQUAL(frame.stream.stream_offset, 1000u);
+    BOOST_CHECK(not frame.stream.is_init());
+    BOOST_CHECK_EQUAL(frame.stream.data.size, 5u);
+    // Payload is a view into the packet, not a copy.
+    BOOST_CHECK(frame.stream.data.data > p.bytes.data()
+                and frame.stream.data.data < p.bytes.data() + p.bytes.size());
+
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.stream.is_init());
+    BOOST_CHECK(frame.stream.is_fin());
+    BOOST_CHECK_EQUAL(frame.stream.parent_stream_id, 5u);
+    BOOST_CHECK_EQUAL(frame.stream.stream_offset, 1ULL << 40);
+    BOOST_CHECK_EQUAL(frame.stream.data.size, 4u); // Until the end of packet.
+
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_input_is_reported)
+{
+    frame_view frame;
+    packet_header_view hdr;
+
+    {
+        packet_builder p;
+        p.u8(0x0c).big(1, 4); // 8 byte sequence expected
+        frame_parser parser(p.buffer());
+        BOOST_CHECK(parser.read_packet_header(hdr) == parse_status::truncated);
+    }
+    {
+        packet_builder p;
+        p.u8(0x00).big(1, 2).u8(42);
+        frame_parser parser(p.buffer());
+        BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+        BOOST_CHECK(parser.next(frame) == parse_status::unknown_frame_type);
+    }
+    {
+        packet_builder p;
+        p.u8(0x00).big(1, 2).u8(6).big(5, 4).big(3, 4).big(100, 2).raw("short");
+        frame_parser parser(p.buffer());
+        BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+        size_t offset = parser.offset();
+        BOOST_CHECK(parser.next(frame) == parse_status::truncated);
+        BOOST_CHECK_EQUAL(parser.offset(), offset); // Position is not advanced on error.
+    }
+    {
+        packet_builder p;
+        p.u8(0x00).big(1, 2).u8(1).u8(0x20).big(5, 4).raw("data"); // USID without INIT
+        frame_parser parser(p.buffer());
+        BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+        BOOST_CHECK(parser.next(frame) == parse_status::invalid);
+    }
+    {
+        packet_builder p;
+        p.u8(0x00).big(1, 2).u8(8).big(2, 2).big(2, 2).big(1, 2).big(1, 2).u8(1); // unsorted tags
+        frame_parser parser(p.buffer());
+        BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+        BOOST_CHECK(parser.next(frame) == parse_status::invalid);
+    }
+    {
+        packet_builder p;
+        p.u8(0x00).big(1, 2).u8(9).big(5, 4).big(7, 4).big(0, 4).big(0, 2); // zero weight
+        frame_parser parser(p.buffer());
+        BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+        BOOST_CHECK(parser.next(frame) == parse_status::invalid);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(writer_round_trip)
+{
+    uint8_t buf[256];
+    string payload = "payload";
+
+    for (uint8_t seq_size : {2, 4, 6, 8}) {
+        for (int code = 0; code < 8; ++code) {
+            uint64_t offset = code == 0 ? 0 : (1ULL << ((stream_offset_size(code) - 1) * 8));
+            BOOST_CHECK_EQUAL(stream_offset_size_code(offset), code);
+
+            frame_writer writer(boost::asio::buffer(buf));
+            packet_header_view hdr{};
+            hdr.sequence_size   = seq_size;
+            hdr.packet_sequence = 0x1234;
+            BOOST_REQUIRE(writer.write_packet_header(hdr));
+
+            stream_frame_view frame{};
+            frame.stream_id     = 3;
+            frame.stream_offset = offset;
+            frame.data = {reinterpret_cast<uint8_t const*>(payload.data()), payload.size()};
+            BOOST_REQUIRE(writer.write_stream(frame));
+            BOOST_REQUIRE(writer.write_padding(10));
+
+            frame_parser parser(writer.written());
+            packet_header_view rhdr;
+            frame_view rframe;
+            BOOST_REQUIRE(parser.read_packet_header(rhdr) == parse_status::ok);
+            BOOST_CHECK_EQUAL(rhdr.sequence_size, seq_size);
+            BOOST_CHECK_EQUAL(rhdr.packet_sequence, 0x1234u);
+            BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+            BOOST_CHECK_EQUAL(rframe.stream.stream_offset, offset);
+            BOOST_CHECK_EQUAL(rframe.stream.data.size, payload.size());
+            BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+            BOOST_CHECK(rframe.type == stream_protocol::frame_type::PADDING);
+            BOOST_CHECK_EQUAL(rframe.raw.size, 10u);
+            BOOST_CHECK(parser.next(rframe) == parse_status::end_of_packet);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(credit_frames)
+{
+    uint8_t buf[32];
+    frame_writer writer(boost::asio::buffer(buf));
+    BOOST_REQUIRE(writer.write_max_data({1ULL << 40}));
+    BOOST_REQUIRE(writer.write_data_blocked({1 << 20}));
+    BOOST_CHECK_EQUAL(writer.size(), 18u);
+
+    frame_parser parser(writer.written());
+    frame_view frame;
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::MAX_DATA);
+    BOOST_CHECK_EQUAL(frame.max_data.maximum_data, 1ULL << 40);
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::DATA_BLOCKED);
+    BOOST_CHECK_EQUAL(frame.data_blocked.data_limit, 1u << 20);
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+
+    // Truncated credit value.
+    frame_parser short_parser(boost::asio::buffer(buf, 5));
+    BOOST_CHECK(short_parser.next(frame) == parse_status::truncated);
+}
+
+BOOST_AUTO_TEST_CASE(stream_credit_frames)
+{
+    uint8_t buf[32];
+    frame_writer writer(boost::asio::buffer(buf));
+    BOOST_REQUIRE(writer.write_max_stream_data({7, 1ULL << 33}));
+    BOOST_REQUIRE(writer.write_stream_data_blocked({9, 16384}));
+    BOOST_CHECK_EQUAL(writer.size(), 26u);
+
+    frame_parser parser(writer.written());
+    frame_view frame;
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::MAX_STREAM_DATA);
+    BOOST_CHECK_EQUAL(frame.max_stream_data.lsid, 7u);
+    BOOST_CHECK_EQUAL(frame.max_stream_data.maximum_stream_data, 1ULL << 33);
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::STREAM_DATA_BLOCKED);
+    BOOST_CHECK_EQUAL(frame.stream_data_blocked.lsid, 9u);
+    BOOST_CHECK_EQUAL(frame.stream_data_blocked.data_limit, 16384u);
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+
+    // Truncated limit.
+    frame_parser short_parser(boost::asio::buffer(buf, 9));
+    BOOST_CHECK(short_parser.next(frame) == parse_status::truncated);
+}
+
+BOOST_AUTO_TEST_CASE(frames_from_several_streams)
+{
+    // Frames are written first, the header goes in front once the packet sequence is known.
+    uint8_t buf[128];
+    constexpr size_t reserved = frame_writer::max_packet_header_size;
+    frame_writer frames(boost::asio::buffer(buf + reserved, sizeof(buf) - reserved));
+    for (uint32_t sid = 1; sid <= 3; ++sid) {
+        stream_frame_view frame{};
+        frame.stream_id     = sid;
+        frame.stream_offset = sid * 100;
+        frame.data          = {reinterpret_cast<uint8_t const*>("chat"), 4};
+        BOOST_REQUIRE(frames.write_stream(frame));
+    }
+
+    packet_header_view hdr{};
+    hdr.packet_sequence = 7;
+    hdr.sequence_size   = 2;
+    size_t header_size  = frame_writer::packet_header_size(hdr);
+    uint8_t* start      = buf + reserved - header_size;
+    BOOST_REQUIRE(frame_writer(boost::asio::buffer(start, header_size)).write_packet_header(hdr));
+    frame_writer packet(boost::asio::buffer(start, buf + sizeof(buf) - start),
+                        header_size + frames.size());
+
+    frame_parser parser(packet.written());
+    BOOST_REQUIRE(parser.read_packet_header(hdr) == parse_status::ok);
+    BOOST_CHECK_EQUAL(hdr.packet_sequence, 7u);
+    frame_view frame;
+    for (uint32_t sid = 1; sid <= 3; ++sid) {
+        BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+        BOOST_CHECK_EQUAL(frame.stream.stream_id, sid);
+        BOOST_CHECK_EQUAL(frame.stream.stream_offset, sid * 100);
+    }
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+}
+
+BOOST_AUTO_TEST_CASE(skip_marker)
+{
+    uint8_t buf[64];
+    frame_writer writer(boost::asio::buffer(buf));
+    stream_frame_view frame{};
+    frame.flags         = stream_frame_view::no_retransmit_flag;
+    frame.stream_id     = 3;
+    frame.stream_offset = 5000;
+    BOOST_REQUIRE(writer.write_stream(frame)); // No data, only the offset.
+    frame.flags = 0;
+    BOOST_REQUIRE(writer.write_stream(frame)); // Empty frame without NORETRANSMIT or FIN.
+
+    frame_parser parser(writer.written());
+    frame_view rframe;
+    BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+    BOOST_CHECK(rframe.stream.is_skip());
+    BOOST_CHECK_EQUAL(rframe.stream.stream_offset, 5000u);
+    BOOST_CHECK(parser.next(rframe) == parse_status::invalid);
+}
+
+BOOST_AUTO_TEST_CASE(init_with_parent_usid)
+{
+    uint8_t buf[128];
+    uint8_t const payload[] = {1, 2, 3, 4};
+    uint8_t usid[stream_frame_view::usid_size], parent_usid[stream_frame_view::usid_size];
+    memset(usid, 0x11, sizeof(usid));
+    memset(parent_usid, 0x22, sizeof(parent_usid));
+
+    frame_writer writer(boost::asio::buffer(buf));
+    stream_frame_view frame{};
+    frame.flags = stream_frame_view::init_flag | stream_frame_view::usid_flag;
+    frame.stream_id        = 9;
+    frame.parent_stream_id = stream_frame_view::parent_by_usid;
+    frame.usid             = usid;
+    frame.parent_usid      = parent_usid;
+    frame.data             = {payload, sizeof(payload)};
+    BOOST_REQUIRE(writer.write_stream(frame));
+    BOOST_CHECK_EQUAL(writer.size(),
+                      frame_writer::stream_header_size(frame) + sizeof(payload));
+
+    frame_parser parser(writer.written());
+    frame_view rframe;
+    BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+    BOOST_CHECK(rframe.stream.has_parent_usid());
+    BOOST_CHECK_EQUAL(memcmp(rframe.stream.usid, usid, sizeof(usid)), 0);
+    BOOST_CHECK_EQUAL(memcmp(rframe.stream.parent_usid, parent_usid, sizeof(parent_usid)), 0);
+    BOOST_CHECK_EQUAL(rframe.stream.data.size, sizeof(payload));
+    BOOST_CHECK(parser.next(rframe) == parse_status::end_of_packet);
+
+    // Datagrams use Parent Stream ID for the sending stream, never for a parent USID.
+    frame.flags |= stream_frame_view::no_retransmit_flag;
+    BOOST_CHECK(not frame.has_parent_usid());
+}
+
+BOOST_AUTO_TEST_CASE(join_frame)
+{
+    uint8_t buf[128];
+    uint8_t const payload[] = {1, 2, 3, 4};
+    uint8_t usid[stream_frame_view::usid_size];
+    memset(usid, 0x33, sizeof(usid));
+
+    frame_writer writer(boost::asio::buffer(buf));
+    stream_frame_view frame{};
+    frame.flags = stream_frame_view::init_flag | stream_frame_view::usid_flag;
+    frame.stream_id        = 4;
+    frame.parent_stream_id = stream_frame_view::join_path;
+    frame.usid             = usid;
+    frame.stream_offset    = 3000;
+    frame.data             = {payload, sizeof(payload)};
+    BOOST_REQUIRE(writer.write_stream(frame));
+
+    // Root stream as parent: a new top-level stream, not a join.
+    frame.parent_stream_id = 0;
+    BOOST_REQUIRE(writer.write_stream(frame));
+
+    // Join without the USID to find the stream by.
+    frame.flags            = stream_frame_view::init_flag;
+    frame.parent_stream_id = stream_frame_view::join_path;
+    BOOST_REQUIRE(writer.write_stream(frame));
+
+    frame_parser parser(writer.written());
+    frame_view rframe;
+    BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+    BOOST_CHECK(rframe.stream.is_join());
+    BOOST_CHECK(not rframe.stream.has_parent_usid());
+    BOOST_CHECK_EQUAL(memcmp(rframe.stream.usid, usid, sizeof(usid)), 0);
+    BOOST_CHECK_EQUAL(rframe.stream.stream_offset, 3000u);
+    BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+    BOOST_CHECK(not rframe.stream.is_join());
+    BOOST_CHECK_EQUAL(rframe.stream.parent_stream_id, 0u);
+    BOOST_CHECK(parser.next(rframe) == parse_status::invalid);
+}
+
+BOOST_AUTO_TEST_CASE(datagram_frame)
+{
+    uint8_t buf[64];
+    uint8_t const payload[] = {1, 2, 3, 4};
+    frame_writer writer(boost::asio::buffer(buf));
+    stream_frame_view frame{};
+    frame.flags = stream_frame_view::init_flag | stream_frame_view::no_retransmit_flag
+                  | stream_frame_view::fin_flag;
+    frame.stream_id        = 7; // Datagram number.
+    frame.parent_stream_id = 2;
+    frame.stream_offset    = 1200;
+    frame.data             = {payload, sizeof(payload)};
+    BOOST_REQUIRE(writer.write_stream(frame));
+    frame.flags = stream_frame_view::init_flag | stream_frame_view::no_retransmit_flag;
+    frame.data  = {};
+    BOOST_REQUIRE(writer.write_stream(frame)); // Empty fragment is not a skip marker.
+
+    frame_parser parser(writer.written());
+    frame_view rframe;
+    BOOST_REQUIRE(parser.next(rframe) == parse_status::ok);
+    BOOST_CHECK(rframe.stream.is_datagram());
+    BOOST_CHECK(not rframe.stream.is_skip());
+    BOOST_CHECK(rframe.stream.is_fin());
+    BOOST_CHECK_EQUAL(rframe.stream.stream_id, 7u);
+    BOOST_CHECK_EQUAL(rframe.stream.parent_stream_id, 2u);
+    BOOST_CHECK_EQUAL(rframe.stream.stream_offset, 1200u);
+    BOOST_CHECK_EQUAL(rframe.stream.data.size, sizeof(payload));
+    BOOST_CHECK(parser.next(rframe) == parse_status::invalid);
+}
+
+BOOST_AUTO_TEST_CASE(path_validation_frames)
+{
+    uint8_t buf[32];
+    frame_writer writer(boost::asio::buffer(buf));
+    BOOST_REQUIRE(writer.write_path_challenge({0x0123456789abcdefULL}));
+    BOOST_REQUIRE(writer.write_path_response({0x0123456789abcdefULL}));
+    BOOST_CHECK_EQUAL(writer.size(), 18u);
+
+    frame_parser parser(writer.written());
+    frame_view frame;
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PATH_CHALLENGE);
+    BOOST_CHECK_EQUAL(frame.path_challenge.data, 0x0123456789abcdefULL);
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PATH_RESPONSE);
+    BOOST_CHECK_EQUAL(frame.path_response.data, 0x0123456789abcdefULL);
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+
+    frame_parser short_parser(boost::asio::buffer(buf, 8));
+    BOOST_CHECK(short_parser.next(frame) == parse_status::truncated);
+}
+
+BOOST_AUTO_TEST_CASE(ping_frame)
+{
+    uint8_t buf[8];
+    frame_writer writer(boost::asio::buffer(buf));
+    BOOST_REQUIRE(writer.write_ping());
+    BOOST_REQUIRE(writer.write_padding(writer.remaining()));
+
+    frame_parser parser(writer.written());
+    frame_view frame;
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PING);
+    BOOST_CHECK_EQUAL(frame.raw.size, 1u);
+    BOOST_REQUIRE(parser.next(frame) == parse_status::ok);
+    BOOST_CHECK(frame.type == stream_protocol::frame_type::PADDING);
+    BOOST_CHECK(parser.next(frame) == parse_status::end_of_packet);
+}
@@ -0,0 +1,66 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_message_header
+#include "sss/channels/message_header.h"
+
+#include <boost/test/unit_test.hpp>
+#include <array>
+#include <cstring>
+
+using namespace sss::channels;
+using boost::asio::buffer;
+
+BOOST_AUTO_TEST_CASE(compact_header_round_trip)
+{
+    std::array<uint8_t, 64> buf;
+
+    for (uint8_t size : {2, 4, 6, 8}) {
+        compact_message_header out{0x0102030405060708ULL, 0x123456789aULL, size};
+        BOOST_CHECK_EQUAL(out.write(buffer(buf)), 1u + 8 + size);
+        BOOST_CHECK(compact_message_header::is_compact(buffer(buf)));
+        BOOST_CHECK_EQUAL(compact_message_header::peek_connection_id(buffer(buf)),
+                          0x0102030405060708ULL);
+
+        compact_message_header in;
+        // Receiver has seen packets just before this one.
+        BOOST_CHECK_EQUAL(in.read(buffer(buf), 0x123456789aULL - 10), out.size());
+        BOOST_CHECK_EQUAL(in.nonce_size, size);
+        BOOST_CHECK_EQUAL(in.connection_id, out.connection_id);
+        BOOST_CHECK_EQUAL(in.nonce, out.nonce);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_header_is_smaller)
+{
+    // magic + short-term public key + nonce
+    BOOST_CHECK_LT(size_t(compact_message_header::max_size), 8u + 32 + 8);
+}
+
+BOOST_AUTO_TEST_CASE(full_packets_are_not_compact)
+{
+    char const magic[] = "messagep";
+    BOOST_CHECK(not compact_message_header::is_compact(buffer(magic, 8)));
+    BOOST_CHECK_EQUAL(compact_message_header::peek_connection_id(buffer(magic, 8)), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_compact_header)
+{
+    std::array<uint8_t, 64> buf;
+    compact_message_header hdr{42, 1000, 8};
+
+    BOOST_CHECK_EQUAL(hdr.write(buffer(buf.data(), 10)), 0u); // Doesn't fit.
+    hdr.nonce_size = 3;
+    BOOST_CHECK_EQUAL(hdr.write(buffer(buf)), 0u); // Invalid nonce size.
+
+    hdr.nonce_size = 8;
+    hdr.write(buffer(buf));
+    BOOST_CHECK_EQUAL(hdr.read(buffer(buf.data(), 12), 0), 0u); // Truncated.
+    buf[0] |= 0x10;
+    BOOST_CHECK_EQUAL(hdr.read(buffer(buf), 0), 0u); // Reserved bits set.
+}
@@ -0,0 +1,73 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_packet_sequence
+#include "sss/framing/packet_sequence.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using namespace sss::framing;
+
+namespace {
+
+uint64_t
+truncate(packet_seq_t seq, uint8_t size)
+{
+    return size >= 8 ? seq : seq & ((1ULL << (size * 8)) - 1);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(shortest_safe_size)
+{
+    BOOST_CHECK_EQUAL(packet_sequence_size(1, 0), 2);
+    BOOST_CHECK_EQUAL(packet_sequence_size(100000, 99990), 2);
+    BOOST_CHECK_EQUAL(packet_sequence_size(0x8000, 0), 4);
+    BOOST_CHECK_EQUAL(packet_sequence_size(0x7fff, 0), 2);
+    BOOST_CHECK_EQUAL(packet_sequence_size(1ULL << 40, 0), 6);
+    BOOST_CHECK_EQUAL(packet_sequence_size(1ULL << 50, 1), 8);
+    // Acks running ahead of what we send (shouldn't happen) still yield a valid size.
+    BOOST_CHECK_EQUAL(packet_sequence_size(5, 10), 2);
+}
+
+BOOST_AUTO_TEST_CASE(expand_all_widths)
+{
+    packet_seq_t const bases[] = {0, 1, 0xfffe, 0x10000, 0xfffffff0ULL, 0x123456789abcULL,
+                                  0xfffffffffff0ULL};
+
+    for (uint8_t size : {2, 4, 6, 8}) {
+        for (packet_seq_t largest : bases) {
+            // Anything within the half-window around expected sequence must round-trip,
+            // including reordered packets from the past and jumps ahead after losses.
+            uint64_t half = size >= 8 ? (1ULL << 62) : (1ULL << (size * 8 - 1));
+            for (int64_t delta : {int64_t(1), int64_t(2), int64_t(-1), int64_t(100)}) {
+                packet_seq_t seq = largest + delta;
+                if (delta < 0 and largest < packet_seq_t(-delta)) {
+                    continue;
+                }
+                BOOST_CHECK_EQUAL(expand_packet_sequence(truncate(seq, size), size, largest), seq);
+            }
+            packet_seq_t ahead = largest + half; // Furthest unambiguous jump.
+            BOOST_CHECK_EQUAL(expand_packet_sequence(truncate(ahead, size), size, largest), ahead);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sender_and_receiver_agree)
+{
+    // Receiver that has seen everything up to largest_acked must recover
+    // every packet sent with the size chosen by the sender.
+    for (packet_seq_t acked : {packet_seq_t(0), packet_seq_t(70000), packet_seq_t(1ULL << 33)}) {
+        for (packet_seq_t inflight : {1ULL, 100ULL, 40000ULL, 3000000000ULL}) {
+            packet_seq_t seq = acked + inflight;
+            uint8_t size     = packet_sequence_size(seq, acked);
+            BOOST_CHECK_EQUAL(expand_packet_sequence(truncate(seq, size), size, acked), seq);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_padding_policy
+#include "sss/framing/padding_policy.h"
+
+#include <boost/test/unit_test.hpp>
+#include <array>
+
+using namespace sss;
+using namespace sss::framing;
+
+namespace {
+
+std::array<uint8_t, 1168> packet_buf;
+
+/// Write a packet of given size, pad it and check the result parses back.
+size_t
+pad_packet(padding_policy& policy, size_t size, size_t max_size = packet_buf.size())
+{
+    frame_writer writer(boost::asio::buffer(packet_buf.data(), max_size));
+    writer.write_detach({1});
+    while (writer.size() < size) {
+        writer.write_empty();
+    }
+    policy.pad(writer);
+
+    frame_parser parser(writer.written());
+    frame_view frame;
+    parse_status status;
+    while ((status = parser.next(frame)) == parse_status::ok) {
+    }
+    BOOST_CHECK(status == parse_status::end_of_packet);
+    return writer.size();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(padding_modes)
+{
+    padding_policy policy(padding_policy::mode::none);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 37), 37u);
+
+    policy.set_mode(padding_policy::mode::multiple_16);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 37), 48u);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 46), 48u); // EMPTY frames fill 2-byte remainder.
+    BOOST_CHECK_EQUAL(pad_packet(policy, 64), 64u);
+
+    policy.set_mode(padding_policy::mode::buckets);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 37), 128u);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 300), 512u);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 1100), 1168u);
+
+    policy.set_mode(padding_policy::mode::full);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 37), 1168u);
+    BOOST_CHECK_EQUAL(pad_packet(policy, 37, 500), 500u); // Never exceeds the buffer.
+}
+
+BOOST_AUTO_TEST_CASE(padding_counters)
+{
+    padding_policy policy(padding_policy::mode::multiple_16);
+    pad_packet(policy, 37);
+    pad_packet(policy, 64);
+
+    auto const& stats = policy.stats();
+    BOOST_CHECK_EQUAL(stats.packets, 2u);
+    BOOST_CHECK_EQUAL(stats.padded_packets, 1u);
+    BOOST_CHECK_EQUAL(stats.payload_bytes, 37u + 64);
+    BOOST_CHECK_EQUAL(stats.padding_bytes, 11u);
+
+    policy.reset_stats();
+    BOOST_CHECK_EQUAL(policy.stats().packets, 0u);
+}
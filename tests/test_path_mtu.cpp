@@ -0,0 +1,100 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_path_mtu
+#include "sss/channels/path_mtu_discovery.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using namespace sss::channels;
+
+namespace {
+
+/**
+ * Run discovery against a path that drops everything above path_mtu.
+ * @return number of probes sent.
+ */
+int
+discover(path_mtu_discovery& pmtu, size_t path_mtu)
+{
+    int probes = 0;
+    for (size_t size; (size = pmtu.next_probe_size()) != 0; ++probes) {
+        BOOST_REQUIRE_LT(probes, 100);
+        BOOST_CHECK_EQUAL(size % path_mtu_discovery::search_granularity, 0u);
+        pmtu.probe_sent(probes + 1, size);
+        if (size <= path_mtu) {
+            pmtu.probe_acked();
+        } else {
+            pmtu.probe_lost();
+        }
+    }
+    return probes;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(starts_at_base_mtu)
+{
+    path_mtu_discovery pmtu;
+    BOOST_CHECK_EQUAL(pmtu.mtu(), stream_protocol::mtu);
+    BOOST_CHECK(pmtu.current_state() == path_mtu_discovery::state::searching);
+    BOOST_CHECK_GT(pmtu.next_probe_size(), stream_protocol::mtu);
+}
+
+BOOST_AUTO_TEST_CASE(jumbo_path_validates_in_one_probe)
+{
+    path_mtu_discovery pmtu(stream_protocol::jumbo_mtu);
+    BOOST_CHECK_EQUAL(discover(pmtu, stream_protocol::jumbo_mtu), 1);
+    BOOST_CHECK_EQUAL(pmtu.mtu(), 8992u); // Rounded down to search granularity.
+    BOOST_CHECK(pmtu.current_state() == path_mtu_discovery::state::search_complete);
+}
+
+BOOST_AUTO_TEST_CASE(binary_search_finds_path_mtu)
+{
+    for (size_t path : {1280u, 1400u, 1500u, 4000u, 8999u}) {
+        path_mtu_discovery pmtu(stream_protocol::jumbo_mtu);
+        discover(pmtu, path);
+        BOOST_CHECK_LE(pmtu.mtu(), path);
+        BOOST_CHECK_GT(pmtu.mtu() + path_mtu_discovery::search_granularity, path);
+        BOOST_CHECK(pmtu.current_state() == path_mtu_discovery::state::search_complete);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(single_probe_loss_is_retried)
+{
+    path_mtu_discovery pmtu(stream_protocol::ethernet_mtu);
+    size_t size = pmtu.next_probe_size();
+    pmtu.probe_sent(1, size);
+    pmtu.probe_lost();
+    BOOST_CHECK_EQUAL(pmtu.next_probe_size(), size);
+    pmtu.probe_sent(2, size);
+    BOOST_CHECK(pmtu.probe_acked());
+    BOOST_CHECK_EQUAL(pmtu.mtu(), size);
+}
+
+BOOST_AUTO_TEST_CASE(black_hole_falls_back_to_base)
+{
+    path_mtu_discovery pmtu(stream_protocol::jumbo_mtu);
+    discover(pmtu, stream_protocol::jumbo_mtu);
+
+    // Route changed, large packets vanish.
+    for (int i = 1; i < path_mtu_discovery::black_hole_threshold; ++i) {
+        BOOST_CHECK(not pmtu.packet_lost(pmtu.mtu()));
+    }
+    pmtu.packet_acked(stream_protocol::mtu); // Small packets still get through.
+    BOOST_CHECK(pmtu.packet_lost(pmtu.mtu()));
+    BOOST_CHECK_EQUAL(pmtu.mtu(), stream_protocol::mtu);
+    BOOST_CHECK(pmtu.current_state() == path_mtu_discovery::state::black_hole);
+    BOOST_CHECK_EQUAL(pmtu.next_probe_size(), 0u);
+
+    // Periodic restart finds the new path MTU.
+    pmtu.restart();
+    discover(pmtu, 1500);
+    BOOST_CHECK_EQUAL(pmtu.mtu(), 1488u);
+}
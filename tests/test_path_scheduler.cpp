@@ -0,0 +1,106 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_path_scheduler
+#include "sss/channels/path_scheduler.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using namespace boost::posix_time;
+
+namespace {
+
+struct fake_path
+{
+    path_estimate estimate;
+    bool active{true};
+    size_t sent{0};
+
+    fake_path(int rtt_ms, size_t window)
+    {
+        estimate.srtt   = milliseconds(rtt_ms);
+        estimate.window = window;
+    }
+
+    inline bool is_active() const { return active; }
+    inline path_estimate tx_path_estimate() const { return estimate; }
+};
+
+/// Send fixed size frames on the selected path, all of them get acked at the end of a round.
+void
+transmit(path_scheduler<fake_path>& paths, int rounds, int frames, size_t frame_size = 1000)
+{
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < frames; ++i) {
+            fake_path* path = paths.select(frame_size);
+            path->sent += frame_size;
+            path->estimate.in_flight += frame_size;
+        }
+        for (auto path : paths.paths()) {
+            path->estimate.in_flight = 0;
+        }
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(delivery_time)
+{
+    fake_path path(100, 10000);
+    BOOST_CHECK(path.estimate.delivery_time(0) == milliseconds(50));
+    path.estimate.in_flight = 5000;
+    BOOST_CHECK(path.estimate.delivery_time(5000) == milliseconds(150));
+
+    path.estimate.window = 0;
+    BOOST_CHECK(path.estimate.delivery_time(1000).is_pos_infinity());
+}
+
+BOOST_AUTO_TEST_CASE(lower_delay_first)
+{
+    path_scheduler<fake_path> paths;
+    fake_path slow(200, 64000), fast(20, 64000);
+    paths.add(&slow);
+    paths.add(&fast);
+    paths.add(&fast); // Adding twice is harmless.
+    BOOST_CHECK_EQUAL(paths.size(), 2u);
+    BOOST_CHECK_EQUAL(paths.select(1000), &fast);
+
+    // Once the fast path queues up enough, the slow one delivers sooner.
+    fast.estimate.in_flight = 640000;
+    BOOST_CHECK_EQUAL(paths.select(1000), &slow);
+}
+
+BOOST_AUTO_TEST_CASE(stripe_by_bandwidth)
+{
+    // Equal delays, one path has three times the window: it gets three times the frames.
+    path_scheduler<fake_path> paths;
+    fake_path a(50, 30000), b(50, 10000);
+    paths.add(&a);
+    paths.add(&b);
+
+    transmit(paths, 100, 40);
+    BOOST_CHECK_EQUAL(a.sent + b.sent, 4000000u);
+    BOOST_CHECK_EQUAL(a.sent, 3 * b.sent);
+}
+
+BOOST_AUTO_TEST_CASE(inactive_paths_skipped)
+{
+    path_scheduler<fake_path> paths;
+    BOOST_CHECK(paths.select(1000) == nullptr);
+
+    fake_path a(10, 10000), b(100, 10000);
+    paths.add(&a);
+    paths.add(&b);
+    a.active = false;
+    BOOST_CHECK_EQUAL(paths.select(1000), &b);
+
+    paths.remove(&b);
+    BOOST_CHECK(not paths.contains(&b));
+    BOOST_CHECK(paths.select(1000) == nullptr);
+}
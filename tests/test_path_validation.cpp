@@ -0,0 +1,69 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_path_validation
+#include "sss/channels/path_validation.h"
+
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+
+BOOST_AUTO_TEST_CASE(validate_new_address)
+{
+    path_validation<std::string> path;
+    BOOST_CHECK(not path.in_progress());
+
+    BOOST_CHECK(path.packet_from("10.0.0.2:9660", true, 0x1234));
+    path.challenge_sent();
+    BOOST_CHECK(path.in_progress());
+    BOOST_CHECK_EQUAL(path.candidate(), "10.0.0.2:9660");
+
+    // More packets from the same address don't restart the challenge.
+    BOOST_CHECK(not path.packet_from("10.0.0.2:9660", true, 0x5678));
+    BOOST_CHECK_EQUAL(path.challenge(), 0x1234u);
+
+    BOOST_CHECK(not path.response(0x5678));
+    BOOST_CHECK(path.response(0x1234));
+    BOOST_CHECK(not path.in_progress());
+    BOOST_CHECK(not path.response(0x1234)); // Duplicate response is ignored.
+}
+
+BOOST_AUTO_TEST_CASE(old_packets_ignored)
+{
+    // A replayed or reordered packet must not redirect the channel.
+    path_validation<std::string> path;
+    BOOST_CHECK(not path.packet_from("192.168.1.1:9660", false, 0x1));
+    BOOST_CHECK(not path.in_progress());
+}
+
+BOOST_AUTO_TEST_CASE(peer_moves_again)
+{
+    path_validation<std::string> path;
+    BOOST_CHECK(path.packet_from("10.0.0.2:9660", true, 0x1));
+    path.challenge_sent();
+    BOOST_CHECK(path.packet_from("10.0.0.3:9660", true, 0x2));
+    BOOST_CHECK_EQUAL(path.attempts(), 0u);
+    BOOST_CHECK(not path.response(0x1));
+    BOOST_CHECK(path.response(0x2));
+    BOOST_CHECK_EQUAL(path.candidate(), "10.0.0.3:9660");
+}
+
+BOOST_AUTO_TEST_CASE(give_up_after_retries)
+{
+    path_validation<std::string> path;
+    BOOST_CHECK(path.packet_from("10.0.0.2:9660", true, 0x1));
+    for (unsigned i = 1; i < path_validation<std::string>::max_challenges; ++i) {
+        path.challenge_sent();
+        BOOST_CHECK(path.challenge_lost());
+    }
+    path.challenge_sent();
+    BOOST_CHECK(not path.challenge_lost());
+    BOOST_CHECK(not path.in_progress());
+    BOOST_CHECK(not path.response(0x1));
+}
@@ -0,0 +1,133 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_priority_tree
+#include "sss/channels/priority_tree.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+
+namespace {
+
+struct fake_stream
+{
+    size_t sent{0};
+};
+
+/// Run the channel transmit loop with always-ready streams sending fixed size packets.
+void
+transmit(priority_tree<fake_stream>& tree, int packets, size_t packet_size = 1000)
+{
+    for (int i = 0; i < packets; ++i) {
+        fake_stream* s = tree.pop();
+        s->sent += packet_size;
+        tree.charge(s, packet_size);
+        tree.push(s);
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(parent_relative_shares)
+{
+    // Two top-level streams share equally, no matter how many substreams each one has.
+    priority_tree<fake_stream> tree;
+    fake_stream a, b, a1, a2, a3, b1;
+    tree.insert(&a, nullptr);
+    tree.insert(&b, nullptr);
+    tree.insert(&a1, &a);
+    tree.insert(&a2, &a, 0, 2);
+    tree.insert(&a3, &a);
+    tree.insert(&b1, &b);
+    for (auto s : {&a1, &a2, &a3, &b1}) {
+        tree.push(s);
+    }
+    BOOST_CHECK_EQUAL(tree.size(), 4u);
+
+    transmit(tree, 800);
+    BOOST_CHECK_EQUAL(a1.sent + a2.sent + a3.sent, b1.sent);
+    BOOST_CHECK_EQUAL(a2.sent, 2 * a1.sent);
+    BOOST_CHECK_EQUAL(a1.sent, a3.sent);
+}
+
+BOOST_AUTO_TEST_CASE(parent_before_children)
+{
+    priority_tree<fake_stream> tree;
+    fake_stream parent, child;
+    tree.insert(&child, &parent);
+    tree.push(&child);
+    tree.push(&parent);
+
+    BOOST_CHECK_EQUAL(tree.pop(), &parent);
+    BOOST_CHECK_EQUAL(tree.pop(), &child);
+    BOOST_CHECK(tree.empty());
+}
+
+BOOST_AUTO_TEST_CASE(reprioritize_subtree)
+{
+    priority_tree<fake_stream> tree;
+    fake_stream a, b, a1, b1;
+    tree.insert(&a1, &a);
+    tree.insert(&b1, &b);
+    tree.push(&a1);
+    tree.push(&b1);
+
+    // Raising the parent takes its whole subtree along.
+    tree.set_weight(&b, 1, 1);
+    BOOST_CHECK_EQUAL(tree.pop(), &b1);
+    tree.push(&b1);
+    BOOST_CHECK_EQUAL(tree.pop(), &b1);
+
+    // Moving b1 under a makes it compete with a1 inside a's share.
+    tree.set_parent(&b1, &a);
+    tree.set_weight(&b1, 0, 3);
+    tree.push(&b1);
+    transmit(tree, 400);
+    BOOST_CHECK_EQUAL(b1.sent, 3 * a1.sent);
+}
+
+BOOST_AUTO_TEST_CASE(no_cycles)
+{
+    // Moving a node under its own descendant lifts the descendant first.
+    priority_tree<fake_stream> tree;
+    fake_stream a, b, c;
+    tree.insert(&a, nullptr);
+    tree.insert(&b, &a);
+    tree.insert(&c, &b);
+    tree.push(&c);
+
+    tree.set_parent(&a, &c); // Now c -> a -> b.
+    tree.push(&b);
+    tree.push(&a);
+    BOOST_CHECK_EQUAL(tree.pop(), &c);
+    BOOST_CHECK_EQUAL(tree.pop(), &a);
+    BOOST_CHECK_EQUAL(tree.pop(), &b);
+    BOOST_CHECK(tree.empty());
+}
+
+BOOST_AUTO_TEST_CASE(remove_keeps_children)
+{
+    priority_tree<fake_stream> tree;
+    fake_stream a, b, c;
+    tree.insert(&b, &a);
+    tree.insert(&c, &b);
+    tree.push(&b);
+    tree.push(&c);
+
+    tree.remove(&b);
+    BOOST_CHECK(not tree.contains(&b));
+    BOOST_CHECK_EQUAL(tree.size(), 1u);
+    BOOST_CHECK_EQUAL(tree.pop(), &c);
+    BOOST_CHECK(tree.empty());
+
+    tree.charge(&b, 100); // Forgotten items are ignored.
+    tree.remove(&a);
+    tree.push(&c); // c moved up to the root.
+    BOOST_CHECK_EQUAL(tree.pop(), &c);
+}
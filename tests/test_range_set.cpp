@@ -0,0 +1,91 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_range_set
+#include "sss/streams/range_set.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+
+BOOST_AUTO_TEST_CASE(add_merges_ranges)
+{
+    range_set set;
+    BOOST_CHECK_EQUAL(set.add(0, 100), 100u);
+    BOOST_CHECK_EQUAL(set.add(200, 300), 100u);
+    BOOST_CHECK_EQUAL(set.intervals(), 2u);
+
+    // Adjacent segments collapse into one interval.
+    BOOST_CHECK_EQUAL(set.add(100, 150), 50u);
+    BOOST_CHECK_EQUAL(set.intervals(), 2u);
+
+    // Overlap only counts new bytes.
+    BOOST_CHECK_EQUAL(set.add(120, 220), 50u);
+    BOOST_CHECK_EQUAL(set.intervals(), 1u);
+    BOOST_CHECK_EQUAL(set.total_size(), 300u);
+    BOOST_CHECK_EQUAL(set.lowest(), 0u);
+    BOOST_CHECK_EQUAL(set.highest(), 300u);
+}
+
+BOOST_AUTO_TEST_CASE(remove_splits_ranges)
+{
+    range_set set;
+    set.add(0, 1000);
+
+    // Out of order ACK punches a hole.
+    BOOST_CHECK_EQUAL(set.remove(400, 500), 100u);
+    BOOST_CHECK_EQUAL(set.intervals(), 2u);
+    BOOST_CHECK(not set.intersects(400, 500));
+    BOOST_CHECK(set.intersects(350, 450));
+    BOOST_CHECK(set.contains(0, 400));
+    BOOST_CHECK(not set.contains(0, 450));
+
+    // Duplicate ACK removes nothing.
+    BOOST_CHECK_EQUAL(set.remove(400, 500), 0u);
+
+    // Range spanning the hole.
+    BOOST_CHECK_EQUAL(set.remove(300, 600), 200u);
+    BOOST_CHECK_EQUAL(set.total_size(), 700u);
+
+    BOOST_CHECK_EQUAL(set.remove(0, 300), 300u);
+    BOOST_CHECK_EQUAL(set.lowest(), 600u);
+    BOOST_CHECK_EQUAL(set.intervals(), 1u);
+
+    BOOST_CHECK_EQUAL(set.remove(0, 2000), 400u);
+    BOOST_CHECK(set.empty());
+    BOOST_CHECK_EQUAL(set.total_size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(contiguous_end)
+{
+    range_set set;
+    set.add(0, 100);
+    set.add(150, 200);
+    BOOST_CHECK_EQUAL(set.contiguous_end(0), 100u);
+    BOOST_CHECK_EQUAL(set.contiguous_end(50), 100u);
+    BOOST_CHECK_EQUAL(set.contiguous_end(100), 100u);
+    BOOST_CHECK_EQUAL(set.contiguous_end(160), 200u);
+    BOOST_CHECK_EQUAL(set.contiguous_end(300), 300u);
+}
+
+BOOST_AUTO_TEST_CASE(memory_scales_with_holes)
+{
+    range_set set;
+    // 1000 segments written back to back are a single interval.
+    for (byte_seq_t seq = 0; seq < 1168000; seq += 1168) {
+        set.add(seq, seq + 1168);
+    }
+    BOOST_CHECK_EQUAL(set.intervals(), 1u);
+
+    // Every other segment ACKed leaves one interval per remaining segment.
+    for (byte_seq_t seq = 0; seq < 1168000; seq += 2 * 1168) {
+        set.remove(seq, seq + 1168);
+    }
+    BOOST_CHECK_EQUAL(set.intervals(), 500u);
+    BOOST_CHECK_EQUAL(set.total_size(), 500u * 1168);
+}
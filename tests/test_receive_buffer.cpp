@@ -0,0 +1,184 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_receive_buffer
+#include "sss/streams/receive_buffer.h"
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+using namespace sss;
+using boost::asio::buffer;
+
+namespace {
+
+std::string
+to_string(boost::asio::const_buffer buf)
+{
+    return std::string(boost::asio::buffer_cast<char const*>(buf), boost::asio::buffer_size(buf));
+}
+
+std::string
+read_all(receive_buffer& buf)
+{
+    std::string out(buf.available(), '\0');
+    buf.read(&out[0], out.size());
+    return out;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(in_order)
+{
+    receive_buffer buf(16, 100);
+    BOOST_CHECK_EQUAL(buf.insert(100, buffer("hello", 5)), 5u);
+    BOOST_CHECK_EQUAL(buf.insert(105, buffer(" world", 6)), 6u);
+    BOOST_CHECK_EQUAL(buf.ready_seq(), 111u);
+
+    char part[4];
+    BOOST_CHECK_EQUAL(buf.read(part, 4), 4u); // Partial read.
+    BOOST_CHECK_EQUAL(std::string(part, 4), "hell");
+    BOOST_CHECK_EQUAL(read_all(buf), "o world");
+    BOOST_CHECK_EQUAL(buf.used(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(reordering)
+{
+    receive_buffer buf(32);
+    BOOST_CHECK_EQUAL(buf.insert(8, buffer("89ab", 4)), 0u);
+    BOOST_CHECK_EQUAL(buf.insert(4, buffer("4567", 4)), 0u);
+    BOOST_CHECK_EQUAL(buf.out_of_order(), 8u);
+    BOOST_CHECK_EQUAL(buf.out_of_order_ranges(), 1u);
+    BOOST_CHECK(buf.is_duplicate(8, 4));
+    BOOST_CHECK(not buf.is_duplicate(2, 4));
+
+    // Filling the gap makes everything contiguous.
+    BOOST_CHECK_EQUAL(buf.insert(0, buffer("0123", 4)), 12u);
+    BOOST_CHECK_EQUAL(buf.out_of_order(), 0u);
+    BOOST_CHECK_EQUAL(read_all(buf), "0123456789ab");
+
+    // Data we already have is dropped.
+    BOOST_CHECK(buf.is_duplicate(4, 4));
+    BOOST_CHECK_EQUAL(buf.insert(4, buffer("XXXX", 4)), 0u);
+    BOOST_CHECK_EQUAL(buf.insert(10, buffer("XXcd", 4)), 2u);
+    BOOST_CHECK_EQUAL(read_all(buf), "cd");
+}
+
+BOOST_AUTO_TEST_CASE(wrap_and_window)
+{
+    receive_buffer buf(8);
+    buf.insert(0, buffer("012345", 6));
+    read_all(buf);
+
+    // Wraps around the end of storage.
+    BOOST_CHECK_EQUAL(buf.insert(6, buffer("6789", 4)), 4u);
+    // Beyond capacity of the ring is dropped, sender will retransmit.
+    BOOST_CHECK_EQUAL(buf.insert(10, buffer("abcdefgh", 8)), 4u);
+    BOOST_CHECK_EQUAL(read_all(buf), "6789abcd");
+
+    // Growing keeps buffered data in place.
+    buf.insert(14, buffer("gh", 2));
+    buf.insert(18, buffer("kl", 2));
+    BOOST_CHECK(buf.set_capacity(64));
+    BOOST_CHECK_EQUAL(buf.insert(16, buffer("ij", 2)), 4u);
+    BOOST_CHECK(not buf.set_capacity(4)); // Buffered data doesn't fit.
+    BOOST_CHECK_EQUAL(read_all(buf), "ghijkl");
+
+    // Capacity is rounded up to a power of two.
+    BOOST_CHECK_EQUAL(receive_buffer(1000).capacity(), 1024u);
+}
+
+BOOST_AUTO_TEST_CASE(scatter_read)
+{
+    receive_buffer buf(16);
+    buf.insert(0, buffer("0123456789ab", 12));
+
+    char header[3], skip[2], body[16];
+    boost::asio::mutable_buffer buffers[] = {buffer(header), {nullptr, 2}, buffer(body)};
+
+    // Stops at max_size, in the middle of the last buffer.
+    BOOST_CHECK_EQUAL(buf.read(buffers, 3, 10), 10u);
+    BOOST_CHECK_EQUAL(std::string(header, 3), "012");
+    BOOST_CHECK_EQUAL(std::string(body, 5), "56789");
+
+    // Stops when data runs out.
+    boost::asio::mutable_buffer more[] = {buffer(skip), buffer(body)};
+    BOOST_CHECK_EQUAL(buf.read(more, 2, 100), 2u);
+    BOOST_CHECK_EQUAL(std::string(skip, 2), "ab");
+    BOOST_CHECK_EQUAL(buf.available(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(peek_and_consume)
+{
+    receive_buffer buf(8);
+    buf.insert(0, buffer("012345", 6));
+    buf.consume(4);
+    buf.insert(6, buffer("6789", 4));
+
+    // Available data wraps, so it is borrowed in two pieces.
+    auto views = buf.peek(100);
+    BOOST_CHECK_EQUAL(to_string(views[0]), "4567");
+    BOOST_CHECK_EQUAL(to_string(views[1]), "89");
+
+    views = buf.peek(3);
+    BOOST_CHECK_EQUAL(to_string(views[0]), "456");
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(views[1]), 0u);
+
+    // Views stay valid while more data arrives.
+    buf.insert(10, buffer("ab", 2));
+    BOOST_CHECK_EQUAL(to_string(views[0]), "456");
+
+    BOOST_CHECK_EQUAL(buf.consume(5), 5u);
+    BOOST_CHECK_EQUAL(to_string(buf.peek(100)[0]), "9ab");
+    BOOST_CHECK_EQUAL(buf.consume(100), 3u);
+    BOOST_CHECK_EQUAL(buf.available(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(same_capacity_keeps_views)
+{
+    receive_buffer buf(8);
+    buf.insert(0, buffer("0123", 4));
+    auto views = buf.peek(100);
+
+    // 7 rounds up to the current capacity, storage must stay where it is.
+    BOOST_CHECK(buf.set_capacity(7));
+    BOOST_CHECK_EQUAL(buf.capacity(), 8u);
+    BOOST_CHECK(boost::asio::buffer_cast<void const*>(buf.peek(100)[0])
+                == boost::asio::buffer_cast<void const*>(views[0]));
+    BOOST_CHECK_EQUAL(to_string(views[0]), "0123");
+}
+
+BOOST_AUTO_TEST_CASE(skip_holes)
+{
+    receive_buffer buf(32);
+    buf.insert(0, buffer("01", 2));
+    buf.insert(4, buffer("45", 2));
+    buf.insert(8, buffer("89", 2));
+
+    // Holes up to the skip point read as zeros, data after them becomes available too.
+    auto holes = buf.skip_to(10);
+    BOOST_REQUIRE_EQUAL(holes.size(), 2u);
+    BOOST_CHECK_EQUAL(holes[0].first, 2u);
+    BOOST_CHECK_EQUAL(holes[0].second, 4u);
+    BOOST_CHECK_EQUAL(holes[1].first, 6u);
+    BOOST_CHECK_EQUAL(holes[1].second, 8u);
+    BOOST_CHECK_EQUAL(buf.out_of_order(), 0u);
+    BOOST_CHECK_EQUAL(read_all(buf), std::string("01\0\0" "45\0\0" "89", 10));
+
+    // Late data for a skipped hole is a duplicate.
+    BOOST_CHECK(buf.is_duplicate(6, 2));
+    BOOST_CHECK_EQUAL(buf.insert(6, buffer("67", 2)), 0u);
+
+    // Skipping into the middle of buffered data stops at its end.
+    buf.insert(12, buffer("cdef", 4));
+    holes = buf.skip_to(13);
+    BOOST_REQUIRE_EQUAL(holes.size(), 1u);
+    BOOST_CHECK_EQUAL(holes[0].first, 10u);
+    BOOST_CHECK_EQUAL(buf.ready_seq(), 16u);
+    BOOST_CHECK(buf.skip_to(14).empty());
+}
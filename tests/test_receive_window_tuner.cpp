@@ -0,0 +1,60 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_receive_window_tuner
+#include "sss/streams/receive_window_tuner.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using namespace boost::posix_time;
+
+namespace {
+
+ptime const start(boost::gregorian::date(2015, 1, 1));
+time_duration const rtt = milliseconds(100);
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(grows_to_bandwidth_delay_product)
+{
+    receive_window_tuner tuner(65536, 65536);
+
+    // Nothing measured until a full RTT has passed.
+    BOOST_CHECK_EQUAL(tuner.drained(60000, start, rtt), 65536u);
+    BOOST_CHECK_EQUAL(tuner.drained(60000, start + milliseconds(50), rtt), 65536u);
+
+    // 1 MB drained per 100 ms RTT: window should cover two RTTs of it.
+    BOOST_CHECK_EQUAL(tuner.drained(880000, start + milliseconds(100), rtt), 2000000u);
+}
+
+BOOST_AUTO_TEST_CASE(slow_reader_keeps_window)
+{
+    receive_window_tuner tuner(65536, 65536);
+    tuner.drained(1000, start, rtt);
+    BOOST_CHECK_EQUAL(tuner.drained(1000, start + milliseconds(200), rtt), 65536u);
+}
+
+BOOST_AUTO_TEST_CASE(window_limits)
+{
+    receive_window_tuner tuner(65536, 65536, 1 << 20);
+    tuner.drained(0, start, rtt);
+    BOOST_CHECK_EQUAL(tuner.drained(10 << 20, start + rtt, rtt), 1u << 20);
+
+    tuner.set_window(1 << 30);
+    BOOST_CHECK_EQUAL(tuner.window(), 1u << 20);
+    tuner.set_window(0);
+    BOOST_CHECK_EQUAL(tuner.window(), 65536u);
+
+    tuner.set_limits(4096, 1 << 20);
+    tuner.set_window(1 << 20);
+    BOOST_CHECK_EQUAL(tuner.shrink_target(0), 1u << 19);
+    BOOST_CHECK_EQUAL(tuner.shrink_target(800000), 800000u);
+    tuner.set_window(6000);
+    BOOST_CHECK_EQUAL(tuner.shrink_target(0), 4096u);
+}
@@ -0,0 +1,110 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_send_buffer
+#include "sss/streams/send_buffer.h"
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+
+using namespace sss;
+using namespace boost::asio;
+
+namespace {
+
+std::string
+to_string(const_buffer buf)
+{
+    return std::string(buffer_cast<char const*>(buf), buffer_size(buf));
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(append_and_release)
+{
+    send_buffer buf(16, 100);
+    BOOST_CHECK(buf.empty());
+    BOOST_CHECK_EQUAL(buf.base_seq(), 100u);
+
+    auto slice = buf.append("hello", 5);
+    BOOST_CHECK_EQUAL(to_string(slice), "hello");
+    BOOST_CHECK_EQUAL(buf.size(), 5u);
+    BOOST_CHECK_EQUAL(buf.end_seq(), 105u);
+
+    // Retransmission reads the very same bytes.
+    BOOST_CHECK_EQUAL(buffer_cast<void const*>(buf.slice(100, 5)), buffer_cast<void const*>(slice));
+
+    BOOST_CHECK_EQUAL(buf.release_to(103), 3u);
+    BOOST_CHECK_EQUAL(buf.release_to(101), 0u); // Already released.
+    BOOST_CHECK_EQUAL(buf.release_to(200), 2u); // Clamped to end.
+    BOOST_CHECK(buf.empty());
+}
+
+BOOST_AUTO_TEST_CASE(wrap_around)
+{
+    send_buffer buf(16);
+    buf.append("0123456789ab", 12);
+    buf.release_to(12);
+
+    // Only 4 bytes fit before the end of storage, the rest goes into the next slice.
+    auto first = buf.append("ABCDEFGH", 8);
+    BOOST_CHECK_EQUAL(to_string(first), "ABCD");
+    auto second = buf.append("EFGH", 4);
+    BOOST_CHECK_EQUAL(to_string(second), "EFGH");
+    BOOST_CHECK_EQUAL(to_string(buf.slice(16, 4)), "EFGH");
+    BOOST_CHECK_EQUAL(buf.size(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(watermarks)
+{
+    send_buffer buf(16);
+    buf.set_watermarks(4, 10);
+    BOOST_CHECK_EQUAL(buf.free_space(), 10u);
+
+    auto slice = buf.append("0123456789abcdef", 16);
+    BOOST_CHECK_EQUAL(buffer_size(slice), 10u);
+    BOOST_CHECK(buf.above_high_watermark());
+    BOOST_CHECK_EQUAL(buf.free_space(), 0u);
+    BOOST_CHECK_EQUAL(buffer_size(buf.append("x", 1)), 0u);
+
+    buf.release_to(5);
+    BOOST_CHECK(not buf.above_high_watermark());
+    BOOST_CHECK(not buf.below_low_watermark());
+    buf.release_to(6);
+    BOOST_CHECK(buf.below_low_watermark());
+
+    buf.set_watermarks(20, 100); // Clamped to capacity.
+    BOOST_CHECK_EQUAL(buf.high_watermark(), 16u);
+    BOOST_CHECK_EQUAL(buf.low_watermark(), 16u);
+}
+
+BOOST_AUTO_TEST_CASE(adopt_without_copy)
+{
+    send_buffer buf(16);
+    buf.set_watermarks(4, 8);
+    buf.append("01", 2);
+
+    auto owner = std::make_shared<std::string>("adopted bytes");
+    auto slice = buf.adopt(buffer(*owner), owner);
+    BOOST_CHECK_EQUAL(buffer_cast<void const*>(slice), owner->data()); // Not copied.
+    BOOST_CHECK_EQUAL(buf.end_seq(), 15u);
+    BOOST_CHECK(buf.above_high_watermark()); // Accepted whole, counts towards watermarks.
+    BOOST_CHECK_EQUAL(owner.use_count(), 2);
+
+    // Owner is held until the whole adopted range is released.
+    buf.release_to(10);
+    BOOST_CHECK_EQUAL(owner.use_count(), 2);
+    buf.release_to(15);
+    BOOST_CHECK_EQUAL(owner.use_count(), 1);
+
+    // Copying continues after the adopted range, at its position in the ring.
+    BOOST_CHECK_EQUAL(to_string(buf.append("xyz", 3)), "x");
+    BOOST_CHECK_EQUAL(to_string(buf.append("yz", 2)), "yz");
+    BOOST_CHECK_EQUAL(buf.end_seq(), 18u);
+}
@@ -0,0 +1,94 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_slab_pool
+#include "sss/internal/slab_pool.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+
+namespace {
+
+struct fake_stream
+{
+    int id;
+    char state[200];
+
+    explicit fake_stream(int i)
+        : id(i)
+    {
+    }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(reuse_blocks)
+{
+    slab_pool pool(4);
+    void* a = pool.allocate(100);
+    void* b = pool.allocate(100);
+    BOOST_CHECK_EQUAL(pool.in_use(), 2u);
+    BOOST_CHECK_EQUAL(pool.capacity(), 4u);
+
+    pool.deallocate(a, 100);
+    BOOST_CHECK_EQUAL(pool.allocate(100), a); // Most recently freed block comes back first.
+
+    std::vector<void*> more;
+    for (int i = 0; i < 5; ++i) {
+        more.push_back(pool.allocate(100));
+    }
+    BOOST_CHECK_EQUAL(pool.capacity(), 8u); // Grown by another slab.
+    BOOST_CHECK_EQUAL(pool.in_use(), 7u);
+
+    for (void* p : more) {
+        pool.deallocate(p, 100);
+    }
+    pool.deallocate(a, 100);
+    pool.deallocate(b, 100);
+    BOOST_CHECK_EQUAL(pool.in_use(), 0u);
+    BOOST_CHECK_EQUAL(pool.capacity(), 8u); // Slabs are kept.
+}
+
+BOOST_AUTO_TEST_CASE(other_sizes_not_pooled)
+{
+    slab_pool pool;
+    void* a = pool.allocate(64);
+    void* b = pool.allocate(1000);
+    BOOST_CHECK_EQUAL(pool.in_use(), 1u);
+    BOOST_CHECK_EQUAL(pool.block_size() % alignof(std::max_align_t), 0u);
+    pool.deallocate(b, 1000);
+    pool.deallocate(a, 64);
+    BOOST_CHECK_EQUAL(pool.in_use(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(shared_objects)
+{
+    auto pool = std::make_shared<slab_pool>();
+    slab_allocator<fake_stream> alloc(pool);
+
+    auto a = std::allocate_shared<fake_stream>(alloc, 1);
+    auto b = std::allocate_shared<fake_stream>(alloc, 2);
+    BOOST_CHECK_EQUAL(pool->in_use(), 2u);
+    BOOST_CHECK_GT(pool->block_size(), sizeof(fake_stream)); // Control block included.
+
+    std::weak_ptr<fake_stream> weak = a;
+    a.reset();
+    BOOST_CHECK_EQUAL(pool->in_use(), 2u); // Control block lives on while weakly referenced.
+    weak.reset();
+    BOOST_CHECK_EQUAL(pool->in_use(), 1u);
+
+    // Objects keep the pool alive.
+    std::weak_ptr<slab_pool> weak_pool = pool;
+    pool.reset();
+    alloc = slab_allocator<fake_stream>(std::make_shared<slab_pool>());
+    BOOST_CHECK(not weak_pool.expired());
+    BOOST_CHECK_EQUAL(b->id, 2);
+    b.reset();
+    BOOST_CHECK(weak_pool.expired());
+}
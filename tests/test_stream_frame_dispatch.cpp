@@ -0,0 +1,84 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_stream_frame_dispatch
+#include "sss/streams/stream_frame_dispatch.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace sss;
+using framing::stream_frame_view;
+
+namespace {
+
+uint8_t const usid[stream_frame_view::usid_size] = {};
+
+/// Frame a stream sends on a new channel when resuming after its last one failed.
+stream_frame_view
+rejoin_frame()
+{
+    stream_frame_view frame{};
+    frame.flags            = stream_frame_view::init_flag | stream_frame_view::usid_flag;
+    frame.stream_id        = 3;
+    frame.parent_stream_id = stream_frame_view::join_path;
+    frame.usid             = usid;
+    frame.stream_offset    = 65536;
+    return frame;
+}
+
+stream_frame_view
+init_frame(uint32_t parent_stream_id)
+{
+    stream_frame_view frame{};
+    frame.flags            = stream_frame_view::init_flag;
+    frame.stream_id        = 5;
+    frame.parent_stream_id = parent_stream_id;
+    return frame;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(rejoin_known_stream)
+{
+    BOOST_CHECK(classify_unattached_frame(rejoin_frame(), true, false)
+                == unattached_frame_action::join);
+}
+
+BOOST_AUTO_TEST_CASE(rejoin_unknown_stream_is_reset)
+{
+    // Never falls back to the root stream as parent, however the parent lookup went.
+    BOOST_CHECK(classify_unattached_frame(rejoin_frame(), false, false)
+                == unattached_frame_action::reset);
+    BOOST_CHECK(classify_unattached_frame(rejoin_frame(), false, true)
+                == unattached_frame_action::reset);
+}
+
+BOOST_AUTO_TEST_CASE(new_top_level_stream)
+{
+    // Root stream (LSID 0) is always attached.
+    BOOST_CHECK(classify_unattached_frame(init_frame(0), false, true)
+                == unattached_frame_action::create);
+}
+
+BOOST_AUTO_TEST_CASE(unknown_parent)
+{
+    BOOST_CHECK(classify_unattached_frame(init_frame(7), false, false)
+                == unattached_frame_action::hold);
+
+    auto frame        = init_frame(stream_frame_view::parent_by_usid);
+    frame.parent_usid = usid;
+    BOOST_CHECK(classify_unattached_frame(frame, false, false) == unattached_frame_action::reset);
+    BOOST_CHECK(classify_unattached_frame(frame, false, true) == unattached_frame_action::create);
+}
+
+BOOST_AUTO_TEST_CASE(data_for_unknown_stream_is_reset)
+{
+    stream_frame_view frame{};
+    frame.stream_id = 9;
+    BOOST_CHECK(classify_unattached_frame(frame, false, false) == unattached_frame_action::reset);
+}
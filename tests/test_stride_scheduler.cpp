@@ -0,0 +1,123 @@
+//
+// Part of Metta OS. Check http://atta-metta.net for latest version.
+//
+// Copyright 2007 - 2015, Stanislav Karchebnyy <berkus@atta-metta.net>
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See file LICENSE_1_0.txt or a copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#define BOOST_TEST_MODULE Test_stride_scheduler
+#include "sss/channels/stride_scheduler.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+
+using namespace sss;
+
+namespace {
+
+struct fake_stream
+{
+    size_t packet_size;
+    size_t sent{0};
+};
+
+/// Run the channel transmit loop for a number of packets: pop, send, charge and requeue.
+void
+transmit(stride_scheduler<fake_stream>& sched, int packets, uint32_t priority = 0,
+         std::map<fake_stream*, uint32_t> const& weights = {})
+{
+    for (int i = 0; i < packets; ++i) {
+        fake_stream* s = sched.pop();
+        s->sent += s->packet_size;
+        sched.charge(s, s->packet_size);
+        auto w = weights.find(s);
+        sched.push(s, priority, w == weights.end() ? 1 : w->second);
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(strict_priority)
+{
+    stride_scheduler<fake_stream> sched;
+    fake_stream low{100}, high{100};
+    sched.push(&low, 1);
+    sched.push(&high, 2);
+    BOOST_CHECK_EQUAL(sched.size(), 2u);
+
+    BOOST_CHECK_EQUAL(sched.pop(), &high);
+    sched.charge(&high, 1000000);
+    sched.push(&high, 2);
+    BOOST_CHECK_EQUAL(sched.pop(), &high); // Pass doesn't matter across levels.
+    BOOST_CHECK_EQUAL(sched.pop(), &low);
+    BOOST_CHECK(sched.empty());
+}
+
+BOOST_AUTO_TEST_CASE(byte_fairness)
+{
+    stride_scheduler<fake_stream> sched;
+    fake_stream small{100}, large{1000};
+    sched.push(&small, 0);
+    sched.push(&large, 0);
+
+    // Equal weights get equal bytes, not equal packets.
+    transmit(sched, 1100);
+    BOOST_CHECK_LE(std::abs(long(small.sent) - long(large.sent)), 1000);
+    BOOST_CHECK_EQUAL(small.sent / small.packet_size, 10 * (large.sent / large.packet_size));
+}
+
+BOOST_AUTO_TEST_CASE(weights)
+{
+    stride_scheduler<fake_stream> sched;
+    fake_stream a{500}, b{500};
+    sched.push(&a, 0, 3);
+    sched.push(&b, 0, 1);
+
+    transmit(sched, 400, 0, {{&a, 3}, {&b, 1}});
+    BOOST_CHECK_EQUAL(a.sent, 3 * b.sent);
+}
+
+BOOST_AUTO_TEST_CASE(idle_stream_does_not_burst)
+{
+    stride_scheduler<fake_stream> sched;
+    fake_stream busy{1000}, idle{1000};
+    sched.push(&busy, 0);
+    sched.push(&idle, 0);
+    BOOST_CHECK_EQUAL(sched.pop(), &busy);
+    sched.charge(&busy, 1000);
+    sched.push(&busy, 0);
+    BOOST_CHECK_EQUAL(sched.pop(), &idle); // idle goes quiet after one packet
+    sched.charge(&idle, 1000);
+
+    transmit(sched, 50);
+    BOOST_CHECK_EQUAL(busy.sent, 50000u);
+
+    // Returning stream alternates with the busy one instead of catching up 50 packets.
+    sched.push(&idle, 0);
+    transmit(sched, 10);
+    BOOST_CHECK_EQUAL(idle.sent, 5000u);
+}
+
+BOOST_AUTO_TEST_CASE(remove_and_reprioritize)
+{
+    stride_scheduler<fake_stream> sched;
+    fake_stream a{1}, b{1}, c{1};
+    sched.push(&a, 0);
+    sched.push(&b, 0);
+    sched.push(&c, 0);
+
+    sched.remove(&b);
+    BOOST_CHECK(not sched.is_ready(&b));
+    BOOST_CHECK_EQUAL(sched.size(), 2u);
+
+    sched.push(&c, 5); // Priority change moves it up.
+    BOOST_CHECK_EQUAL(sched.size(), 2u);
+    BOOST_CHECK_EQUAL(sched.pop(), &c);
+    BOOST_CHECK_EQUAL(sched.pop(), &a);
+    BOOST_CHECK(sched.empty());
+
+    sched.remove(&a);
+    sched.charge(&a, 100); // Forgotten items are ignored.
+    BOOST_CHECK(not sched.is_ready(&a));
+}
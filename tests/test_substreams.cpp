@@ -119,3 +119,57 @@ BOOST_FIXTURE_TEST_CASE(multiple_substreams, substreams_fixture)
     BOOST_CHECK(received[5].as_string() == "ONE!");
 }
 
+
+// Request and response on a fresh substream take a single round trip,
+// the same as on a stream that is already attached.
+BOOST_FIXTURE_TEST_CASE(substream_request_one_rtt, substreams_fixture)
+{
+    // Server answers every record on the stream it came in on.
+    std::function<void(std::shared_ptr<stream>)> serve = [&](std::shared_ptr<stream> s) {
+        s->set_child_receive_buffer_size(16384);
+        s->listen(stream::buffer_limit);
+        s->on_ready_read_record.connect([s] {
+            s->read_record();
+            s->write_record("RESPONSE");
+        });
+        s->on_new_substream.connect([&, s] {
+            while (auto sub = s->accept_substream()) {
+                serve(sub);
+            }
+        });
+        streams.emplace_back(s);
+    };
+    server->on_new_connection.connect([&] { serve(server->accept()); });
+
+    boost::posix_time::time_duration attached_rtt, substream_rtt;
+    boost::posix_time::ptime sent;
+    std::shared_ptr<stream> substream;
+
+    client->on_ready_read_record.connect([&] {
+        client->read_record();
+        attached_rtt = client_host->current_time() - sent;
+
+        substream = client->open_substream();
+        substream->on_ready_read_record.connect([&] {
+            received.emplace_back(substream->read_record());
+            substream_rtt = client_host->current_time() - sent;
+        });
+        sent = client_host->current_time();
+        substream->write_record("REQUEST");
+    });
+
+    client->on_link_up.connect([&] {
+        sent = client_host->current_time();
+        client->write_record("REQUEST");
+    });
+
+    client->connect_to(server_host_eid, "simulator", "test", server_host_address);
+
+    simulator->run();
+
+    BOOST_REQUIRE(received.size() == 1);
+    BOOST_CHECK(received[0].as_string() == "RESPONSE");
+    logger::debug() << "Request on attached stream took " << attached_rtt << ", on new substream "
+                    << substream_rtt;
+    BOOST_CHECK(substream_rtt <= attached_rtt + attached_rtt / 2);
+}